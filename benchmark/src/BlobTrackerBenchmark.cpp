@@ -0,0 +1,1048 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//! Headless benchmark of the blob tracker on synthetic video. Runs a suite of scenarios and writes the
+//! throughput and latency percentiles of each as JSON, for comparing builds and gating regressions.
+//!
+//! Usage: BlobTrackerBenchmark [--frames N] [--warmup N] [--width N] [--height N] [--blobs N] [--pairs N]
+//!                             [--radius R] [--speed S] [--noise N] [--seed N] [--filter TEXT] [--output FILE]
+//! --filter runs only the scenarios whose name contains TEXT. The JSON goes to stdout without --output.
+//! Exits with 2 if a check/ scenario failed, a tuio/ scenario received bad bundles or allocated, or an allocations/
+//! scenario of a mode documented not to allocate did.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mndl/blobtracker/BlobTracker.h"
+#include "mndl/blobtracker/BlobTrackerPool.h"
+#include "mndl/blobtracker/TuioSender.h"
+
+#include "PipelineChecks.h"
+#include "SyntheticVideo.h"
+#include "TuioReceiver.h"
+
+using namespace ci;
+using namespace mndl::blobtracker;
+using namespace std;
+
+namespace {
+
+//! Heap allocations of the whole program through operator new.
+atomic< uint64_t > sNumAllocations( 0 );
+
+//! Counts and allocates \a size bytes, aligned to \a alignment if it is beyond what malloc() guarantees.
+void * allocate( size_t size, size_t alignment )
+{
+	sNumAllocations.fetch_add( 1, memory_order_relaxed );
+	size = ( size > 0 ) ? size : 1;
+	void *p = nullptr;
+	if ( alignment <= alignof( max_align_t ) )
+	{
+		p = malloc( size );
+	}
+	else if ( posix_memalign( &p, alignment, size ) != 0 )
+	{
+		p = nullptr;
+	}
+	if ( p == nullptr )
+	{
+		throw bad_alloc();
+	}
+	return p;
+}
+
+} // anonymous namespace
+
+// counts the allocations, the array and nothrow forms call these by default, all are freed with free()
+void * operator new( size_t size )
+{
+	return allocate( size, 0 );
+}
+
+void * operator new( size_t size, align_val_t alignment )
+{
+	return allocate( size, size_t( alignment ) );
+}
+
+void operator delete( void *p ) noexcept
+{
+	free( p );
+}
+
+void operator delete( void *p, size_t ) noexcept
+{
+	free( p );
+}
+
+void operator delete( void *p, align_val_t ) noexcept
+{
+	free( p );
+}
+
+void operator delete( void *p, size_t, align_val_t ) noexcept
+{
+	free( p );
+}
+
+namespace {
+
+struct Config
+{
+	int mFrames = 300;
+	int mWarmup = 20;
+	SyntheticVideo::Params mVideo;
+	string mFilter;
+	string mOutput;
+};
+
+struct Measurement
+{
+	string mName;
+	int mWidth = 0;
+	int mHeight = 0;
+	uint64_t mFrames = 0;
+	double mSeconds = 0.0;
+	vector< double > mLatencies; //!< per frame in seconds, empty if frames are not timed one by one
+	double mBlobsSum = 0.0;
+	vector< pair< string, double > > mMetrics;
+	Stats mStats; //!< of the timed frames, empty for the pool
+};
+
+double now()
+{
+	return chrono::duration< double >( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+//! Returns the nearest rank \a p percentile of the sorted \a values.
+double percentile( const vector< double > &values, double p )
+{
+	if ( values.empty() )
+	{
+		return 0.0;
+	}
+	size_t rank = size_t( std::ceil( p * double( values.size() ) ) );
+	return values[ std::min( std::max( rank, size_t( 1 ) ), values.size() ) - 1 ];
+}
+
+//! Accumulates the distance of the true disc centers from the nearest tracked blob.
+struct Accuracy
+{
+	double mErrorSum = 0.0;
+	uint64_t mNumFound = 0;
+	uint64_t mNumTruth = 0;
+
+	void add( const vector< vec2 > &truth, const BlobPool &blobs, const vec2 &scale, float maxDistance )
+	{
+		for ( const vec2 &t : truth )
+		{
+			float best = maxDistance;
+			for ( const vec2 &p : blobs.mPositions )
+			{
+				best = std::min( best, glm::distance( t, p * scale ) );
+			}
+			if ( best < maxDistance )
+			{
+				mErrorSum += best;
+				mNumFound++;
+			}
+			mNumTruth++;
+		}
+	}
+};
+
+//! Renders \a frame to \a surface as gray RGB.
+void toColor( const Channel8u &frame, Surface8u *surface )
+{
+	const int inc = surface->getPixelInc();
+	for ( int y = 0; y < frame.getHeight(); y++ )
+	{
+		const uint8_t *src = frame.getData() + size_t( y ) * frame.getRowBytes();
+		uint8_t *dst = surface->getData() + size_t( y ) * surface->getRowBytes();
+		for ( int x = 0; x < frame.getWidth(); x++, dst += inc )
+		{
+			dst[ surface->getRedOffset() ] = dst[ surface->getGreenOffset() ] = dst[ surface->getBlueOffset() ] = src[ x ];
+		}
+	}
+}
+
+//! Renders \a frame to \a depth, the discs at 1000 in front of the background at 3000.
+void toDepth( const Channel8u &frame, Channel16u *depth )
+{
+	const int range = SyntheticVideo::kForeground - SyntheticVideo::kBackground;
+	for ( int y = 0; y < frame.getHeight(); y++ )
+	{
+		const uint8_t *src = frame.getData() + size_t( y ) * frame.getRowBytes();
+		uint16_t *dst = reinterpret_cast< uint16_t * >( reinterpret_cast< uint8_t * >( depth->getData() ) +
+														size_t( y ) * depth->getRowBytes() );
+		for ( int x = 0; x < frame.getWidth(); x++ )
+		{
+			dst[ x ] = uint16_t( std::max( 3000 - ( int( src[ x ] ) - SyntheticVideo::kBackground ) * 2000 / range, 1 ) );
+		}
+	}
+}
+
+//! Runs update() of a tracker created with \a options over the video of \a video, timing each frame
+//! after the warmup. \a onFrame is called after each timed frame. The frames are passed in \a format,
+//! converted before the timing.
+Measurement runTracker( const Config &config, const string &name, const SyntheticVideo::Params &video,
+						const BlobTracker::Options &options,
+						const function< void( const SyntheticVideo &, const BlobTracker & ) > &onFrame = nullptr,
+						InputFrame::Format format = InputFrame::Format::GRAY )
+{
+	Measurement m;
+	m.mName = name;
+	m.mWidth = video.mWidth;
+	m.mHeight = video.mHeight;
+
+	SyntheticVideo source( video );
+	BlobTrackerRef tracker = BlobTracker::create( options );
+	Surface8u surface;
+	Channel16u depth;
+	if ( format == InputFrame::Format::COLOR )
+	{
+		surface = Surface8u( video.mWidth, video.mHeight, false );
+	}
+	else if ( format == InputFrame::Format::DEPTH )
+	{
+		depth = Channel16u( video.mWidth, video.mHeight );
+	}
+	m.mLatencies.reserve( config.mFrames );
+	uint64_t numAllocations = 0;
+	for ( int i = 0; i < config.mWarmup + config.mFrames; i++ )
+	{
+		const Channel8u &frame = source.nextFrame();
+		if ( format == InputFrame::Format::COLOR )
+		{
+			toColor( frame, &surface );
+		}
+		else if ( format == InputFrame::Format::DEPTH )
+		{
+			toDepth( frame, &depth );
+		}
+		if ( i == config.mWarmup )
+		{
+			tracker->resetStats();
+		}
+		uint64_t allocationsBefore = sNumAllocations.load();
+		double start = now();
+		if ( format == InputFrame::Format::COLOR )
+		{
+			tracker->update( surface );
+		}
+		else if ( format == InputFrame::Format::DEPTH )
+		{
+			tracker->update( depth );
+		}
+		else
+		{
+			tracker->update( frame );
+		}
+		double latency = now() - start;
+		if ( i < config.mWarmup )
+		{
+			continue;
+		}
+
+		numAllocations += sNumAllocations.load() - allocationsBefore;
+		m.mLatencies.push_back( latency );
+		m.mSeconds += latency;
+		m.mBlobsSum += double( tracker->getNumBlobs() );
+		m.mFrames++;
+		if ( onFrame )
+		{
+			onFrame( source, *tracker );
+		}
+	}
+	m.mStats = tracker->getStats();
+	m.mMetrics.push_back( make_pair( "allocations_per_frame",
+			double( numAllocations ) / double( std::max( m.mFrames, uint64_t( 1 ) ) ) ) );
+	return m;
+}
+
+//! Runs the frames of \a video twice through a tracker created with \a options and counts the heap allocations
+//! of update() in the timed frames of the second run. The buffers have grown to the largest frame of the video
+//! by then, so the modes documented not to allocate should not allocate at all.
+Measurement runAllocations( const Config &config, const string &name, const SyntheticVideo::Params &video,
+							const BlobTracker::Options &options )
+{
+	Measurement m;
+	m.mName = name;
+	m.mWidth = video.mWidth;
+	m.mHeight = video.mHeight;
+
+	BlobTrackerRef tracker = BlobTracker::create( options );
+	uint64_t numAllocations = 0;
+	for ( int pass = 0; pass < 2; pass++ )
+	{
+		// the tracks of the last frame die and the ones of the first are born again in the warmup
+		SyntheticVideo source( video );
+		for ( int i = 0; i < config.mWarmup + config.mFrames; i++ )
+		{
+			const Channel8u &frame = source.nextFrame();
+			uint64_t allocationsBefore = sNumAllocations.load();
+			double start = now();
+			tracker->update( frame );
+			double latency = now() - start;
+			if ( ( pass == 0 ) || ( i < config.mWarmup ) )
+			{
+				continue;
+			}
+
+			numAllocations += sNumAllocations.load() - allocationsBefore;
+			m.mLatencies.push_back( latency );
+			m.mSeconds += latency;
+			m.mBlobsSum += double( tracker->getNumBlobs() );
+			m.mFrames++;
+		}
+	}
+	m.mMetrics.push_back( make_pair( "allocations", double( numAllocations ) ) );
+	return m;
+}
+
+//! Feeds \a numStreams videos to a BlobTrackerPool as fast as it takes them and measures the throughput.
+Measurement runPool( const Config &config, const string &name, const SyntheticVideo::Params &video,
+					 const BlobTracker::Options &options, size_t numStreams )
+{
+	Measurement m;
+	m.mName = name;
+	m.mWidth = video.mWidth;
+	m.mHeight = video.mHeight;
+
+	// the frames are rendered up front, so the sources do not compete with the pool for the cores
+	const int numCached = 8;
+	vector< vector< Channel8u > > frames( numStreams );
+	for ( size_t s = 0; s < numStreams; s++ )
+	{
+		SyntheticVideo::Params streamVideo = video;
+		streamVideo.mSeed = video.mSeed + uint32_t( s );
+		SyntheticVideo source( streamVideo );
+		for ( int i = 0; i < numCached; i++ )
+		{
+			frames[ s ].push_back( source.nextFrame().clone() );
+		}
+	}
+
+	BlobTrackerPoolRef pool = BlobTrackerPool::create( 0, 2 );
+	for ( size_t s = 0; s < numStreams; s++ )
+	{
+		pool->addStream( options );
+	}
+
+	auto numDropped = [ & ]()
+	{
+		uint64_t n = 0;
+		for ( size_t s = 0; s < numStreams; s++ )
+		{
+			n += pool->getNumDroppedFrames( s );
+		}
+		return n;
+	};
+
+	// a rejected frame is offered again instead of dropped, so every accepted frame is either tracked or
+	// replaced by a later one, returns the number replaced
+	auto feed = [ & ]( int numRounds, uint64_t *numTracked )
+	{
+		uint64_t droppedBefore = numDropped();
+		uint64_t accepted = 0;
+		uint64_t rejected = 0;
+		for ( int i = 0; i < numRounds; i++ )
+		{
+			for ( size_t s = 0; s < numStreams; s++ )
+			{
+				while ( ! pool->update( s, frames[ s ][ i % numCached ] ) )
+				{
+					rejected++;
+					*numTracked += pool->dispatchEvents();
+					this_thread::yield();
+				}
+				accepted++;
+			}
+			*numTracked += pool->dispatchEvents();
+		}
+		auto numReplaced = [ & ]() { return numDropped() - droppedBefore - rejected; };
+		while ( *numTracked + numReplaced() < accepted )
+		{
+			*numTracked += pool->dispatchEvents();
+			this_thread::yield();
+		}
+		return numReplaced();
+	};
+
+	uint64_t warmupTracked = 0;
+	feed( config.mWarmup, &warmupTracked );
+	uint64_t numTracked = 0;
+	double start = now();
+	uint64_t numReplaced = feed( config.mFrames, &numTracked );
+	m.mSeconds = now() - start;
+	m.mFrames = numTracked;
+	for ( size_t s = 0; s < numStreams; s++ )
+	{
+		m.mBlobsSum += double( pool->getTracker( s )->getNumBlobs() ) * double( numTracked ) / double( numStreams );
+	}
+	m.mMetrics.push_back( make_pair( "streams", double( numStreams ) ) );
+	m.mMetrics.push_back( make_pair( "threads", double( pool->getWorkStealingPool()->getNumThreads() ) ) );
+	m.mMetrics.push_back( make_pair( "replaced_frames", double( numReplaced ) ) );
+	return m;
+}
+
+//! Sends the frames tracked from \a video through a TuioSender to a loopback TuioReceiver as fast as send()
+//! returns, timing the packing of each frame. The frames are sent twice and the second run is timed, the buffers
+//! have grown to the largest frame by then, so its heap allocations are counted. The throughput of the sending
+//! thread is a metric. The last metric counts the failed checks: malformed bundles, bundles larger than the
+//! maximum packet size, alive ids of the last bundle differing from the sender's and allocations of send().
+Measurement runTuio( const Config &config, const string &name, const SyntheticVideo::Params &video,
+					 const BlobTracker::Options &options, const TuioSender::Options &tuioOptions )
+{
+	Measurement m;
+	m.mName = name;
+	m.mWidth = video.mWidth;
+	m.mHeight = video.mHeight;
+
+	// the frames from the first, so the sender sees every blob begin, then a background frame ending all blobs, so
+	// the second run starts without blobs like the first
+	vector< FrameResultRef > frames;
+	{
+		SyntheticVideo source( video );
+		BlobTrackerRef tracker = BlobTracker::create( options );
+		for ( int i = 0; i < config.mWarmup + config.mFrames; i++ )
+		{
+			tracker->update( source.nextFrame() );
+			frames.push_back( tracker->getFrameResult() );
+		}
+		Channel8u background( video.mWidth, video.mHeight );
+		for ( int y = 0; y < video.mHeight; y++ )
+		{
+			std::memset( background.getData() + y * background.getRowBytes(), SyntheticVideo::kBackground,
+						 size_t( video.mWidth ) );
+		}
+		tracker->update( background );
+		frames.push_back( tracker->getFrameResult() );
+	}
+
+	uint64_t numFailures = 1;
+	TuioReceiver receiver;
+	receiver.setMaxPacketSize( tuioOptions.getMaxPacketSize() );
+	if ( ! receiver.open() )
+	{
+		fprintf( stderr, "cannot open the loopback receiver\n" );
+		m.mMetrics.push_back( make_pair( "failures", double( numFailures ) ) );
+		return m;
+	}
+	TuioSenderRef sender = TuioSender::create( "127.0.0.1", receiver.getPort(), tuioOptions );
+	if ( ! sender )
+	{
+		fprintf( stderr, "cannot create the sender\n" );
+		m.mMetrics.push_back( make_pair( "failures", double( numFailures ) ) );
+		return m;
+	}
+	numFailures = 0;
+
+	double start = now();
+	for ( const FrameResultRef &frame : frames )
+	{
+		sender->send( frame );
+	}
+	// the background frame is left out, so the last bundle has alive ids to compare
+	uint64_t numAllocations = 0;
+	for ( size_t i = 0; i + 1 < frames.size(); i++ )
+	{
+		uint64_t allocationsBefore = sNumAllocations.load();
+		double packStart = now();
+		sender->send( frames[ i ] );
+		double latency = now() - packStart;
+		numAllocations += sNumAllocations.load() - allocationsBefore;
+		m.mLatencies.push_back( latency );
+		m.mSeconds += latency;
+		m.mBlobsSum += double( sender->getNumAlive() );
+		m.mFrames++;
+	}
+	uint64_t numFrames = sender->getNumFrames();
+	uint64_t numDropped = sender->getNumDroppedFrames();
+	size_t numAlive = sender->getNumAlive();
+	// waits for the last bundles
+	sender.reset();
+	double seconds = now() - start;
+	receiver.close();
+
+	if ( receiver.getNumMalformed() > 0 )
+	{
+		fprintf( stderr, "%s received %llu malformed bundles\n", name.c_str(),
+				 (unsigned long long)receiver.getNumMalformed() );
+		numFailures++;
+	}
+	if ( receiver.getNumOversized() > 0 )
+	{
+		fprintf( stderr, "%s received %llu bundles larger than the maximum packet size, the largest of %zu bytes\n",
+				 name.c_str(), (unsigned long long)receiver.getNumOversized(), receiver.getLargestPacketSize() );
+		numFailures++;
+	}
+	if ( receiver.getNumAlive() != numAlive )
+	{
+		fprintf( stderr, "%s received %zu alive ids, %zu were sent\n", name.c_str(), receiver.getNumAlive(), numAlive );
+		numFailures++;
+	}
+	if ( numAllocations > 0 )
+	{
+		fprintf( stderr, "%s allocated %llu times at steady state\n", name.c_str(), (unsigned long long)numAllocations );
+		numFailures++;
+	}
+
+	m.mMetrics.push_back( make_pair( "allocations_per_frame",
+			double( numAllocations ) / double( std::max( m.mFrames, uint64_t( 1 ) ) ) ) );
+	m.mMetrics.push_back( make_pair( "packets_per_second", double( receiver.getNumPackets() ) / seconds ) );
+	m.mMetrics.push_back( make_pair( "packets_per_frame",
+			double( receiver.getNumPackets() ) / double( std::max( numFrames - numDropped, uint64_t( 1 ) ) ) ) );
+	m.mMetrics.push_back( make_pair( "dropped_frames", double( numDropped ) ) );
+	m.mMetrics.push_back( make_pair( "received_packets", double( receiver.getNumPackets() ) ) );
+	m.mMetrics.push_back( make_pair( "largest_packet_bytes", double( receiver.getLargestPacketSize() ) ) );
+	m.mMetrics.push_back( make_pair( "failures", double( numFailures ) ) );
+	return m;
+}
+
+//! Returns options with the threshold, area limits and match distance suited to the discs of \a video.
+BlobTracker::Options optionsFor( const SyntheticVideo::Params &video )
+{
+	BlobTracker::Options options;
+	options.mDebugImagesEnabled = false;
+	options.mBlurSize = 5;
+	options.mThreshold = ( SyntheticVideo::kBackground + SyntheticVideo::kForeground ) / 2;
+	float frameArea = float( video.mWidth ) * float( video.mHeight );
+	float discBounds = 4.f * video.mBlobRadius * video.mBlobRadius;
+	options.mMinArea = .25f * discBounds / frameArea;
+	options.mMaxArea = std::min( 4.f * discBounds / frameArea, 1.f );
+	// the circling pairs move faster than their centers
+	options.mMaxMatchDistance = ( 4.f * video.mSpeed + video.mBlobRadius ) / float( std::max( video.mWidth, video.mHeight ) );
+	return options;
+}
+
+//! Writes the stage times and the counter means of \a stats, the quantiles are bin upper bounds.
+void writeStats( FILE *out, const Stats &stats )
+{
+	bool first = true;
+	for ( int i = 0; i < Stats::kNumStages; i++ )
+	{
+		Stats::Stage stage = static_cast< Stats::Stage >( i );
+		const Histogram &h = stats.getStageTime( stage );
+		if ( h.getCount() == 0 )
+		{
+			continue;
+		}
+		fprintf( out, "%s \"%s\": { \"mean\": %.4f, \"p50\": %.4f, \"p99\": %.4f }",
+				 first ? ",\n      \"stages_ms\": {" : ",", Stats::getStageName( stage ), 1e-6 * h.getMean(),
+				 1e-6 * double( h.getQuantile( .5 ) ), 1e-6 * double( h.getQuantile( .99 ) ) );
+		first = false;
+	}
+	if ( first )
+	{
+		return;
+	}
+	fprintf( out, " }" );
+
+	const pair< const char *, const Histogram * > counters[] = {
+		{ "contours", &stats.mContours }, { "rejected_by_area", &stats.mRejectedByArea },
+		{ "rejected_by_roi", &stats.mRejectedByRoi }, { "reallocations", &stats.mReallocations },
+		{ "dirty_tiles", &stats.mDirtyTiles }, { "matches", &stats.mMatches }, { "births", &stats.mBirths },
+		{ "deaths", &stats.mDeaths } };
+	fprintf( out, ",\n      \"counters_mean\": {" );
+	for ( size_t i = 0; i < sizeof( counters ) / sizeof( counters[ 0 ] ); i++ )
+	{
+		fprintf( out, "%s \"%s\": %.4g", ( i > 0 ) ? "," : "", counters[ i ].first, counters[ i ].second->getMean() );
+	}
+	fprintf( out, ", \"detections\": %llu, \"extrapolated\": %llu }", (unsigned long long)stats.mNumDetections,
+			 (unsigned long long)stats.mNumExtrapolatedFrames );
+}
+
+void writeJson( FILE *out, const Config &config, const vector< Measurement > &results )
+{
+	const SyntheticVideo::Params &v = config.mVideo;
+	fprintf( out, "{\n" );
+	fprintf( out, "  \"version\": 1,\n" );
+	fprintf( out, "  \"frames\": %d,\n  \"warmup\": %d,\n", config.mFrames, config.mWarmup );
+	fprintf( out, "  \"video\": { \"width\": %d, \"height\": %d, \"blobs\": %d, \"pairs\": %d, \"radius\": %g, "
+			 "\"speed\": %g, \"noise\": %d, \"seed\": %u },\n", v.mWidth, v.mHeight, v.mNumBlobs, v.mNumMergingPairs,
+			 v.mBlobRadius, v.mSpeed, v.mNoise, v.mSeed );
+	fprintf( out, "  \"results\": [" );
+	for ( size_t i = 0; i < results.size(); i++ )
+	{
+		const Measurement &m = results[ i ];
+		double fps = ( m.mSeconds > 0.0 ) ? double( m.mFrames ) / m.mSeconds : 0.0;
+		double megapixels = double( m.mWidth ) * double( m.mHeight ) * 1e-6;
+		fprintf( out, "%s\n    {\n", ( i > 0 ) ? "," : "" );
+		fprintf( out, "      \"name\": \"%s\",\n", m.mName.c_str() );
+		fprintf( out, "      \"width\": %d,\n      \"height\": %d,\n", m.mWidth, m.mHeight );
+		fprintf( out, "      \"frames\": %llu,\n", (unsigned long long)m.mFrames );
+		fprintf( out, "      \"seconds\": %.6f,\n", m.mSeconds );
+		fprintf( out, "      \"fps\": %.3f,\n", fps );
+		fprintf( out, "      \"megapixels_per_second\": %.3f,\n", fps * megapixels );
+		fprintf( out, "      \"blobs_mean\": %.3f", ( m.mFrames > 0 ) ? m.mBlobsSum / double( m.mFrames ) : 0.0 );
+		if ( ! m.mLatencies.empty() )
+		{
+			vector< double > sorted = m.mLatencies;
+			std::sort( sorted.begin(), sorted.end() );
+			fprintf( out, ",\n      \"latency_ms\": { \"mean\": %.4f, \"p50\": %.4f, \"p99\": %.4f, \"max\": %.4f }",
+					 1e3 * m.mSeconds / double( sorted.size() ), 1e3 * percentile( sorted, .5 ),
+					 1e3 * percentile( sorted, .99 ), 1e3 * sorted.back() );
+		}
+		if ( ! m.mMetrics.empty() )
+		{
+			fprintf( out, ",\n      \"metrics\": {" );
+			for ( size_t j = 0; j < m.mMetrics.size(); j++ )
+			{
+				fprintf( out, "%s \"%s\": %.6g", ( j > 0 ) ? "," : "", m.mMetrics[ j ].first.c_str(),
+						 m.mMetrics[ j ].second );
+			}
+			fprintf( out, " }" );
+		}
+		writeStats( out, m.mStats );
+		fprintf( out, "\n    }" );
+	}
+	fprintf( out, "\n  ]\n}\n" );
+}
+
+bool parseArgs( int argc, char **argv, Config *config )
+{
+	for ( int i = 1; i < argc; i++ )
+	{
+		string arg = argv[ i ];
+		if ( i + 1 >= argc )
+		{
+			fprintf( stderr, "missing value for %s\n", arg.c_str() );
+			return false;
+		}
+		const char *value = argv[ ++i ];
+		SyntheticVideo::Params &v = config->mVideo;
+		if ( arg == "--frames" ) config->mFrames = std::max( atoi( value ), 1 );
+		else if ( arg == "--warmup" ) config->mWarmup = std::max( atoi( value ), 0 );
+		else if ( arg == "--width" ) v.mWidth = std::max( atoi( value ), 16 );
+		else if ( arg == "--height" ) v.mHeight = std::max( atoi( value ), 16 );
+		else if ( arg == "--blobs" ) v.mNumBlobs = std::max( atoi( value ), 0 );
+		else if ( arg == "--pairs" ) v.mNumMergingPairs = std::max( atoi( value ), 0 );
+		else if ( arg == "--radius" ) v.mBlobRadius = std::max( float( atof( value ) ), 1.f );
+		else if ( arg == "--speed" ) v.mSpeed = float( atof( value ) );
+		else if ( arg == "--noise" ) v.mNoise = std::min( std::max( atoi( value ), 0 ), 64 );
+		else if ( arg == "--seed" ) v.mSeed = uint32_t( strtoul( value, nullptr, 10 ) );
+		else if ( arg == "--filter" ) config->mFilter = value;
+		else if ( arg == "--output" ) config->mOutput = value;
+		else
+		{
+			fprintf( stderr, "unknown option %s\n", arg.c_str() );
+			return false;
+		}
+	}
+	return true;
+}
+
+} // anonymous namespace
+
+int main( int argc, char **argv )
+{
+	Config config;
+	config.mVideo.mNumMergingPairs = 4;
+	if ( ! parseArgs( argc, argv, &config ) )
+	{
+		return 1;
+	}
+
+	vector< Measurement > results;
+	auto wanted = [ & ]( const string &name )
+	{
+		return config.mFilter.empty() || ( name.find( config.mFilter ) != string::npos );
+	};
+	auto run = [ & ]( const string &name, const SyntheticVideo::Params &video, const BlobTracker::Options &options )
+	{
+		if ( wanted( name ) )
+		{
+			fprintf( stderr, "%s\n", name.c_str() );
+			results.push_back( runTracker( config, name, video, options ) );
+		}
+	};
+
+	const SyntheticVideo::Params &video = config.mVideo;
+	const BlobTracker::Options base = optionsFor( video );
+
+	// the optimized stages against their reference implementations, the frames are the cases checked
+	bool passed = true;
+	PipelineChecks checks( video.mSeed );
+	auto check = [ & ]( const string &name, const function< PipelineChecks::Result () > &fn )
+	{
+		if ( ! wanted( name ) )
+		{
+			return;
+		}
+		fprintf( stderr, "%s\n", name.c_str() );
+		Measurement m;
+		m.mName = name;
+		double start = now();
+		PipelineChecks::Result result = fn();
+		m.mSeconds = now() - start;
+		m.mFrames = result.mNumCases;
+		m.mMetrics.push_back( make_pair( "failures", double( result.mNumFailures ) ) );
+		if ( result.mNumFailures > 0 )
+		{
+			fprintf( stderr, "%s failed %llu of %llu cases\n", name.c_str(), (unsigned long long)result.mNumFailures,
+					 (unsigned long long)result.mNumCases );
+			passed = false;
+		}
+		results.push_back( m );
+	};
+	check( "check/preprocess", [ & ]() { return checks.checkPreprocessStage( 2000 ); } );
+	check( "check/stripes", [ & ]() { return checks.checkStripes( 2000, 8 ); } );
+	check( "check/debug_geometry", [ & ]() { return checks.checkDebugGeometry(); } );
+
+	// preprocessing and detection engines
+	{
+		BlobTracker::Options options = base;
+		run( "preprocess/opencv", video, options );
+		options.mPreprocessMode = BlobTracker::Options::PreprocessMode::FUSED;
+		run( "preprocess/fused", video, options );
+		options.mDetectionMode = BlobTracker::Options::DetectionMode::LABELS;
+		run( "detection/labels", video, options );
+		options.mCropToRoi = true;
+		options.mNormalizedRegionOfInterest = Rectf( .25f, .25f, .75f, .75f );
+		run( "detection/labels/roi_quarter", video, options );
+	}
+
+	// adaptive threshold against the block size, the fused stage takes the local means from an integral image
+	for ( int blockSize : { 15, 51, 151 } )
+	{
+		BlobTracker::Options options = base;
+		options.mAdaptiveThresholdEnabled = true;
+		options.mAdaptiveThresholdBlockSize = blockSize;
+		// the discs are well above the mean of any block smaller than the frame
+		options.mAdaptiveThresholdOffset = ( SyntheticVideo::kForeground - SyntheticVideo::kBackground ) / 4;
+		run( "threshold/adaptive/opencv/" + to_string( blockSize ), video, options );
+		options.mPreprocessMode = BlobTracker::Options::PreprocessMode::FUSED;
+		run( "threshold/adaptive/fused/" + to_string( blockSize ), video, options );
+	}
+
+	// labels of the bit mask, compare with detection/labels, then filtered by the morphology against the radius
+	{
+		BlobTracker::Options options = base;
+		options.mPreprocessMode = BlobTracker::Options::PreprocessMode::FUSED;
+		options.mDetectionMode = BlobTracker::Options::DetectionMode::LABELS;
+		options.mBitMaskEnabled = true;
+		run( "bitmask/labels", video, options );
+		for ( int radius : { 1, 4 } )
+		{
+			options.mMorphologyRadius = radius;
+			options.mMorphology = BlobTracker::Options::Morphology::OPEN;
+			run( "bitmask/open/" + to_string( radius ), video, options );
+			options.mMorphology = BlobTracker::Options::Morphology::CLOSE;
+			run( "bitmask/close/" + to_string( radius ), video, options );
+		}
+	}
+
+	// colour and depth input converted in the first pass
+	{
+		BlobTracker::Options options = base;
+		options.mPreprocessMode = BlobTracker::Options::PreprocessMode::FUSED;
+		if ( wanted( "input/rgb" ) )
+		{
+			fprintf( stderr, "input/rgb\n" );
+			results.push_back( runTracker( config, "input/rgb", video, options, nullptr, InputFrame::Format::COLOR ) );
+		}
+		if ( wanted( "input/depth" ) )
+		{
+			fprintf( stderr, "input/depth\n" );
+			results.push_back( runTracker( config, "input/depth", video, options, nullptr, InputFrame::Format::DEPTH ) );
+		}
+	}
+
+	// pipeline variants compiled for the flags against the generic ones checking them
+	for ( bool specialized : { false, true } )
+	{
+		BlobTracker::Options options = base;
+		options.mPreprocessMode = BlobTracker::Options::PreprocessMode::FUSED;
+		options.mDetectionMode = BlobTracker::Options::DetectionMode::LABELS;
+		options.mFlip = true;
+		options.mBoundsEnabled = options.mConvexHullEnabled = true;
+		options.mPipelineSpecializationEnabled = specialized;
+		const string variant = specialized ? "specialized" : "generic";
+		run( "variants/" + variant, video, options );
+
+		const string depthName = "variants/depth/" + variant;
+		if ( wanted( depthName ) )
+		{
+			fprintf( stderr, "%s\n", depthName.c_str() );
+			options.mFlip = false;
+			results.push_back( runTracker( config, depthName, video, options, nullptr, InputFrame::Format::DEPTH ) );
+		}
+	}
+
+	// intra-frame threads, fused preprocessing and labels split into stripes
+	for ( int numThreads : { 1, 2, 4, 8 } )
+	{
+		BlobTracker::Options options = base;
+		options.mPreprocessMode = BlobTracker::Options::PreprocessMode::FUSED;
+		options.mDetectionMode = BlobTracker::Options::DetectionMode::LABELS;
+		options.mNumThreads = numThreads;
+		run( "threads/" + to_string( numThreads ), video, options );
+	}
+
+	// matcher frame time against the number of small blobs
+	for ( int numBlobs : { 50, 200, 800 } )
+	{
+		SyntheticVideo::Params crowd = video;
+		crowd.mNumBlobs = numBlobs;
+		crowd.mNumMergingPairs = 0;
+		crowd.mBlobRadius = 5.f;
+		crowd.mSpeed = 1.f;
+		BlobTracker::Options options = optionsFor( crowd );
+		options.mPreprocessMode = BlobTracker::Options::PreprocessMode::FUSED;
+		options.mDetectionMode = BlobTracker::Options::DetectionMode::LABELS;
+		options.mBlurSize = 3;
+		const pair< const char *, BlobTracker::Options::MatchMode > modes[] = {
+			{ "knn", BlobTracker::Options::MatchMode::KNN },
+			{ "greedy", BlobTracker::Options::MatchMode::GREEDY },
+			{ "hungarian", BlobTracker::Options::MatchMode::HUNGARIAN } };
+		for ( const auto &mode : modes )
+		{
+			options.mMatchMode = mode.second;
+			run( string( "match/" ) + mode.first + "/" + to_string( numBlobs ), crowd, options );
+		}
+	}
+
+	// dense crowds of tiny blobs, matched through the spatial grid and for comparison against all blobs
+	for ( int numBlobs : { 1000, 5000, 10000, 20000 } )
+	{
+		SyntheticVideo::Params crowd = video;
+		crowd.mNumBlobs = numBlobs;
+		crowd.mNumMergingPairs = 0;
+		crowd.mBlobRadius = 2.f;
+		crowd.mSpeed = .5f;
+		BlobTracker::Options options = optionsFor( crowd );
+		options.mPreprocessMode = BlobTracker::Options::PreprocessMode::FUSED;
+		options.mDetectionMode = BlobTracker::Options::DetectionMode::LABELS;
+		options.mBlurSize = 3;
+		const pair< const char *, BlobTracker::Options::MatchMode > modes[] = {
+			{ "knn", BlobTracker::Options::MatchMode::KNN },
+			{ "greedy", BlobTracker::Options::MatchMode::GREEDY } };
+		for ( bool gridEnabled : { false, true } )
+		{
+			// the cost matrix of the greedy matcher would not fit the largest crowd
+			if ( ! gridEnabled && ( numBlobs > 5000 ) )
+			{
+				continue;
+			}
+			options.mMatchGridEnabled = gridEnabled;
+			for ( const auto &mode : modes )
+			{
+				string name = string( gridEnabled ? "match/grid/" : "match/" ) + mode.first + "/" + to_string( numBlobs );
+				if ( ! wanted( name ) )
+				{
+					continue;
+				}
+				options.mMatchMode = mode.second;
+				fprintf( stderr, "%s\n", name.c_str() );
+				Measurement m = runTracker( config, name, crowd, options );
+				// the matching time per blob stays flat if the matching scales linearly
+				double numBlobsMean = m.mBlobsSum / double( std::max( m.mFrames, uint64_t( 1 ) ) );
+				m.mMetrics.push_back( make_pair( "track_ns_per_blob",
+						m.mStats.getStageTime( Stats::Stage::TRACK ).getMean() / std::max( numBlobsMean, 1. ) ) );
+				results.push_back( m );
+			}
+		}
+	}
+
+	// pyramid speed against accuracy, the distance of the true centers from the tracked blobs in pixels
+	for ( int level = 0; level <= 3; level++ )
+	{
+		string name = "pyramid/level" + to_string( level );
+		if ( ! wanted( name ) )
+		{
+			continue;
+		}
+		SyntheticVideo::Params sparse = video;
+		sparse.mNumMergingPairs = 0;
+		BlobTracker::Options options = base;
+		options.mPreprocessMode = BlobTracker::Options::PreprocessMode::FUSED;
+		options.mPyramidEnabled = level > 0;
+		options.mMaxPyramidLevel = level;
+		options.mPyramidMinBlobSize = 1.f;
+		Accuracy accuracy;
+		const vec2 scale( float( sparse.mWidth ), float( sparse.mHeight ) );
+		fprintf( stderr, "%s\n", name.c_str() );
+		Measurement m = runTracker( config, name, sparse, options,
+				[ & ]( const SyntheticVideo &source, const BlobTracker &tracker )
+				{
+					accuracy.add( source.getPositions(), tracker.getBlobPool(), scale, sparse.mBlobRadius );
+				} );
+		double numFound = double( std::max( accuracy.mNumFound, uint64_t( 1 ) ) );
+		m.mMetrics.push_back( make_pair( "level", double( level ) ) );
+		m.mMetrics.push_back( make_pair( "position_error_px", accuracy.mErrorSum / numFound ) );
+		m.mMetrics.push_back( make_pair( "recall", double( accuracy.mNumFound ) /
+												   double( std::max( accuracy.mNumTruth, uint64_t( 1 ) ) ) ) );
+		results.push_back( m );
+	}
+
+	// work skipping modes
+	{
+		BlobTracker::Options options = base;
+		options.mPreprocessMode = BlobTracker::Options::PreprocessMode::FUSED;
+		options.mIncrementalEnabled = true;
+		run( "incremental", video, options );
+
+		SyntheticVideo::Params still = video;
+		still.mSpeed = 0.f;
+		still.mNumMergingPairs = 0;
+		run( "incremental/static", still, options );
+
+		options = base;
+		options.mPreprocessMode = BlobTracker::Options::PreprocessMode::FUSED;
+		options.mBackgroundSubtractionEnabled = true;
+		run( "background", video, options );
+
+		options = base;
+		options.mPredictionEnabled = true;
+		options.mDetectionInterval = 2;
+		run( "prediction/interval2", video, options );
+	}
+
+	// TUIO packing and loopback sending against the number of blobs
+	for ( int numBlobs : { 20, 200, 800 } )
+	{
+		SyntheticVideo::Params crowd = video;
+		crowd.mNumBlobs = numBlobs;
+		crowd.mNumMergingPairs = 0;
+		crowd.mBlobRadius = std::min( video.mBlobRadius, 8.f );
+		BlobTracker::Options options = optionsFor( crowd );
+		options.mPreprocessMode = BlobTracker::Options::PreprocessMode::FUSED;
+		options.mDetectionMode = BlobTracker::Options::DetectionMode::LABELS;
+		const pair< const char *, TuioSender::Options::Protocol > protocols[] = {
+			{ "1.1", TuioSender::Options::Protocol::TUIO_1_1 }, { "2.0", TuioSender::Options::Protocol::TUIO_2_0 } };
+		for ( const auto &protocol : protocols )
+		{
+			string name = string( "tuio/" ) + protocol.first + "/" + to_string( numBlobs );
+			if ( wanted( name ) )
+			{
+				TuioSender::Options tuioOptions;
+				tuioOptions.setProtocol( protocol.second );
+				tuioOptions.setSensorSize( ivec2( crowd.mWidth, crowd.mHeight ) );
+				fprintf( stderr, "%s\n", name.c_str() );
+				Measurement m = runTuio( config, name, crowd, options, tuioOptions );
+				if ( m.mMetrics.back().second > 0.0 )
+				{
+					passed = false;
+				}
+				results.push_back( m );
+			}
+		}
+	}
+
+	// heap allocations at steady state, the fused preprocessing with the labels on a single thread and without
+	// the debug images does not allocate, OpenCV's blur and findContours and the tasks of the stripes do
+	{
+		BlobTracker::Options fused = base;
+		fused.mPreprocessMode = BlobTracker::Options::PreprocessMode::FUSED;
+		fused.mDetectionMode = BlobTracker::Options::DetectionMode::LABELS;
+		vector< pair< string, BlobTracker::Options > > freeModes;
+		freeModes.push_back( make_pair( "fused/labels", fused ) );
+		BlobTracker::Options options = fused;
+		options.mBitMaskEnabled = true;
+		options.mMorphology = BlobTracker::Options::Morphology::OPEN;
+		freeModes.push_back( make_pair( "fused/labels/bitmask", options ) );
+		options = fused;
+		options.mAdaptiveThresholdEnabled = true;
+		options.mAdaptiveThresholdOffset = ( SyntheticVideo::kForeground - SyntheticVideo::kBackground ) / 4;
+		freeModes.push_back( make_pair( "fused/labels/adaptive", options ) );
+		options = fused;
+		options.mIncrementalEnabled = true;
+		freeModes.push_back( make_pair( "fused/labels/incremental", options ) );
+		options = fused;
+		options.mBackgroundSubtractionEnabled = true;
+		freeModes.push_back( make_pair( "fused/labels/background", options ) );
+		options = fused;
+		options.mMatchMode = BlobTracker::Options::MatchMode::GREEDY;
+		options.mMatchGridEnabled = true;
+		freeModes.push_back( make_pair( "fused/labels/grid", options ) );
+		options = fused;
+		options.mPredictionEnabled = true;
+		options.mDetectionInterval = 2;
+		freeModes.push_back( make_pair( "fused/labels/prediction", options ) );
+
+		vector< pair< string, BlobTracker::Options > > allocatingModes;
+		allocatingModes.push_back( make_pair( "opencv/contours", base ) );
+		options = fused;
+		options.mNumThreads = 4;
+		allocatingModes.push_back( make_pair( "fused/labels/threads4", options ) );
+
+		for ( int allocating = 0; allocating < 2; allocating++ )
+		{
+			for ( const auto &mode : allocating ? allocatingModes : freeModes )
+			{
+				string name = "allocations/" + mode.first;
+				if ( ! wanted( name ) )
+				{
+					continue;
+				}
+				fprintf( stderr, "%s\n", name.c_str() );
+				Measurement m = runAllocations( config, name, video, mode.second );
+				double numAllocations = m.mMetrics.back().second;
+				if ( ! allocating && ( numAllocations > 0.0 ) )
+				{
+					fprintf( stderr, "%s allocated %.0f times at steady state\n", name.c_str(), numAllocations );
+					passed = false;
+				}
+				results.push_back( m );
+			}
+		}
+	}
+
+	// multi-stream throughput
+	for ( size_t numStreams : { 1, 2, 4, 8 } )
+	{
+		string name = "pool/streams" + to_string( numStreams );
+		if ( wanted( name ) )
+		{
+			BlobTracker::Options options = base;
+			options.mPreprocessMode = BlobTracker::Options::PreprocessMode::FUSED;
+			options.mDetectionMode = BlobTracker::Options::DetectionMode::LABELS;
+			fprintf( stderr, "%s\n", name.c_str() );
+			results.push_back( runPool( config, name, video, options, numStreams ) );
+		}
+	}
+
+	FILE *out = stdout;
+	if ( ! config.mOutput.empty() )
+	{
+		out = fopen( config.mOutput.c_str(), "w" );
+		if ( out == nullptr )
+		{
+			fprintf( stderr, "cannot write %s\n", config.mOutput.c_str() );
+			return 1;
+		}
+	}
+	writeJson( out, config, results );
+	if ( out != stdout )
+	{
+		fclose( out );
+	}
+	return passed ? 0 : 2;
+}
@@ -0,0 +1,525 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <tuple>
+#include <vector>
+
+#include "mndl/blobtracker/BitMask.h"
+#include "mndl/blobtracker/BlobLabeler.h"
+#include "mndl/blobtracker/BlobTracker.h"
+#include "mndl/blobtracker/DebugGeometry.h"
+#include "mndl/blobtracker/PreprocessStage.h"
+#include "mndl/blobtracker/WorkStealingPool.h"
+
+#include "PipelineChecks.h"
+
+using namespace ci;
+using namespace mndl::blobtracker;
+using namespace std;
+
+namespace {
+
+//! Failures described on stderr per check, the rest are only counted.
+const uint64_t kMaxReported = 10;
+
+void fail( PipelineChecks::Result *result, const char *format, ... )
+{
+	if ( result->mNumFailures++ < kMaxReported )
+	{
+		va_list args;
+		va_start( args, format );
+		fprintf( stderr, "  " );
+		vfprintf( stderr, format, args );
+		fprintf( stderr, "\n" );
+		va_end( args );
+	}
+}
+
+//! Returns the number of pixels of \a area differing in \a a and \a b, both 8-bit.
+int countDifferences( const cv::Mat &a, const cv::Mat &b, const cv::Rect &area )
+{
+	int n = 0;
+	for ( int y = area.y; y < area.y + area.height; y++ )
+	{
+		const uint8_t *rowA = a.ptr< uint8_t >( y );
+		const uint8_t *rowB = b.ptr< uint8_t >( y );
+		for ( int x = area.x; x < area.x + area.width; x++ )
+		{
+			n += rowA[ x ] != rowB[ x ];
+		}
+	}
+	return n;
+}
+
+//! A component with its outline points sorted, comparable regardless of the order the labelling found them in.
+struct LabelledComponent
+{
+	int mX, mY, mWidth, mHeight;
+	int64_t mArea;
+	float mCentroidX, mCentroidY;
+	vector< pair< int, int > > mPoints;
+
+	bool operator<( const LabelledComponent &rhs ) const
+	{
+		return tie( mY, mX, mWidth, mHeight, mArea, mCentroidX, mCentroidY, mPoints ) <
+			   tie( rhs.mY, rhs.mX, rhs.mWidth, rhs.mHeight, rhs.mArea, rhs.mCentroidX, rhs.mCentroidY, rhs.mPoints );
+	}
+	bool operator==( const LabelledComponent &rhs ) const { return ! ( *this < rhs ) && ! ( rhs < *this ); }
+};
+
+vector< LabelledComponent > getComponents( const BlobLabeler &labeler )
+{
+	vector< LabelledComponent > components;
+	for ( const BlobLabeler::Component &c : labeler.getComponents() )
+	{
+		LabelledComponent l = { c.mBounds.x, c.mBounds.y, c.mBounds.width, c.mBounds.height, c.mArea,
+								c.mCentroid.x, c.mCentroid.y, {} };
+		for ( size_t i = c.mFirstPoint; i < c.mFirstPoint + c.mNumPoints; i++ )
+		{
+			l.mPoints.push_back( make_pair( labeler.getPoints()[ i ].x, labeler.getPoints()[ i ].y ) );
+		}
+		std::sort( l.mPoints.begin(), l.mPoints.end() );
+		components.push_back( l );
+	}
+	std::sort( components.begin(), components.end() );
+	return components;
+}
+
+//! Returns the positions and bounds of the blobs of \a blobs, sorted.
+vector< tuple< float, float, float, float, float, float > > getBlobs( const BlobPool &blobs )
+{
+	vector< tuple< float, float, float, float, float, float > > sorted;
+	for ( size_t i = 0; i < blobs.getSize(); i++ )
+	{
+		const Rectf &b = blobs.mBounds[ i ];
+		sorted.push_back( make_tuple( blobs.mPositions[ i ].x, blobs.mPositions[ i ].y, b.x1, b.y1, b.x2, b.y2 ) );
+	}
+	std::sort( sorted.begin(), sorted.end() );
+	return sorted;
+}
+
+bool isSameColor( const ColorA &a, const ColorA &b )
+{
+	return ( a.r == b.r ) && ( a.g == b.g ) && ( a.b == b.b ) && ( a.a == b.a );
+}
+
+} // anonymous namespace
+
+void PipelineChecks::fillImage( cv::Mat &image )
+{
+	const int pattern = uniform( 0, 3 );
+	const int value = uniform( 0, 255 );
+	for ( int y = 0; y < image.rows; y++ )
+	{
+		uint8_t *row = image.ptr< uint8_t >( y );
+		for ( int x = 0; x < image.cols; x++ )
+		{
+			switch ( pattern )
+			{
+				case 0:
+					row[ x ] = uint8_t( uniform( 0, 255 ) );
+					break;
+				case 1:
+					row[ x ] = uint8_t( std::min( x * 3 + y * 2 + uniform( 0, 40 ), 255 ) );
+					break;
+				case 2:
+					row[ x ] = ( uniform( 0, 15 ) == 0 ) ? 255 : 0;
+					break;
+				default:
+					row[ x ] = uint8_t( value );
+					break;
+			}
+		}
+	}
+}
+
+void PipelineChecks::fillMask( cv::Mat &mask )
+{
+	const int density = uniform( 0, 40 );
+	for ( int y = 0; y < mask.rows; y++ )
+	{
+		uint8_t *row = mask.ptr< uint8_t >( y );
+		for ( int x = 0; x < mask.cols; x++ )
+		{
+			row[ x ] = ( uniform( 0, 99 ) < density ) ? 255 : 0;
+		}
+	}
+	const int numShapes = uniform( 0, 12 );
+	for ( int i = 0; i < numShapes; i++ )
+	{
+		const int cx = uniform( 0, mask.cols - 1 );
+		const int cy = uniform( 0, mask.rows - 1 );
+		const int r = uniform( 0, 20 );
+		const bool disc = uniform( 0, 1 ) != 0;
+		for ( int y = std::max( cy - r, 0 ); y <= std::min( cy + r, mask.rows - 1 ); y++ )
+		{
+			for ( int x = std::max( cx - r, 0 ); x <= std::min( cx + r, mask.cols - 1 ); x++ )
+			{
+				if ( ! disc || ( ( x - cx ) * ( x - cx ) + ( y - cy ) * ( y - cy ) <= r * r ) )
+				{
+					mask.ptr< uint8_t >( y )[ x ] = 255;
+				}
+			}
+		}
+	}
+}
+
+PipelineChecks::Result PipelineChecks::checkPreprocessStage( int numCases )
+{
+	// the power of two sizes are left out, newer OpenCV versions round them differently, see FusedPreprocessStage
+	const int sizes[] = { 1, 3, 5, 6, 7, 9, 10, 12, 15, 17, 23, 31, 51 };
+	const int numSizes = int( sizeof( sizes ) / sizeof( sizes[ 0 ] ) );
+	// odd widths and the ones around the vector widths leave a scalar tail
+	const int widths[] = { 1, 2, 3, 7, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 129, 333 };
+	const int numWidths = int( sizeof( widths ) / sizeof( widths[ 0 ] ) );
+
+	Result result;
+	PreprocessStageRef stage = FusedPreprocessStage::create();
+	for ( int i = 0; i < numCases; i++ )
+	{
+		const int width = widths[ uniform( 0, numWidths - 1 ) ];
+		const int height = uniform( 1, 80 );
+		// half of the inputs are views into a larger image, so their rows are padded
+		cv::Mat parent( height + 4, width + 8, CV_8UC1 );
+		fillImage( parent );
+		cv::Mat input = parent( cv::Rect( 3, 2, width, height ) );
+		if ( uniform( 0, 1 ) == 0 )
+		{
+			input = input.clone();
+		}
+		// a copy, so the reference blur reflects the borders of the input instead of reading the parent
+		const cv::Mat reference = input.clone();
+
+		PreprocessStage::Params params;
+		params.mBlurSize = sizes[ uniform( 0, numSizes - 1 ) ];
+		params.mThreshold = uniform( -2, 257 );
+		params.mThresholdInvertEnabled = uniform( 0, 1 ) != 0;
+		params.mAdaptiveThresholdEnabled = uniform( 0, 2 ) == 0;
+		params.mAdaptiveBlockSize = sizes[ uniform( 0, numSizes - 1 ) ];
+		params.mAdaptiveOffset = uniform( -20, 40 );
+		params.mSpecializationEnabled = uniform( 0, 1 ) != 0;
+		const bool keepBlurred = uniform( 0, 1 ) != 0;
+
+		// the full input or an area at a random offset, which may touch the borders
+		cv::Rect area( 0, 0, width, height );
+		if ( uniform( 0, 2 ) > 0 )
+		{
+			area.x = uniform( 0, width - 1 );
+			area.y = uniform( 0, height - 1 );
+			area.width = uniform( 1, width - area.x );
+			area.height = uniform( 1, height - area.y );
+		}
+
+		// blurring the whole input gives the area the pixels around it, like blurring a view of the area
+		cv::Mat expectedBlurred;
+		cv::Mat expectedMask;
+		cv::blur( reference, expectedBlurred, cv::Size( params.mBlurSize, params.mBlurSize ) );
+		if ( params.mAdaptiveThresholdEnabled )
+		{
+			const int offset = params.mAdaptiveOffset;
+			cv::Mat mean;
+			cv::Mat difference;
+			cv::blur( reference, mean, cv::Size( params.mAdaptiveBlockSize, params.mAdaptiveBlockSize ) );
+			cv::subtract( expectedBlurred, mean, difference, cv::noArray(), CV_16S );
+			cv::compare( difference, cv::Scalar( params.mThresholdInvertEnabled ? -offset : offset ), expectedMask,
+					params.mThresholdInvertEnabled ? cv::CMP_LT : cv::CMP_GT );
+		}
+		else
+		{
+			cv::threshold( expectedBlurred, expectedMask, params.mThreshold, 255,
+					params.mThresholdInvertEnabled ? CV_THRESH_BINARY_INV : CV_THRESH_BINARY );
+		}
+
+		// the pixels outside the area have to keep their value
+		const uint8_t outside = 77;
+		cv::Mat blurred( input.size(), CV_8UC1, cv::Scalar( outside ) );
+		cv::Mat mask( input.size(), CV_8UC1, cv::Scalar( outside ) );
+		stage->process( input, area, params, blurred, mask, keepBlurred );
+		BitMask bits;
+		bits.create( input.size() );
+		cv::Mat bitsBlurred( input.size(), CV_8UC1, cv::Scalar( outside ) );
+		stage->processBits( input, area, params, bitsBlurred, bits, keepBlurred );
+		cv::Mat unpacked( input.size(), CV_8UC1, cv::Scalar( 0 ) );
+		bits.unpack( area, unpacked );
+
+		cv::Mat expectedOutside( input.size(), CV_8UC1, cv::Scalar( outside ) );
+		cv::Mat expectedArea = expectedOutside( area );
+		expectedMask( area ).copyTo( expectedArea );
+		const cv::Rect all( 0, 0, width, height );
+		int maskDifferences = countDifferences( mask, expectedOutside, all );
+		int bitsDifferences = countDifferences( unpacked, expectedMask, area );
+		int blurredDifferences = keepBlurred ?
+			countDifferences( blurred, expectedBlurred, area ) + countDifferences( bitsBlurred, expectedBlurred, area ) : 0;
+		result.mNumCases++;
+		if ( maskDifferences + bitsDifferences + blurredDifferences > 0 )
+		{
+			fail( &result, "%dx%d%s area %d,%d %dx%d blur %d threshold %d%s%s adaptive %d/%d%s: "
+				  "%d mask, %d bit mask, %d blurred pixels differ",
+				  width, height, input.isContinuous() ? "" : " padded", area.x, area.y, area.width, area.height,
+				  params.mBlurSize, params.mThreshold, params.mThresholdInvertEnabled ? " inverted" : "",
+				  params.mSpecializationEnabled ? "" : " generic",
+				  params.mAdaptiveThresholdEnabled ? params.mAdaptiveBlockSize : 0, params.mAdaptiveOffset,
+				  keepBlurred ? " kept" : "", maskDifferences, bitsDifferences, blurredDifferences );
+		}
+	}
+	return result;
+}
+
+PipelineChecks::Result PipelineChecks::checkStripes( int numCases, int maxStripes )
+{
+	Result result;
+	WorkStealingPoolRef pool = WorkStealingPool::create( size_t( std::max( maxStripes - 1, 1 ) ) );
+	BlobLabeler single;
+	BlobLabeler joined;
+	vector< BlobLabeler > stripes( maxStripes );
+	for ( int i = 0; i < numCases; i++ )
+	{
+		const int width = uniform( 1, 200 );
+		const int height = uniform( 1, 150 );
+		cv::Mat mask( height, width, CV_8UC1 );
+		fillMask( mask );
+		const cv::Rect all( 0, 0, width, height );
+		BitMask bits;
+		bits.create( mask.size() );
+		bits.pack( mask, all );
+		const bool fromBits = uniform( 0, 1 ) != 0;
+
+		// the area limits of the components are applied after joining
+		const float minArea = ( uniform( 0, 3 ) == 0 ) ? float( uniform( 0, 50 ) ) : 0.f;
+		const float maxArea = ( uniform( 0, 3 ) == 0 ) ? float( uniform( 50, 2000 ) ) : FLT_MAX;
+		if ( fromBits )
+		{
+			single.scan( bits, all );
+		}
+		else
+		{
+			single.scan( mask, cv::Point( 0, 0 ) );
+		}
+		single.finish( minArea, maxArea, true );
+		const vector< LabelledComponent > expected = getComponents( single );
+
+		// stripes of random heights, cut at distinct rows
+		const int numStripes = std::min( 1 + i % maxStripes, height );
+		vector< int > cuts;
+		while ( int( cuts.size() ) < numStripes - 1 )
+		{
+			int y = uniform( 1, height - 1 );
+			if ( std::find( cuts.begin(), cuts.end(), y ) == cuts.end() )
+			{
+				cuts.push_back( y );
+			}
+		}
+		cuts.push_back( 0 );
+		cuts.push_back( height );
+		std::sort( cuts.begin(), cuts.end() );
+
+		atomic< size_t > remaining( numStripes );
+		for ( int s = 0; s < numStripes; s++ )
+		{
+			const cv::Rect stripeArea( 0, cuts[ s ], width, cuts[ s + 1 ] - cuts[ s ] );
+			BlobLabeler *stripe = &stripes[ s ];
+			pool->submit( [ &, stripe, stripeArea ]
+				{
+					if ( fromBits )
+					{
+						stripe->scan( bits, stripeArea );
+					}
+					else
+					{
+						stripe->scan( mask( stripeArea ), stripeArea.tl() );
+					}
+					remaining.fetch_sub( 1, memory_order_release );
+				} );
+		}
+		pool->wait( remaining );
+		joined.clear();
+		for ( int s = 0; s < numStripes; s++ )
+		{
+			joined.append( stripes[ s ] );
+		}
+		joined.finish( minArea, maxArea, true );
+
+		result.mNumCases++;
+		if ( ( getComponents( joined ) != expected ) || ( joined.getNumRejected() != single.getNumRejected() ) )
+		{
+			fail( &result, "%dx%d %s mask in %d stripes: %zu components, %zu rejected, single pass %zu, %zu rejected",
+				  width, height, fromBits ? "bit" : "byte", numStripes, joined.getComponents().size(),
+				  joined.getNumRejected(), expected.size(), single.getNumRejected() );
+		}
+	}
+
+	// the whole pipeline, stripes of at least 32 rows preprocessed, thresholded and labelled on the threads
+	const int width = 320;
+	const int height = 32 * maxStripes;
+	Channel8u frame( width, height );
+	cv::Mat mask( height, width, CV_8UC1 );
+	for ( int i = 0; i < std::max( numCases / 20, 1 ); i++ )
+	{
+		fillMask( mask );
+		for ( int y = 0; y < height; y++ )
+		{
+			uint8_t *row = frame.getData() + y * frame.getRowBytes();
+			for ( int x = 0; x < width; x++ )
+			{
+				row[ x ] = uint8_t( ( mask.ptr< uint8_t >( y )[ x ] ? 200 : 40 ) + uniform( 0, 20 ) );
+			}
+		}
+
+		BlobTracker::Options options;
+		options.mDebugImagesEnabled = false;
+		options.mPreprocessMode = BlobTracker::Options::PreprocessMode::FUSED;
+		options.mDetectionMode = BlobTracker::Options::DetectionMode::LABELS;
+		options.mMinArea = 0.f;
+		options.mMaxArea = 1.f;
+		options.mBlurSize = uniform( 1, 7 );
+		options.mThreshold = 120;
+		options.mBitMaskEnabled = uniform( 0, 1 ) != 0;
+		if ( options.mBitMaskEnabled && ( uniform( 0, 1 ) != 0 ) )
+		{
+			options.mMorphology = BlobTracker::Options::Morphology::OPEN;
+			options.mMorphologyRadius = uniform( 1, 3 );
+		}
+		BlobTrackerRef reference = BlobTracker::create( options );
+		reference->update( frame );
+		const auto expected = getBlobs( reference->getBlobPool() );
+		for ( int numThreads = 2; numThreads <= maxStripes; numThreads++ )
+		{
+			options.mNumThreads = numThreads;
+			BlobTrackerRef tracker = BlobTracker::create( options );
+			tracker->update( frame );
+			result.mNumCases++;
+			if ( getBlobs( tracker->getBlobPool() ) != expected )
+			{
+				fail( &result, "frame %d on %d threads%s: %zu blobs, single thread %zu", i, numThreads,
+					  options.mBitMaskEnabled ? " bit mask" : "", tracker->getBlobPool().getSize(), expected.size() );
+			}
+		}
+	}
+	return result;
+}
+
+PipelineChecks::Result PipelineChecks::checkDebugGeometry()
+{
+	DebugGeometry::Style style;
+	style.mRoiColor = ColorA( 1.f, 0.f, 0.f, 1.f );
+	style.mBoundsColor = ColorA( 0.f, 1.f, 0.f, 1.f );
+	style.mHullColor = ColorA( 0.f, 0.f, 1.f, 1.f );
+	style.mMarkerColor = ColorA( 1.f, 1.f, 1.f, 1.f );
+	style.mMarkerSize = 3.f;
+
+	// the roi and the blobs in [ 0, 1 ] are mapped to the 200 x 100 pixels at 10, 20, so x * 200 + 10, y * 100 + 20
+	const Rectf roi( .25f, .25f, .75f, .75f );
+	const Rectf outputArea( 10.f, 20.f, 210.f, 120.f );
+	struct KnownBlob
+	{
+		vec2 mPos;
+		Rectf mBounds;
+		vector< vec2 > mHull;
+	};
+	const KnownBlob knownBlobs[] = {
+		{ vec2( .5f, .5f ), Rectf( .4f, .4f, .6f, .6f ), { vec2( .4f, .5f ), vec2( .5f, .4f ), vec2( .6f, .6f ) } },
+		// a hull of two points is a single open line
+		{ vec2( .05f, .95f ), Rectf( 0.f, .9f, .1f, 1.f ), { vec2( 0.f, 1.f ), vec2( .1f, .9f ) } },
+		{ vec2( 1.f, 0.f ), Rectf( 1.f, 0.f, 1.f, 0.f ), {} } };
+
+	vector< DebugGeometry::Vertex > lines;
+	auto line = [ & ]( float x1, float y1, float x2, float y2, const ColorA &color )
+	{
+		lines.push_back( DebugGeometry::Vertex{ vec2( x1, y1 ), color } );
+		lines.push_back( DebugGeometry::Vertex{ vec2( x2, y2 ), color } );
+	};
+	auto rect = [ & ]( float x1, float y1, float x2, float y2, const ColorA &color )
+	{
+		line( x1, y1, x2, y1, color );
+		line( x2, y1, x2, y2, color );
+		line( x2, y2, x1, y2, color );
+		line( x1, y2, x1, y1, color );
+	};
+	auto marker = [ & ]( float x, float y )
+	{
+		line( x - 3.f, y, x + 3.f, y, style.mMarkerColor );
+		line( x, y - 3.f, x, y + 3.f, style.mMarkerColor );
+	};
+	// the roi, then the bounds, the hulls and the markers of all blobs
+	rect( 60.f, 45.f, 160.f, 95.f, style.mRoiColor );
+	rect( 90.f, 60.f, 130.f, 80.f, style.mBoundsColor );
+	rect( 10.f, 110.f, 30.f, 120.f, style.mBoundsColor );
+	rect( 210.f, 20.f, 210.f, 20.f, style.mBoundsColor );
+	line( 90.f, 70.f, 110.f, 60.f, style.mHullColor );
+	line( 110.f, 60.f, 130.f, 80.f, style.mHullColor );
+	line( 130.f, 80.f, 90.f, 70.f, style.mHullColor );
+	line( 10.f, 120.f, 30.f, 110.f, style.mHullColor );
+	const size_t numWithoutMarkers = lines.size();
+	marker( 110.f, 70.f );
+	marker( 20.f, 115.f );
+	marker( 210.f, 20.f );
+	const vector< DebugGeometry::Vertex > all = lines;
+	// only the roi and the markers without the bounds and hulls
+	vector< DebugGeometry::Vertex > markers( all.begin(), all.begin() + 8 );
+	markers.insert( markers.end(), all.begin() + numWithoutMarkers, all.end() );
+
+	Result result;
+	DebugGeometry geometry;
+	for ( float scale : { 1.f, 2.f } )
+	{
+		BlobPool blobs;
+		for ( const KnownBlob &known : knownBlobs )
+		{
+			const size_t i = blobs.getIndex( blobs.add() );
+			blobs.mPositions[ i ] = known.mPos * scale;
+			blobs.mBounds[ i ] = known.mBounds * scale;
+			for ( const vec2 &p : known.mHull )
+			{
+				blobs.mConvexHulls[ i ].push_back( p * scale );
+			}
+		}
+		for ( bool enabled : { true, false } )
+		{
+			// built twice, the second build replaces the lines of the first
+			geometry.build( blobs, roi, scale, enabled, enabled, outputArea, style );
+			geometry.build( blobs, roi, scale, enabled, enabled, outputArea, style );
+			const vector< DebugGeometry::Vertex > &expected = enabled ? all : markers;
+			const vector< DebugGeometry::Vertex > &vertices = geometry.getVertices();
+			result.mNumCases++;
+			if ( vertices.size() != expected.size() )
+			{
+				fail( &result, "scale %g%s: %zu vertices instead of %zu", scale, enabled ? "" : " without bounds and hulls",
+					  vertices.size(), expected.size() );
+				continue;
+			}
+			for ( size_t i = 0; i < vertices.size(); i++ )
+			{
+				const vec2 d = vertices[ i ].mPos - expected[ i ].mPos;
+				if ( ( std::abs( d.x ) > 1e-3f ) || ( std::abs( d.y ) > 1e-3f ) ||
+					 ! isSameColor( vertices[ i ].mColor, expected[ i ].mColor ) )
+				{
+					fail( &result, "scale %g%s: vertex %zu at %g, %g instead of %g, %g", scale,
+						  enabled ? "" : " without bounds and hulls", i, vertices[ i ].mPos.x, vertices[ i ].mPos.y,
+						  expected[ i ].mPos.x, expected[ i ].mPos.y );
+					break;
+				}
+			}
+		}
+	}
+	return result;
+}
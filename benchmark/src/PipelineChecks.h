@@ -0,0 +1,62 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+#include "CinderOpenCV.h"
+
+//! Checks of the optimized stages of the tracker against their reference implementations on random inputs, run by
+//! the benchmark as the check/ scenarios. The same seed checks the same cases. The first failures of each check
+//! are described on stderr.
+class PipelineChecks
+{
+ public:
+	struct Result
+	{
+		uint64_t mNumCases = 0;
+		uint64_t mNumFailures = 0;
+	};
+
+	PipelineChecks( uint32_t seed ) : mRandom( seed ) {}
+
+	//! Compares the mask and the blurred image of FusedPreprocessStage bit for bit with cv::blur followed by
+	//! cv::threshold, or by the comparison with the local means for the adaptive threshold. The cases cover the
+	//! blur and block sizes, odd widths, inputs with padded rows, areas at the borders and inside, inverting, the
+	//! bit mask and the specialized and generic kernels, leaving out the sizes whose rounding FusedPreprocessStage
+	//! does not match. Only the SIMD path the library was compiled for runs, build the benchmark with SIMD=scalar,
+	//! sse2 or avx2 to check the others.
+	Result checkPreprocessStage( int numCases );
+	//! Compares the components of random masks labelled in 1 to \a maxStripes stripes, scanned concurrently and
+	//! joined at the seams, with the ones labelled in a single pass, from byte and bit masks. Then compares the
+	//! blobs of trackers splitting random frames into 2 to \a maxStripes stripes with the ones of a single thread.
+	Result checkStripes( int numCases, int maxStripes );
+	//! Compares the line vertices DebugGeometry builds for a few known blobs, with and without the bounds and hulls
+	//! and at two normalization scales, with their positions and colors worked out by hand.
+	Result checkDebugGeometry();
+
+ protected:
+	int uniform( int lo, int hi ) { return std::uniform_int_distribution< int >( lo, hi )( mRandom ); }
+	//! Fills \a image with noise over the full range, a gradient with noise, sparse saturated pixels or a constant.
+	void fillImage( cv::Mat &image );
+	//! Fills \a mask with 0 and 255, random discs and rectangles over speckles of a random density.
+	void fillMask( cv::Mat &mask );
+
+	std::mt19937 mRandom;
+};
@@ -0,0 +1,167 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "SyntheticVideo.h"
+
+using namespace ci;
+using namespace std;
+
+namespace {
+
+//! The noise table is longer than a frame by this many bytes, each frame starts at a random offset into it.
+const size_t kNoiseSlack = 4096;
+
+} // anonymous namespace
+
+SyntheticVideo::SyntheticVideo( const Params &params ) :
+	mParams( params ),
+	mRandom( params.mSeed ),
+	mChannel( params.mWidth, params.mHeight )
+{
+	const float r = mParams.mBlobRadius;
+	auto randomMover = [ & ]()
+	{
+		Mover m;
+		m.mPos = vec2( r + random() * std::max( mParams.mWidth - 2.f * r, 0.f ),
+					   r + random() * std::max( mParams.mHeight - 2.f * r, 0.f ) );
+		float angle = random() * 6.2831853f;
+		m.mVel = vec2( std::cos( angle ), std::sin( angle ) ) * mParams.mSpeed;
+		return m;
+	};
+
+	for ( int i = 0; i < mParams.mNumBlobs; i++ )
+	{
+		mMovers.push_back( randomMover() );
+	}
+	for ( int i = 0; i < mParams.mNumMergingPairs; i++ )
+	{
+		Pair p;
+		p.mCenter = randomMover();
+		p.mAngle = random() * 6.2831853f;
+		p.mAngularSpeed = .02f + random() * .03f;
+		p.mPhase = random() * 6.2831853f;
+		mPairs.push_back( p );
+	}
+	mPositions.resize( mMovers.size() + 2 * mPairs.size() );
+
+	const size_t numPixels = size_t( mParams.mWidth ) * size_t( mParams.mHeight );
+	mNoise.resize( numPixels + kNoiseSlack );
+	const int noise = std::max( mParams.mNoise, 0 );
+	for ( uint8_t &v : mNoise )
+	{
+		int n = ( noise > 0 ) ? int( mRandom() % uint32_t( 2 * noise + 1 ) ) - noise : 0;
+		v = uint8_t( std::min( std::max( int( kBackground ) + n, 0 ), 255 ) );
+	}
+}
+
+float SyntheticVideo::random()
+{
+	return float( double( mRandom() ) / 4294967296.0 );
+}
+
+void SyntheticVideo::move()
+{
+	const float r = mParams.mBlobRadius;
+	const vec2 lo( r );
+	const vec2 hi( std::max( mParams.mWidth - r, r ), std::max( mParams.mHeight - r, r ) );
+	auto bounce = [ & ]( Mover &m )
+	{
+		m.mPos += m.mVel;
+		for ( int i = 0; i < 2; i++ )
+		{
+			if ( ( m.mPos[ i ] < lo[ i ] ) || ( m.mPos[ i ] > hi[ i ] ) )
+			{
+				m.mVel[ i ] = -m.mVel[ i ];
+				m.mPos[ i ] = std::min( std::max( m.mPos[ i ], lo[ i ] ), hi[ i ] );
+			}
+		}
+	};
+
+	size_t k = 0;
+	for ( Mover &m : mMovers )
+	{
+		bounce( m );
+		mPositions[ k++ ] = m.mPos;
+	}
+
+	// the separation swings between half a radius, merged, and three and a half radii, apart
+	for ( Pair &p : mPairs )
+	{
+		bounce( p.mCenter );
+		p.mAngle += p.mAngularSpeed;
+		float separation = r * ( 2.f + 1.5f * std::sin( p.mAngle * .5f + p.mPhase ) );
+		vec2 offset = vec2( std::cos( p.mAngle ), std::sin( p.mAngle ) ) * ( separation * .5f );
+		mPositions[ k++ ] = p.mCenter.mPos + offset;
+		mPositions[ k++ ] = p.mCenter.mPos - offset;
+	}
+}
+
+void SyntheticVideo::drawDisc( const vec2 &center )
+{
+	const int w = mParams.mWidth;
+	const int h = mParams.mHeight;
+	const float r = mParams.mBlobRadius;
+	const int y1 = std::max( int( std::floor( center.y - r ) ), 0 );
+	const int y2 = std::min( int( std::ceil( center.y + r ) ), h - 1 );
+	const uint8_t lift = kForeground - kBackground;
+	for ( int y = y1; y <= y2; y++ )
+	{
+		// pixel centers within the radius
+		float dy = float( y ) - center.y;
+		float halfWidth = r * r - dy * dy;
+		if ( halfWidth < 0.f )
+		{
+			continue;
+		}
+		halfWidth = std::sqrt( halfWidth );
+		int x1 = std::max( int( std::ceil( center.x - halfWidth ) ), 0 );
+		int x2 = std::min( int( std::floor( center.x + halfWidth ) ), w - 1 );
+		uint8_t *row = mChannel.getData() + size_t( y ) * mChannel.getRowBytes();
+		for ( int x = x1; x <= x2; x++ )
+		{
+			// overlapping discs are not lifted twice
+			if ( row[ x ] < kForeground - mParams.mNoise )
+			{
+				row[ x ] = uint8_t( std::min( row[ x ] + lift, 255 ) );
+			}
+		}
+	}
+}
+
+const Channel8u & SyntheticVideo::nextFrame()
+{
+	move();
+
+	const int w = mParams.mWidth;
+	const int h = mParams.mHeight;
+	const uint8_t *noise = mNoise.data() + mRandom() % kNoiseSlack;
+	for ( int y = 0; y < h; y++ )
+	{
+		std::memcpy( mChannel.getData() + size_t( y ) * mChannel.getRowBytes(), noise + size_t( y ) * w, w );
+	}
+	for ( const vec2 &pos : mPositions )
+	{
+		drawDisc( pos );
+	}
+
+	mNumFrames++;
+	return mChannel;
+}
@@ -0,0 +1,87 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "cinder/Channel.h"
+#include "cinder/Vector.h"
+
+//! Deterministic synthetic blob video. Bright discs move over a dark noisy background and bounce off the
+//! image edges. Pairs of discs circling around a common center periodically merge and split. The same
+//! parameters give the same frames on every platform.
+class SyntheticVideo
+{
+ public:
+	struct Params
+	{
+		int mWidth = 1280;
+		int mHeight = 720;
+		int mNumBlobs = 20; //!< independently moving discs
+		int mNumMergingPairs = 0; //!< pairs of discs merging and splitting
+		float mBlobRadius = 24.f; //!< in pixels
+		float mSpeed = 4.f; //!< in pixels per frame
+		int mNoise = 8; //!< amplitude of the uniform pixel noise
+		uint32_t mSeed = 1;
+	};
+
+	SyntheticVideo( const Params &params );
+
+	//! Renders the next frame into the channel returned, which is reused by the following frames.
+	const ci::Channel8u & nextFrame();
+
+	//! Returns the centers of the discs in the last frame in pixels, the independent ones first.
+	const std::vector< ci::vec2 > & getPositions() const { return mPositions; }
+	uint64_t getNumFrames() const { return mNumFrames; }
+	const Params & getParams() const { return mParams; }
+
+	static const uint8_t kBackground = 40;
+	static const uint8_t kForeground = 200;
+
+ protected:
+	//! Returns a uniform random number in [ 0, 1 ) from the raw generator output, which is fixed by the standard.
+	float random();
+
+	void move();
+	void drawDisc( const ci::vec2 &center );
+
+	struct Mover
+	{
+		ci::vec2 mPos;
+		ci::vec2 mVel;
+	};
+
+	struct Pair
+	{
+		Mover mCenter;
+		float mAngle;
+		float mAngularSpeed;
+		float mPhase;
+	};
+
+	Params mParams;
+	std::mt19937 mRandom;
+	std::vector< Mover > mMovers;
+	std::vector< Pair > mPairs;
+	std::vector< ci::vec2 > mPositions;
+	std::vector< uint8_t > mNoise; // background with noise, a frame and a random offset long
+	ci::Channel8u mChannel;
+	uint64_t mNumFrames = 0;
+};
@@ -0,0 +1,229 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "TuioReceiver.h"
+
+using namespace std;
+
+namespace {
+
+uint32_t getInt32( const uint8_t *p )
+{
+	return ( uint32_t( p[ 0 ] ) << 24 ) | ( uint32_t( p[ 1 ] ) << 16 ) | ( uint32_t( p[ 2 ] ) << 8 ) | uint32_t( p[ 3 ] );
+}
+
+//! Returns the padded size of the string at \a p, or 0 if it is not terminated before \a end.
+size_t getStringSize( const uint8_t *p, const uint8_t *end )
+{
+	const void *zero = std::memchr( p, 0, size_t( end - p ) );
+	if ( zero == nullptr )
+	{
+		return 0;
+	}
+	size_t size = ( size_t( static_cast< const uint8_t * >( zero ) - p ) + 4 ) & ~size_t( 3 );
+	return ( size <= size_t( end - p ) ) ? size : 0;
+}
+
+} // anonymous namespace
+
+TuioReceiver::~TuioReceiver()
+{
+	close();
+}
+
+bool TuioReceiver::open()
+{
+	mSocket = socket( AF_INET, SOCK_DGRAM, 0 );
+	if ( mSocket < 0 )
+	{
+		return false;
+	}
+	sockaddr_in address;
+	std::memset( &address, 0, sizeof( address ) );
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	socklen_t length = sizeof( address );
+	// a large receive buffer, so the bursts of the sender are not dropped, and a timeout to notice close()
+	int bufferSize = 8 << 20;
+	timeval timeout = { 0, 20000 };
+	if ( ( bind( mSocket, reinterpret_cast< sockaddr * >( &address ), sizeof( address ) ) != 0 ) ||
+		 ( getsockname( mSocket, reinterpret_cast< sockaddr * >( &address ), &length ) != 0 ) ||
+		 ( setsockopt( mSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) ) != 0 ) )
+	{
+		::close( mSocket );
+		mSocket = -1;
+		return false;
+	}
+	setsockopt( mSocket, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof( bufferSize ) );
+	mPort = ntohs( address.sin_port );
+	mRunning = true;
+	mThread = thread( &TuioReceiver::receive, this );
+	return true;
+}
+
+void TuioReceiver::close()
+{
+	mRunning = false;
+	if ( mThread.joinable() )
+	{
+		mThread.join();
+	}
+	if ( mSocket >= 0 )
+	{
+		::close( mSocket );
+		mSocket = -1;
+	}
+}
+
+void TuioReceiver::receive()
+{
+	vector< uint8_t > buffer( 65536 );
+	for ( ;; )
+	{
+		ssize_t size = recv( mSocket, buffer.data(), buffer.size(), 0 );
+		if ( size < 0 )
+		{
+			// timed out with nothing queued
+			if ( ! mRunning )
+			{
+				break;
+			}
+			continue;
+		}
+		mNumPackets++;
+		mLargestPacketSize = std::max( mLargestPacketSize.load(), size_t( size ) );
+		if ( ! parse( buffer.data(), size_t( size ) ) )
+		{
+			mNumMalformed++;
+		}
+	}
+}
+
+bool TuioReceiver::parse( const uint8_t *data, size_t size )
+{
+	if ( ( size < 16 ) || ( std::memcmp( data, "#bundle", 8 ) != 0 ) )
+	{
+		return false;
+	}
+
+	const uint8_t *end = data + size;
+	const uint8_t *p = data + 16;
+	size_t blobMessagesSize = 0;
+	while ( p < end )
+	{
+		if ( end - p < 4 )
+		{
+			return false;
+		}
+		size_t elementSize = getInt32( p );
+		p += 4;
+		if ( ( elementSize > size_t( end - p ) ) || ( elementSize % 4 != 0 ) )
+		{
+			return false;
+		}
+		const uint8_t *elementEnd = p + elementSize;
+
+		const char *address = reinterpret_cast< const char * >( p );
+		size_t addressSize = getStringSize( p, elementEnd );
+		if ( addressSize == 0 )
+		{
+			return false;
+		}
+		const char *types = reinterpret_cast< const char * >( p + addressSize );
+		size_t typesSize = getStringSize( p + addressSize, elementEnd );
+		if ( ( typesSize == 0 ) || ( types[ 0 ] != ',' ) )
+		{
+			return false;
+		}
+
+		const uint8_t *arg = p + addressSize + typesSize;
+		const uint8_t *firstArg = arg;
+		size_t numInts = 0;
+		for ( const char *t = types + 1; *t != 0; t++ )
+		{
+			size_t argSize = 0;
+			switch ( *t )
+			{
+				case 'i':
+				case 'f':
+					argSize = 4;
+					numInts += ( *t == 'i' );
+					break;
+				case 't':
+					argSize = 8;
+					break;
+				case 's':
+					argSize = getStringSize( arg, elementEnd );
+					break;
+				default:
+					return false;
+			}
+			if ( ( argSize == 0 ) || ( argSize > size_t( elementEnd - arg ) ) )
+			{
+				return false;
+			}
+			arg += argSize;
+		}
+		if ( arg != elementEnd )
+		{
+			return false;
+		}
+
+		const char *command = reinterpret_cast< const char * >( firstArg );
+		if ( std::strcmp( address, "/tuio2/bnd" ) == 0 )
+		{
+			mNumBlobMessages++;
+			blobMessagesSize += 4 + elementSize;
+		}
+		else if ( std::strcmp( address, "/tuio2/alv" ) == 0 )
+		{
+			mNumAlive = numInts;
+		}
+		else if ( ( std::strcmp( address, "/tuio/2Dblb" ) == 0 ) && ( types[ 1 ] == 's' ) )
+		{
+			if ( std::strcmp( command, "set" ) == 0 )
+			{
+				mNumBlobMessages++;
+				blobMessagesSize += 4 + elementSize;
+			}
+			else if ( std::strcmp( command, "alive" ) == 0 )
+			{
+				mNumAlive = numInts;
+			}
+		}
+		p = elementEnd;
+	}
+
+	// the split of TuioSender::pack(), the blob messages fill the packet size or come on top of the other messages
+	// if those take more than half of it
+	const size_t otherSize = size - blobMessagesSize;
+	const size_t maxSize = ( otherSize > mMaxPacketSize / 2 ) ? ( otherSize + mMaxPacketSize ) : mMaxPacketSize;
+	if ( ( mMaxPacketSize > 0 ) && ( size > maxSize ) )
+	{
+		mNumOversized++;
+	}
+	return true;
+}
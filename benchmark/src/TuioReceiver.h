@@ -0,0 +1,75 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+//! Loopback UDP receiver checking the TUIO bundles of a TuioSender. Every datagram is parsed as an OSC bundle,
+//! the element sizes have to add up and the type tags have to match the arguments. The blob messages and the
+//! alive ids of the last bundle are counted. Bundles larger than the maximum packet size of the sender are counted
+//! as oversized.
+class TuioReceiver
+{
+ public:
+	~TuioReceiver();
+
+	//! Sets the maximum packet size of the sender, see TuioSender::Options::setMaxPacketSize(). A bundle whose other
+	//! messages take more than half of it may carry this many bytes of blob messages besides them. Zero, the default,
+	//! accepts any size. Call before open().
+	void setMaxPacketSize( size_t maxPacketSize ) { mMaxPacketSize = maxPacketSize; }
+
+	//! Binds to an ephemeral port of 127.0.0.1 and starts receiving. Returns false if the socket cannot be bound.
+	bool open();
+	//! Stops receiving after the datagrams already queued.
+	void close();
+
+	uint16_t getPort() const { return mPort; }
+
+	uint64_t getNumPackets() const { return mNumPackets; }
+	//! Returns the number of datagrams that are not well-formed OSC bundles.
+	uint64_t getNumMalformed() const { return mNumMalformed; }
+	//! Returns the number of well-formed bundles larger than the maximum packet size allows.
+	uint64_t getNumOversized() const { return mNumOversized; }
+	//! Returns the size of the largest datagram in bytes.
+	size_t getLargestPacketSize() const { return mLargestPacketSize; }
+	//! Returns the number of /tuio/2Dblb set and /tuio2/bnd messages.
+	uint64_t getNumBlobMessages() const { return mNumBlobMessages; }
+	//! Returns the number of alive ids in the last bundle.
+	size_t getNumAlive() const { return mNumAlive; }
+
+ protected:
+	void receive();
+	//! Parses the bundle of \a size bytes at \a data, returns false if it is malformed.
+	bool parse( const uint8_t *data, size_t size );
+
+	size_t mMaxPacketSize = 0;
+	int mSocket = -1;
+	uint16_t mPort = 0;
+	std::thread mThread;
+	std::atomic< bool > mRunning { false };
+
+	std::atomic< uint64_t > mNumPackets { 0 };
+	std::atomic< uint64_t > mNumMalformed { 0 };
+	std::atomic< uint64_t > mNumOversized { 0 };
+	std::atomic< size_t > mLargestPacketSize { 0 };
+	std::atomic< uint64_t > mNumBlobMessages { 0 };
+	std::atomic< size_t > mNumAlive { 0 };
+};
@@ -0,0 +1,55 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "CinderOpenCV.h"
+
+namespace mndl { namespace blobtracker {
+
+//! Exponential running average background of an 8-bit image stream. The background is kept in 8.7 fixed
+//! point, 16 bits per pixel, and the difference and the update are done in one pass vectorized with AVX2
+//! or SSE2 when the compiler targets them. apply() and reset() can be called from any thread.
+class BackgroundModel
+{
+ public:
+	//! Writes the absolute difference of \a area of \a input and the background to the same area of
+	//! \a foreground, then moves the background towards the input by \a learningRate, in [ 0, 0.5 ).
+	//! Pixels whose difference is above \a freezeThreshold are not learned. The first frame, and the first
+	//! after the size of \a input or \a area changed, becomes the background.
+	void apply( const cv::Mat &input, const cv::Rect &area, float learningRate, int freezeThreshold,
+				cv::Mat &foreground );
+
+	//! Forgets the background, the next frame becomes the background.
+	void reset();
+
+ protected:
+	//! Processes \a n pixels, \a rate is the learning rate scaled by 65536.
+	static void applyRow( const uint8_t *input, int16_t *background, uint8_t *foreground, int n,
+						  int rate, int freezeThreshold );
+
+	std::mutex mMutex;
+	std::vector< int16_t > mBackground; // rows of mArea.width pixels
+	cv::Size mSize;
+	cv::Rect mArea;
+};
+
+} } // namespace mndl::blobtracker
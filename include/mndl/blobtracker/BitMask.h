@@ -0,0 +1,112 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "CinderOpenCV.h"
+
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+
+namespace mndl { namespace blobtracker {
+
+//! Returns the index of the lowest set bit of \a word, which must not be zero.
+inline int countTrailingZeros( uint64_t word )
+{
+#if defined( _MSC_VER ) && defined( _M_X64 )
+	unsigned long index;
+	_BitScanForward64( &index, word );
+	return int( index );
+#elif defined( _MSC_VER )
+	unsigned long index;
+	if ( _BitScanForward( &index, uint32_t( word ) ) )
+	{
+		return int( index );
+	}
+	_BitScanForward( &index, uint32_t( word >> 32 ) );
+	return int( index ) + 32;
+#else
+	return __builtin_ctzll( word );
+#endif
+}
+
+//! Binary image at one bit per pixel. Pixel x of a row is bit x % 64 of word x / 64, the rows start on word
+//! boundaries and the bits past the width are kept zero. The buffer is kept between calls.
+class BitMask
+{
+ public:
+	//! Sets the size to \a size. All pixels are cleared if the size changes.
+	void create( const cv::Size &size );
+	//! Copies the size and the pixels to \a dst, without the scratch buffers.
+	void copyTo( BitMask &dst ) const;
+
+	cv::Size getSize() const { return cv::Size( mWidth, mHeight ); }
+	int getWidth() const { return mWidth; }
+	int getHeight() const { return mHeight; }
+	size_t getWordsPerRow() const { return mWordsPerRow; }
+	bool empty() const { return mWords.empty(); }
+	const uint64_t * getData() const { return mWords.data(); }
+
+	uint64_t * getRow( int y ) { return mWords.data() + size_t( y ) * mWordsPerRow; }
+	const uint64_t * getRow( int y ) const { return mWords.data() + size_t( y ) * mWordsPerRow; }
+	bool get( int x, int y ) const { return ( ( getRow( y )[ x >> 6 ] >> ( x & 63 ) ) & 1 ) != 0; }
+
+	//! Sets the pixels of \a area to \a value.
+	void fill( const cv::Rect &area, bool value );
+	//! Sets pixels \a x to \a x + \a n - 1 of row \a y from the bytes at \a src, non-zero bytes are set.
+	void packRow( const uint8_t *src, int x, int y, int n );
+	//! Packs \a area of the 8-bit \a mask into the same area.
+	void pack( const cv::Mat &mask, const cv::Rect &area );
+	//! Writes \a area as 0 and 255 bytes into the same area of the 8-bit \a dst, which must have the size of the mask.
+	void unpack( const cv::Rect &area, cv::Mat &dst ) const;
+
+ protected:
+	int mWidth = 0;
+	int mHeight = 0;
+	size_t mWordsPerRow = 0;
+	std::vector< uint64_t > mWords;
+};
+
+//! Erosion and dilation of bit masks with a square kernel. The rows are shifted and combined a whole word, 64 pixels,
+//! at a time, horizontally first, then vertically. Keeps scratch buffers, an instance must not be used by more
+//! than one thread at a time.
+class BitMorphology
+{
+ public:
+	//! Erodes \a area of \a src with a square of 2 * \a radius + 1 pixels into the same area of \a dst, which must
+	//! have the size of \a src. The pixels outside \a bounds count as set, so blobs touching the edges of the
+	//! processed area do not shrink there, like cv::erode. \a radius is clamped to [ 0, 63 ].
+	void erode( const BitMask &src, BitMask &dst, const cv::Rect &area, const cv::Rect &bounds, int radius )
+	{ apply( src, dst, area, bounds, radius, true ); }
+	//! Dilates \a area of \a src like erode(), the pixels outside \a bounds count as clear.
+	void dilate( const BitMask &src, BitMask &dst, const cv::Rect &area, const cv::Rect &bounds, int radius )
+	{ apply( src, dst, area, bounds, radius, false ); }
+
+ protected:
+	void apply( const BitMask &src, BitMask &dst, const cv::Rect &area, const cv::Rect &bounds, int radius,
+				bool erode );
+
+	std::vector< uint64_t > mBoundsMasks;
+	std::vector< uint64_t > mRowWords;
+	std::vector< uint64_t > mRows; // horizontally filtered rows
+};
+
+} } // namespace mndl::blobtracker
@@ -23,14 +23,62 @@
 #include "cinder/Rect.h"
 #include "cinder/Vector.h"
 
+#include "mndl/blobtracker/BlobPool.h"
+#include "mndl/blobtracker/FrameResult.h"
+
 namespace mndl { namespace blobtracker {
 
 typedef std::shared_ptr< struct Blob > BlobRef;
 
+//! Copy of a blob of a BlobPool, see BlobTracker::getBlobs().
 struct Blob
 {
  public:
 	static BlobRef create() { return BlobRef( new Blob() ); }
+	//! Creates a copy of the blob at \a index of \a pool.
+	static BlobRef create( const BlobPool &pool, size_t index )
+	{
+		BlobRef blob = create();
+		blob->set( pool, index );
+		return blob;
+	}
+
+	//! Copies the blob at \a index of \a pool. The hull is reused if nobody else holds it.
+	void set( const BlobPool &pool, size_t index )
+	{
+		mId = pool.mIds[ index ];
+		mBounds = pool.mBounds[ index ];
+		mPos = pool.mPositions[ index ];
+		mPrevPos = pool.mPrevPositions[ index ];
+		const ci::PolyLine2f &hull = pool.mConvexHulls[ index ];
+		if ( hull.size() == 0 )
+		{
+			mConvexHull.reset();
+			return;
+		}
+		if ( ! mConvexHull || ! isSoleOwner( mConvexHull ) )
+		{
+			mConvexHull = std::make_shared< ci::PolyLine2f >();
+		}
+		*mConvexHull = hull;
+	}
+
+	//! Copies \a state of a blob of \a frame.
+	void set( const FrameResult &frame, const FrameResult::BlobState &state )
+	{
+		mId = state.mId;
+		mBounds = state.mBounds;
+		mPos = state.mPos;
+		mPrevPos = state.mPrevPos;
+		if ( state.mNumHullPoints == 0 )
+		{
+			mConvexHull.reset();
+			return;
+		}
+		Span< ci::vec2 > hull = frame.getHullPoints( state );
+		mConvexHull = std::make_shared< ci::PolyLine2f >( std::vector< ci::vec2 >( hull.begin(), hull.end() ) );
+		mConvexHull->setClosed();
+	}
 
 	int32_t mId;
 	ci::Rectf mBounds;
@@ -42,26 +90,44 @@ struct Blob
 	Blob() : mId( -1 ) {}
 };
 
-//! Represents a blob event
+//! Represents a blob event. The blob state is copied and the frame result the event was emitted from is held, so
+//! an event stays valid after the callback for as long as it is kept. A kept event keeps its frame result out of
+//! the tracker's reuse, which then allocates a new one.
 class BlobEvent
 {
  public:
-	BlobEvent( BlobRef blobRef ) : mBlobRef( blobRef ) {}
+	BlobEvent( const FrameResultRef &frame, const FrameResult::BlobState &state ) :
+		mFrame( frame ), mState( state )
+	{}
 
 	//! Returns an ID unique for the lifetime of the blob.
-	int32_t getId() const { return mBlobRef->mId; }
+	int32_t getId() const { return mState.mId; }
 	//! Returns the position of the blob centroid normalized to the image resolution.
-	ci::vec2 getPos() const { return mBlobRef->mPos; }
+	ci::vec2 getPos() const { return mState.mPos; }
 	//! Returns the previous position of the blob centroid normalized to the image resolution.
-	ci::vec2 getPrevPos() const { return mBlobRef->mPrevPos; }
+	ci::vec2 getPrevPos() const { return mState.mPrevPos; }
 	//! Returns the bounding box of the blob.
-	ci::Rectf & getBounds() const { return mBlobRef->mBounds; }
-	//! Returns the blob object reference.
-	const BlobRef & getBlob() const { return mBlobRef; }
+	const ci::Rectf & getBounds() const { return mState.mBounds; }
+	//! Returns the handle of the blob in BlobTracker::getBlobPool(), valid until the blob ends.
+	const BlobHandle & getHandle() const { return mState.mHandle; }
+	//! Returns true if the position was predicted by the motion model in a frame without detection.
+	bool isExtrapolated() const { return mState.mExtrapolated; }
+	//! Returns the convex hull points of the blob in the frame of the event.
+	Span< ci::vec2 > getConvexHull() const { return mFrame->getHullPoints( mState ); }
+	//! Returns the frame result the event was emitted from.
+	const FrameResultRef & getFrameResult() const { return mFrame; }
+	//! Returns a new copy of the blob in the frame of the event, allocates. Unlike the tracker's Blob returned by
+	//! earlier versions, each call makes a separate snapshot that later frames do not update.
+	BlobRef getBlob() const
+	{
+		BlobRef blob = Blob::create();
+		blob->set( *mFrame, mState );
+		return blob;
+	}
 
 private:
-	BlobRef mBlobRef;
+	FrameResultRef mFrame;
+	FrameResult::BlobState mState;
 };
 
 } } // namespace mndl::blobtracker
-
@@ -0,0 +1,112 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "cinder/Vector.h"
+
+#include "CinderOpenCV.h"
+
+#include "mndl/blobtracker/BitMask.h"
+
+namespace mndl { namespace blobtracker {
+
+//! Run-length connected component labelling of a binary mask. The 8-connected components are
+//! found with union-find on the runs of non-zero pixels, while their area, bounding box and
+//! first-order moments are accumulated in the same pass. The cost is proportional to the number
+//! of runs, not the number of components. The scratch buffers are kept between calls.
+class BlobLabeler
+{
+ public:
+	struct Component
+	{
+		cv::Rect mBounds; //!< bounding box in pixels
+		int64_t mArea; //!< number of pixels
+		ci::vec2 mCentroid; //!< mean of the pixel coordinates
+		size_t mFirstPoint; //!< index of the first outline point in getPoints()
+		size_t mNumPoints; //!< number of outline points
+	};
+
+	//! Labels the non-zero pixels of the 8-bit \a mask. Components with a bounding box area outside
+	//! [ \a minBoundsArea, \a maxBoundsArea ) are dropped. \a offset is added to all coordinates.
+	//! If \a collectPoints is true the first and last pixel of each run of the kept components are
+	//! collected, their convex hull is the convex hull of the component.
+	const std::vector< Component > & label( const cv::Mat &mask, const cv::Point &offset,
+											float minBoundsArea, float maxBoundsArea, bool collectPoints )
+	{
+		scan( mask, offset );
+		return finish( minBoundsArea, maxBoundsArea, collectPoints );
+	}
+
+	//! Labels the runs of \a mask at \a offset without building the components. Stripes of a mask
+	//! scanned by separate labelers are joined with append().
+	void scan( const cv::Mat &mask, const cv::Point &offset );
+	//! Labels the runs of \a area of the bit \a mask like scan(), in the coordinates of the mask. The runs are
+	//! found 64 pixels at a time from the lowest set and clear bits of the words.
+	void scan( const BitMask &mask, const cv::Rect &area );
+	//! Removes all runs.
+	void clear();
+	//! Appends the runs of \a stripe and joins the components touching across the seam if the stripe
+	//! starts on the row below the last one scanned.
+	void append( const BlobLabeler &stripe );
+	//! Builds the components of the scanned runs, see label().
+	const std::vector< Component > & finish( float minBoundsArea, float maxBoundsArea, bool collectPoints );
+
+	const std::vector< Component > & getComponents() const { return mComponents; }
+	const std::vector< cv::Point > & getPoints() const { return mPoints; }
+	//! Returns the number of components dropped by the area limits in the last finish().
+	size_t getNumRejected() const { return mNumRejected; }
+
+ protected:
+	int32_t findRoot( int32_t label );
+	void merge( int32_t a, int32_t b );
+	//! Adds the run [ \a x1, \a x2 ) of row \a y and merges it with the touching runs of the previous row in
+	//! [ \a prev, \a prevEnd ). \a prev is advanced past the runs left of it.
+	void addRun( int32_t y, int32_t x1, int32_t x2, size_t &prev, size_t prevEnd );
+	//! Merges the runs in [ \a prevBegin, \a prevEnd ) with the touching runs of the next row in [ \a begin, \a end ).
+	void joinRows( size_t prevBegin, size_t prevEnd, size_t begin, size_t end );
+
+	struct Run
+	{
+		int32_t mY;
+		int32_t mX1, mX2; // [ mX1, mX2 ), offset applied
+		int32_t mLabel;
+	};
+
+	struct Stats
+	{
+		int64_t mArea;
+		int64_t mSumX, mSumY;
+		int32_t mX1, mY1, mX2, mY2; // inclusive
+	};
+
+	int mTop = 0; // first scanned row
+	int mBottom = 0; // row after the last scanned one
+	size_t mLastRowBegin = 0; // first run of the last scanned row
+
+	std::vector< Run > mRuns;
+	std::vector< int32_t > mParents;
+	std::vector< Stats > mStats;
+	std::vector< int32_t > mComponentIndices;
+	std::vector< Component > mComponents;
+	std::vector< cv::Point > mPoints;
+	size_t mNumRejected = 0;
+};
+
+} } // namespace mndl::blobtracker
@@ -0,0 +1,92 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "cinder/Vector.h"
+
+#include "mndl/blobtracker/SpatialGrid.h"
+
+namespace mndl { namespace blobtracker {
+
+//! Assigns tracks to new blobs based on a gated cost matrix of squared distances.
+//! The scratch buffers are kept between calls, so matching does not allocate once the
+//! number of tracks and blobs has settled.
+class BlobMatcher
+{
+ public:
+	//! Builds the \a trackPos x \a blobPos cost matrix. Pairs farther than \a maxDistance are gated out.
+	void computeCosts( const std::vector< ci::vec2 > &trackPos, const std::vector< ci::vec2 > &blobPos,
+					   float maxDistance );
+	//! Collects the pairs of each of \a trackPos and its \a maxCandidates closest blobs sorted into \a blobGrid
+	//! within \a maxDistance, without the cost matrix, so the work grows with the number of tracks instead of
+	//! tracks x blobs, however many blobs are within \a maxDistance. Only matchGreedy() can use them. A track whose
+	//! candidates are all taken by closer tracks stays unmatched, even if a farther blob within \a maxDistance is left.
+	void computeCandidates( const std::vector< ci::vec2 > &trackPos, const SpatialGrid &blobGrid, float maxDistance,
+							size_t maxCandidates = 8 );
+
+	//! Assigns the closest pairs first, the lower track and blob index of equally close ones. Returns the blob
+	//! index for each track or -1 if the track is unmatched.
+	const std::vector< int32_t > & matchGreedy();
+	//! Finds the assignment with the maximum number of matches and the minimum total squared distance.
+	//! Returns the blob index for each track or -1 if the track is unmatched.
+	const std::vector< int32_t > & matchHungarian();
+
+	size_t getNumTracks() const { return mNumTracks; }
+	size_t getNumBlobs() const { return mNumBlobs; }
+
+ protected:
+	bool isGated( size_t track, size_t blob ) const { return mCosts[ track * mNumBlobs + blob ] > mMaxCost; }
+
+	size_t mNumTracks = 0;
+	size_t mNumBlobs = 0;
+	float mMaxCost = 0.f;
+	std::vector< float > mCosts;
+	std::vector< int32_t > mAssignment;
+	bool mCandidatesCollected = false; // by computeCandidates(), instead of the cost matrix
+
+	// greedy scratch
+	struct Candidate
+	{
+		float mCost;
+		uint32_t mTrack;
+		uint32_t mBlob;
+
+		bool operator<( const Candidate &rhs ) const
+		{
+			if ( mCost != rhs.mCost )
+			{
+				return mCost < rhs.mCost;
+			}
+			return ( mTrack != rhs.mTrack ) ? ( mTrack < rhs.mTrack ) : ( mBlob < rhs.mBlob );
+		}
+	};
+	std::vector< Candidate > mCandidates;
+	std::vector< bool > mBlobTaken;
+	std::vector< std::pair< float, uint32_t > > mNearest; // of a track in the grid
+
+	// hungarian scratch
+	std::vector< double > mU, mV, mMinV;
+	std::vector< int32_t > mP, mWay;
+	std::vector< bool > mUsed;
+};
+
+} } // namespace mndl::blobtracker
@@ -0,0 +1,101 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cinder/PolyLine.h"
+#include "cinder/Rect.h"
+#include "cinder/Vector.h"
+
+namespace mndl { namespace blobtracker {
+
+//! Stable reference to a blob of a BlobPool. A handle outlives moves of its blob inside the pool,
+//! the generation tells it apart from a later blob reusing the same slot.
+struct BlobHandle
+{
+	BlobHandle() : mSlot( 0 ), mGeneration( 0 ) {}
+	BlobHandle( uint32_t slot, uint32_t generation ) : mSlot( slot ), mGeneration( generation ) {}
+
+	uint32_t mSlot;
+	uint32_t mGeneration; //!< 0 is never live
+
+	bool operator==( const BlobHandle &rhs ) const { return ( mSlot == rhs.mSlot ) && ( mGeneration == rhs.mGeneration ); }
+	bool operator!=( const BlobHandle &rhs ) const { return ! ( *this == rhs ); }
+};
+
+//! Structure of arrays storage of blobs. The blob properties are kept in densely packed columns indexed by
+//! [ 0, getSize() ), so a pass over one property touches contiguous memory. Removing a blob moves the last
+//! one into its place. Slots, columns and the point buffers of the hulls are reused, so the pool does not
+//! allocate once the number of blobs has settled.
+class BlobPool
+{
+ public:
+	//! Appends a blob with id -1, zero position, velocity and bounds and an empty hull at index getSize() - 1.
+	BlobHandle add();
+	//! Removes the blob at \a index, the last blob is moved into its place.
+	void removeAt( size_t index );
+	//! Removes the blob of \a handle, which has to be valid.
+	void remove( const BlobHandle &handle ) { removeAt( getIndex( handle ) ); }
+	//! Removes all blobs and invalidates their handles.
+	void clear();
+
+	size_t getSize() const { return mIds.size(); }
+	bool isEmpty() const { return mIds.empty(); }
+
+	//! Returns whether \a handle refers to a blob still in the pool.
+	bool isValid( const BlobHandle &handle ) const
+	{
+		return ( handle.mSlot < mSlots.size() ) && ( mSlots[ handle.mSlot ].mGeneration == handle.mGeneration );
+	}
+	//! Returns the current index of the blob of the valid \a handle.
+	size_t getIndex( const BlobHandle &handle ) const { return mSlots[ handle.mSlot ].mIndex; }
+	//! Returns the handle of the blob at \a index.
+	BlobHandle getHandle( size_t index ) const
+	{
+		uint32_t slot = mIndexSlots[ index ];
+		return BlobHandle( slot, mSlots[ slot ].mGeneration );
+	}
+
+	//! Copies the position, bounds and hull of the blob at \a srcIndex of \a src to the blob at \a index.
+	//! The previous position is set to the old position of the blob. The id and velocity are kept.
+	void update( size_t index, const BlobPool &src, size_t srcIndex );
+
+	// blob properties indexed by [ 0, getSize() ), written in place, never resized directly
+	std::vector< int32_t > mIds;
+	std::vector< ci::vec2 > mPositions; //!< centroid normalized to the image resolution
+	std::vector< ci::vec2 > mPrevPositions;
+	std::vector< ci::vec2 > mVelocities; //!< normalized units per second, zero unless prediction is enabled
+	std::vector< ci::Rectf > mBounds;
+	std::vector< ci::PolyLine2f > mConvexHulls; //!< empty if the convex hull is disabled
+
+ protected:
+	struct Slot
+	{
+		uint32_t mIndex;
+		uint32_t mGeneration;
+	};
+
+	std::vector< Slot > mSlots;
+	std::vector< uint32_t > mIndexSlots; // slot of each index
+	std::vector< uint32_t > mFreeSlots;
+	std::vector< ci::PolyLine2f > mSpareHulls; // hulls of removed blobs keeping their point buffers
+};
+
+} } // namespace mndl::blobtracker
@@ -17,17 +17,34 @@
 
 #pragma once
 
+#include <thread>
 #include <vector>
 
 #include "cinder/params/Params.h"
 
 #include "cinder/Channel.h"
 #include "cinder/Function.h"
+#include "cinder/Rect.h"
 #include "cinder/Vector.h"
 
 #include "CinderOpenCV.h"
 
+#include "mndl/blobtracker/BackgroundModel.h"
+#include "mndl/blobtracker/BitMask.h"
 #include "mndl/blobtracker/Blob.h"
+#include "mndl/blobtracker/BlobLabeler.h"
+#include "mndl/blobtracker/BlobMatcher.h"
+#include "mndl/blobtracker/BlobPool.h"
+#include "mndl/blobtracker/FrameMailbox.h"
+#include "mndl/blobtracker/FrameResult.h"
+#include "mndl/blobtracker/InputFrame.h"
+#include "mndl/blobtracker/PreprocessStage.h"
+#include "mndl/blobtracker/SnapshotCell.h"
+#include "mndl/blobtracker/SpatialGrid.h"
+#include "mndl/blobtracker/Stats.h"
+#include "mndl/blobtracker/TileChangeDetector.h"
+#include "mndl/blobtracker/TripleBuffer.h"
+#include "mndl/blobtracker/WorkStealingPool.h"
 
 namespace mndl { namespace blobtracker {
 
@@ -65,11 +82,196 @@ class BlobTracker
 		{ mNormalizedRegionOfInterest = normalizedRoi; }
 		void enableBlankOutsideRoi( bool blankOutsideRoi = true )
 		{ mBlankOutsideRoi = blankOutsideRoi; }
+		//! If \a cropToRoi is true only the region of interest is blurred, thresholded and traced, blobs are clipped to its edges.
+		//! Replaces blanking outside the region of interest.
+		void enableCropToRoi( bool cropToRoi = true ) { mCropToRoi = cropToRoi; }
+		//! Returns whether processing is restricted to the region of interest.
+		bool isCropToRoi() const { return mCropToRoi; }
 
 		//! If /a enableInvert is true the thresholding pass returns an inverted image.
 		void enableThresholdInvert( bool enableInvert = true ) { mThresholdInvertEnabled = enableInvert; }
 		//! Returns whether thresholding inverts the image.
 		bool isThresholdInvert() const { return mThresholdInvertEnabled; }
+		//! If \a enableAdaptive is true the blurred pixels are compared with the mean of the input around them instead
+		//! of the threshold, which copes with uneven lighting. A pixel passes if it is brighter than its local mean by
+		//! more than the adaptive offset, or darker if the threshold inverts. Disabled by default.
+		void enableAdaptiveThreshold( bool enableAdaptive = true ) { mAdaptiveThresholdEnabled = enableAdaptive; }
+		//! Returns whether the pixels are compared with their local mean instead of the threshold.
+		bool isAdaptiveThreshold() const { return mAdaptiveThresholdEnabled; }
+		//! Sets the width and height in pixels of the area the local mean is taken over, 51 by default.
+		//! PreprocessMode::FUSED takes it from an integral image, so the cost does not depend on the size.
+		void setAdaptiveThresholdBlockSize( int blockSize ) { mAdaptiveThresholdBlockSize = blockSize; }
+		int getAdaptiveThresholdBlockSize() const { return mAdaptiveThresholdBlockSize; }
+		//! Sets how much brighter, or darker if inverted, than its local mean a pixel has to be, 10 by default.
+		void setAdaptiveThresholdOffset( int offset ) { mAdaptiveThresholdOffset = offset; }
+		int getAdaptiveThresholdOffset() const { return mAdaptiveThresholdOffset; }
+
+		//! Enables or disables keeping the input, blurred and thresholded images for getImage*(), needed by DebugDrawer. Enabled by default.
+		//! When disabled, the thresholded image is traced in place and the getImage*() functions return empty images.
+		void enableDebugImages( bool enableDebugImages = true ) { mDebugImagesEnabled = enableDebugImages; }
+		//! Returns whether the input, blurred and thresholded images are kept.
+		bool isDebugImagesEnabled() const { return mDebugImagesEnabled; }
+
+		enum class MatchMode : int
+		{
+			KNN = 0, //!< k-nearest neighbour voting per track, the original behaviour
+			GREEDY, //!< closest pairs first on the gated cost matrix
+			HUNGARIAN //!< optimal assignment on the gated cost matrix
+		};
+
+		//! Sets how tracks are associated with the blobs of the new frame. MatchMode::KNN by default.
+		void setMatchMode( MatchMode matchMode ) { mMatchMode = matchMode; }
+		//! Returns how tracks are associated with the blobs of the new frame.
+		MatchMode getMatchMode() const { return mMatchMode; }
+		//! Sets the maximum distance a blob can move between frames and still continue its track, relative to the normalization scale. Ignored by MatchMode::KNN unless the match grid is enabled. 0.1 by default.
+		void setMaxMatchDistance( float maxMatchDistance ) { mMaxMatchDistance = maxMatchDistance; }
+		//! Returns the maximum distance a blob can move between frames and still continue its track.
+		float getMaxMatchDistance() const { return mMaxMatchDistance; }
+		//! Enables or disables the spatial grid over the blobs of the new frame, rebuilt for each frame in linear time.
+		//! MatchMode::GREEDY only pairs each track with its 8 closest blobs within the maximum match distance,
+		//! found ring by ring from the track's cell, which keeps the matching near linear with thousands of blobs
+		//! however large the distance is. MatchMode::KNN also stops at the maximum match distance then,
+		//! MatchMode::HUNGARIAN still solves the full cost matrix. Disabled by default.
+		void enableMatchGrid( bool enableMatchGrid = true ) { mMatchGridEnabled = enableMatchGrid; }
+		//! Returns whether the tracks are matched through the spatial grid.
+		bool isMatchGridEnabled() const { return mMatchGridEnabled; }
+
+		enum class PreprocessMode : int
+		{
+			OPENCV = 0, //!< separate cv::blur and cv::threshold passes
+			FUSED //!< single pass box blur and threshold, see FusedPreprocessStage
+		};
+
+		//! Sets how the input is blurred and thresholded. PreprocessMode::OPENCV by default.
+		void setPreprocessMode( PreprocessMode preprocessMode ) { mPreprocessMode = preprocessMode; }
+		//! Returns how the input is blurred and thresholded.
+		PreprocessMode getPreprocessMode() const { return mPreprocessMode; }
+
+		enum class DetectionMode : int
+		{
+			CONTOURS = 0, //!< traces the outer contours of the thresholded image, the original behaviour
+			LABELS //!< labels the connected components of the thresholded image, see BlobLabeler
+		};
+
+		//! Sets how blobs are extracted from the thresholded image. DetectionMode::CONTOURS by default.
+		//! DetectionMode::LABELS rejects blobs by area in the labelling pass and uses the pixel centroid.
+		//! Blobs inside the holes of other blobs are also reported.
+		void setDetectionMode( DetectionMode detectionMode ) { mDetectionMode = detectionMode; }
+		//! Returns how blobs are extracted from the thresholded image.
+		DetectionMode getDetectionMode() const { return mDetectionMode; }
+
+		//! If \a enableBitMask is true, DetectionMode::LABELS keeps the thresholded image at one bit per pixel. Each
+		//! row is packed as it is thresholded and the runs are labelled 64 pixels at a time, getImageThresholded()
+		//! unpacks the mask on demand. DetectionMode::CONTOURS always traces a byte image. Disabled by default.
+		void enableBitMask( bool enableBitMask = true ) { mBitMaskEnabled = enableBitMask; }
+		//! Returns whether the thresholded image is kept at one bit per pixel in DetectionMode::LABELS.
+		bool isBitMaskEnabled() const { return mBitMaskEnabled; }
+
+		enum class Morphology : int
+		{
+			NONE = 0,
+			OPEN, //!< erosion then dilation, removes specks and thin bridges smaller than the kernel
+			CLOSE //!< dilation then erosion, fills holes and gaps smaller than the kernel
+		};
+
+		//! Sets the filter applied to the thresholded image before labelling. Needs the bit mask, see enableBitMask().
+		//! Blobs refined at full resolution are not filtered. Morphology::NONE by default.
+		void setMorphology( Morphology morphology ) { mMorphology = morphology; }
+		//! Returns the filter applied to the thresholded image before labelling.
+		Morphology getMorphology() const { return mMorphology; }
+		//! Sets the radius in pixels of the square morphology kernel, at most 63. It is scaled down to the pyramid
+		//! level, where a radius rounded to 0 disables the filter. 1 by default.
+		void setMorphologyRadius( int radius ) { mMorphologyRadius = radius; }
+		//! Returns the radius in pixels of the square morphology kernel.
+		int getMorphologyRadius() const { return mMorphologyRadius; }
+
+		//! Enables or disables detection on a downscaled image. The level is the deepest one, up to the maximum
+		//! pyramid level, where the smallest blob allowed by the minimum area is still at least the pyramid
+		//! minimum blob size. Each level halves the image size. Disabled by default.
+		void enablePyramid( bool enablePyramid = true ) { mPyramidEnabled = enablePyramid; }
+		//! Returns whether detection on a downscaled image is enabled.
+		bool isPyramidEnabled() const { return mPyramidEnabled; }
+		//! Sets the deepest pyramid level. 3 by default.
+		void setMaxPyramidLevel( int maxPyramidLevel ) { mMaxPyramidLevel = maxPyramidLevel; }
+		//! Returns the deepest pyramid level.
+		int getMaxPyramidLevel() const { return mMaxPyramidLevel; }
+		//! Sets the size in pixels the smallest blob must keep on the chosen pyramid level. 8 by default.
+		void setPyramidMinBlobSize( float pyramidMinBlobSize ) { mPyramidMinBlobSize = pyramidMinBlobSize; }
+		//! Returns the size in pixels the smallest blob must keep on the chosen pyramid level.
+		float getPyramidMinBlobSize() const { return mPyramidMinBlobSize; }
+		//! If \a enableRefinement is true, the bounds, centroid and convex hull of blobs found on a pyramid level
+		//! are recalculated in a full resolution window around them. Enabled by default.
+		void enablePyramidRefinement( bool enableRefinement = true ) { mPyramidRefinementEnabled = enableRefinement; }
+		//! Returns whether blobs found on a pyramid level are refined at full resolution.
+		bool isPyramidRefinementEnabled() const { return mPyramidRefinementEnabled; }
+
+		//! Sets the number of threads a frame is processed with. Blur, threshold and, in DetectionMode::LABELS,
+		//! labelling run on horizontal stripes in parallel, and the components crossing the stripe seams are
+		//! merged. Within a BlobTrackerPool the pool's threads are used instead. 1 by default.
+		void setNumThreads( int numThreads ) { mNumThreads = numThreads; }
+		//! Returns the number of threads a frame is processed with.
+		int getNumThreads() const { return mNumThreads; }
+
+		//! Enables or disables the constant velocity motion model. Tracks are matched against the position
+		//! predicted from their velocity at the time of the frame. Disabled by default.
+		void enablePrediction( bool enablePrediction = true ) { mPredictionEnabled = enablePrediction; }
+		//! Returns whether tracks are matched against their predicted positions.
+		bool isPredictionEnabled() const { return mPredictionEnabled; }
+		//! Sets how often update() runs detection. In the \a detectionInterval - 1 calls between detections the
+		//! frame is ignored, the tracks are moved by their velocity and reported as extrapolated. Only moves
+		//! blobs with prediction enabled. 1 by default, every frame is detected.
+		void setDetectionInterval( int detectionInterval ) { mDetectionInterval = detectionInterval; }
+		//! Returns how often update() runs detection.
+		int getDetectionInterval() const { return mDetectionInterval; }
+
+		//! Enables or disables incremental processing. The frame is compared with the previous one in tiles,
+		//! and only the changed tiles and the blur margin around them are blurred and thresholded again.
+		//! If no tile changed, the blobs of the previous frame are kept and tracking is skipped. Disabled by default.
+		void enableIncremental( bool enableIncremental = true ) { mIncrementalEnabled = enableIncremental; }
+		//! Returns whether only the changed tiles of a frame are processed.
+		bool isIncrementalEnabled() const { return mIncrementalEnabled; }
+		//! Sets the size of the compared tiles in pixels of the pyramid level blobs are detected on. 32 by default.
+		void setTileSize( int tileSize ) { mTileSize = tileSize; }
+		//! Returns the size of the compared tiles.
+		int getTileSize() const { return mTileSize; }
+		//! Sets the mean absolute pixel difference a tile has to exceed to count as changed. Smaller differences
+		//! are ignored until they add up. 2 by default.
+		void setTileChangeThreshold( float tileChangeThreshold ) { mTileChangeThreshold = tileChangeThreshold; }
+		//! Returns the mean absolute pixel difference a tile has to exceed to count as changed.
+		float getTileChangeThreshold() const { return mTileChangeThreshold; }
+
+		//! Enables or disables background subtraction. The absolute difference of the input and a running
+		//! average background is blurred and thresholded instead of the input. Disabled by default.
+		void enableBackgroundSubtraction( bool enableBackgroundSubtraction = true )
+		{ mBackgroundSubtractionEnabled = enableBackgroundSubtraction; }
+		//! Returns whether the difference from the background is thresholded.
+		bool isBackgroundSubtractionEnabled() const { return mBackgroundSubtractionEnabled; }
+		//! Sets the weight of the new frame in the running average background, in [ 0, 0.5 ). 0.01 by default.
+		void setBackgroundLearningRate( float backgroundLearningRate ) { mBackgroundLearningRate = backgroundLearningRate; }
+		//! Returns the weight of the new frame in the running average background.
+		float getBackgroundLearningRate() const { return mBackgroundLearningRate; }
+		//! If \a enableFreeze is true the background is not learned where the difference is above the threshold,
+		//! so blobs standing still are not faded into the background. Disabled by default.
+		void enableBackgroundFreeze( bool enableFreeze = true ) { mBackgroundFreezeEnabled = enableFreeze; }
+		//! Returns whether the background is not learned under blobs.
+		bool isBackgroundFreezeEnabled() const { return mBackgroundFreezeEnabled; }
+
+		//! Sets the band of 16-bit depth input that is detected, in the units of the depth camera, usually
+		//! millimetres. Readings in [ \a depthNear, \a depthFar ] are white, the others black. 0 is never
+		//! in the band, depth cameras report it for no reading. [ 500, 1500 ] by default.
+		void setDepthRange( uint16_t depthNear, uint16_t depthFar ) { mDepthNear = depthNear; mDepthFar = depthFar; }
+		//! Returns the nearest depth detected.
+		uint16_t getDepthNear() const { return mDepthNear; }
+		//! Returns the farthest depth detected.
+		uint16_t getDepthFar() const { return mDepthFar; }
+
+		//! Enables or disables the pipeline variants compiled for the flip, threshold invert, bounds and convex hull
+		//! flags, picked for each frame from the options. The generic variants check the flags inside their loops,
+		//! for comparing the two. Enabled by default.
+		void enablePipelineSpecialization( bool enableSpecialization = true )
+		{ mPipelineSpecializationEnabled = enableSpecialization; }
+		//! Returns whether the pipeline variants compiled for the flags are used.
+		bool isPipelineSpecializationEnabled() const { return mPipelineSpecializationEnabled; }
 
 		bool mBoundsEnabled = true;
 		bool mConvexHullEnabled = false;
@@ -82,13 +284,69 @@ class BlobTracker
 		float mMaxArea = 0.45f;
 		ci::Rectf mNormalizedRegionOfInterest = ci::Rectf( 0.f, 0.f, 1.0f, 1.0f );
 		bool mBlankOutsideRoi = false;
+		bool mCropToRoi = false;
 		bool mThresholdInvertEnabled = false;
+		bool mAdaptiveThresholdEnabled = false;
+		int mAdaptiveThresholdBlockSize = 51;
+		int mAdaptiveThresholdOffset = 10;
+		bool mDebugImagesEnabled = true;
+		MatchMode mMatchMode = MatchMode::KNN;
+		float mMaxMatchDistance = 0.1f;
+		bool mMatchGridEnabled = false;
+		PreprocessMode mPreprocessMode = PreprocessMode::OPENCV;
+		DetectionMode mDetectionMode = DetectionMode::CONTOURS;
+		bool mBitMaskEnabled = false;
+		Morphology mMorphology = Morphology::NONE;
+		int mMorphologyRadius = 1;
+		bool mPyramidEnabled = false;
+		int mMaxPyramidLevel = 3;
+		float mPyramidMinBlobSize = 8.f;
+		bool mPyramidRefinementEnabled = true;
+		int mNumThreads = 1;
+		bool mPredictionEnabled = false;
+		int mDetectionInterval = 1;
+		bool mIncrementalEnabled = false;
+		int mTileSize = 32;
+		float mTileChangeThreshold = 2.f;
+		bool mBackgroundSubtractionEnabled = false;
+		float mBackgroundLearningRate = 0.01f;
+		bool mBackgroundFreezeEnabled = false;
+		uint16_t mDepthNear = 500;
+		uint16_t mDepthFar = 1500;
+		bool mPipelineSpecializationEnabled = true;
 	};
 
+	typedef std::shared_ptr< const Options > OptionsRef;
+
+	//! Creates a tracker with a copy of \a options, change them later with setOptions().
 	static BlobTrackerRef create( const Options &options = Options() )
 	{ return BlobTrackerRef( new BlobTracker( options ) ); }
 
-	void update( const ci::Channel8u &inputChannel );
+	~BlobTracker();
+
+	//! Processes \a inputChannel and emits the blob signals on the calling thread.
+	//! Once the buffers have grown to the largest frame, update() does not allocate with PreprocessMode::FUSED,
+	//! DetectionMode::LABELS, one thread and the debug images disabled. OpenCV's blur and findContours allocate in
+	//! the other modes, and the stripes of more threads allocate their pool tasks.
+	void update( const ci::Channel8u &inputChannel ) { update( InputFrame( inputChannel ) ); }
+	//! Processes the luma of \a inputSurface, converted while it is read, without a grayscale copy of the frame.
+	void update( const ci::Surface8u &inputSurface ) { update( InputFrame( inputSurface ) ); }
+	//! Processes the depth band of \a inputDepth set by Options::setDepthRange(), thresholded while it is read.
+	void update( const ci::Channel16u &inputDepth ) { update( InputFrame( inputDepth ) ); }
+	void update( const InputFrame &input );
+
+	//! Queues a copy of \a inputChannel for processing on the tracker's worker thread and returns immediately.
+	//! If the worker is still busy, the frame replaces any frame waiting before it, so under load only
+	//! the latest frame is processed. The options snapshot is captured with the frame. Do not mix with update().
+	void updateAsync( const ci::Channel8u &inputChannel ) { updateAsync( InputFrame( inputChannel ) ); }
+	//! Queues a copy of \a inputSurface, converted to luma on the worker thread.
+	void updateAsync( const ci::Surface8u &inputSurface ) { updateAsync( InputFrame( inputSurface ) ); }
+	//! Queues a copy of \a inputDepth, thresholded to the depth band on the worker thread.
+	void updateAsync( const ci::Channel16u &inputDepth ) { updateAsync( InputFrame( inputDepth ) ); }
+	void updateAsync( const InputFrame &input );
+	//! Tracks the latest frame finished by the worker thread and emits the blob signals on the calling thread.
+	//! Returns false if no new frame was finished since the last call.
+	bool dispatchEvents();
 
 	typedef void( BlobCallback )( BlobEvent );
 	typedef ci::signals::Signal< BlobCallback > BlobSignal;
@@ -105,6 +363,15 @@ class BlobTracker
 	ci::signals::Connection connectBlobsEnded( T fn, Y *inst )
 	{ return mBlobsEndedSig.connect( std::bind( fn, inst, std::placeholders::_1 ) ); }
 
+	typedef void( FrameCallback )( const FrameResultRef & );
+	typedef ci::signals::Signal< FrameCallback > FrameSignal;
+
+	//! Connects a callback receiving the began, moved and ended blobs of each tracked frame at once.
+	//! It is called before the per blob signals, which are emitted from the same frame result.
+	template< typename T, typename Y >
+	ci::signals::Connection connectFrame( T fn, Y *inst )
+	{ return mFrameSig.connect( std::bind( fn, inst, std::placeholders::_1 ) ); }
+
 	template< typename T, typename Y >
 	void connectBlobCallbacks( T fnBegan, T fnMoved, T fnEnded, Y *inst )
 	{
@@ -122,29 +389,234 @@ class BlobTracker
 	}
 	*/
 
-	void reset() { mBlobs.clear(); }
-
-	const Options &getOptions() const { return mOptions; }
-
+	void reset()
+	{
+		mBlobs.clear();
+		mBlobsViewDirty = true;
+		mTrackedResult = nullptr;
+	}
+	//! Forgets the background, the next detected frame becomes the background.
+	void resetBackground() { mBackground.reset(); }
+
+	//! Publishes a copy of \a options, each update takes the latest published options once for its frame. Can be
+	//! called from another thread than the one updating the tracker, without locking either, but only from one.
+	void setOptions( const Options &options ) { mOptionsCell.publish( std::make_shared< Options >( options ) ); }
+	//! Returns the options the last tracked frame was detected with, or the options the tracker was created with.
+	//! Only read on the thread calling update() or dispatchEvents().
+	const Options &getOptions() const { return *mOptions; }
+
+	//! Returns the images of the last processed frame. These are the tracker's own buffers, which are overwritten by the next frame.
+	//! The blurred and thresholded images have the size of the pyramid level the blobs were detected on.
 	cv::Mat getImageInput() const { return mInput; }
 	cv::Mat getImageBlurred() const { return mBlurred; }
-	cv::Mat getImageThresholded() const { return mThresholded; }
-
-	size_t getNumBlobs() const { return mBlobs.size(); }
-	const std::vector< BlobRef > & getBlobs() const { return mBlobs; }
+	//! A bit mask is unpacked by the first call after each frame, with the morphology applied.
+	cv::Mat getImageThresholded() const;
+
+	//! Returns the mean distance between the predicted and the detected positions of the tracks matched in the
+	//! last detected frame, relative to the normalization scale. 0 if prediction is disabled.
+	float getPredictionError() const { return mPredictionError; }
+
+	//! Returns the result of the last tracked frame, or nullptr before the first frame.
+	const FrameResultRef & getFrameResult() const { return mFrameResult; }
+
+	//! Returns the number of tiles compared in the last processed frame, 0 unless incremental processing is enabled.
+	size_t getNumTiles() const { return mNumTiles; }
+	//! Returns the number of tiles processed again in the last processed frame.
+	size_t getNumDirtyTiles() const { return mNumDirtyTiles; }
+
+	//! Returns the stage timings and counters accumulated since the creation of the tracker or resetStats().
+	//! Only read on the thread calling update() or dispatchEvents(). Empty if MNDL_BLOBTRACKER_STATS is 0.
+	const Stats & getStats() const { return mStats; }
+	void resetStats() { mStats.clear(); }
+
+	size_t getNumBlobs() const { return mBlobs.getSize(); }
+	//! Returns the tracked blobs. Tracks keep their slot in the pool for their lifetime, but removing a
+	//! track moves the last one into its index.
+	const BlobPool & getBlobPool() const { return mBlobs; }
+	//! Returns copies of the tracked blobs, built on the first call after each frame. The Blob objects
+	//! are reused unless held elsewhere. Prefer getBlobPool(), which needs no copies.
+	const std::vector< BlobRef > & getBlobs() const;
 
  protected:
 	BlobTracker( const Options &options );
 
-	const Options &mOptions;
+	SnapshotCell< Options > mOptionsCell;
+	OptionsRef mOptions; // of the last tracked frame, only written and read by the tracking thread
+
+	struct DetectionSetup;
+	typedef std::shared_ptr< const DetectionSetup > DetectionSetupRef;
+
+	//! Buffers of one detection pass. They are kept between frames and only reallocated when the frame size changes.
+	struct DetectionResult
+	{
+		cv::Mat mInput;
+		cv::Mat mForeground;
+		cv::Mat mBlurred;
+		cv::Mat mThresholded;
+		BitMask mBitMask; //!< replaces mThresholded if the bit mask is enabled
+		BitMask mMorphologyScratch; //!< after the first morphology pass
+		BitMask mMorphologyMask;
+		const BitMask *mLabelMask = nullptr; //!< the bit mask labelled, nullptr if mThresholded is
+		BitMorphology mMorphology;
+		cv::Mat mContourImage;
+		cv::Rect mCropArea;
+		std::vector< std::vector< cv::Point > > mContours;
+		std::vector< cv::Point > mHull;
+		BlobLabeler mLabeler;
+		cv::Mat mLevelInput;
+		cv::Mat mRefineBlurred;
+		cv::Mat mRefineThresholded;
+		BlobLabeler mRefineLabeler;
+		BlobPool mBlobs;
+		uint64_t mBlobsVersion = 0; //!< changes whenever the blobs are detected again
+		double mTimestamp = 0.0;
+		DetectionSetupRef mSetup; //!< of the frame detected into this result, its options are tracked with
+
+		void clearBlobs()
+		{
+			mBlobs.clear();
+			mBlobsVersion++;
+		}
+
+		// incremental processing
+		TileChangeDetector mTileChanges;
+		OptionsRef mTileOptions; //!< options of the last frame detected into this result
+		size_t mNumTiles = 0;
+		size_t mNumDirtyTiles = 0;
+
+		DetectionStats mStats; //!< of the last detection
+		//! Returns the number of images and blob columns reallocated since the last call.
+		uint32_t countReallocations();
+		const void *mBufferData[ 12 ] = {};
+
+		//! Returns the stage of \a mode from \a stages, created on first use.
+		static const PreprocessStageRef &getPreprocessStage( PreprocessStageRef *stages, Options::PreprocessMode mode );
+		PreprocessStageRef mPreprocessStages[ 2 ];
+
+		//! Scratch of a horizontal stripe processed in parallel.
+		struct Stripe
+		{
+			PreprocessStageRef mPreprocessStages[ 2 ];
+			BlobLabeler mLabeler;
+			BitMorphology mMorphology;
+		};
+		std::vector< Stripe > mStripes;
+	};
+
+	typedef void ( *ExtractBlobsFn )( const DetectionSetup &, const cv::Mat &, int, DetectionResult * );
 
-	std::vector< BlobRef > mBlobs;
-	void trackBlobs( std::vector< BlobRef > newBlobs );
-	int32_t findClosestBlobKnn( const std::vector< BlobRef > &newBlobs,
-			BlobRef track, int k, double thresh );
+	//! The options of a frame and the values derived from them for an input size. Immutable, shared by the
+	//! frames until the options or the input size change.
+	struct DetectionSetup
+	{
+		DetectionSetup( const OptionsRef &options, const cv::Size &inputSize );
+
+		OptionsRef mOptions;
+		cv::Size mInputSize;
+		ci::RectMapping mNormMapping; //!< input pixels to [ 0, Options::mNormalizationScale ]
+		ci::Rectf mRoi; //!< region of interest in normalized coordinates
+		cv::Rect mRoiRect; //!< region of interest in input pixels
+		int mLevel; //!< pyramid level the blobs are detected on
+		int mLevelScale;
+		cv::Size mLevelSize;
+		cv::Rect mArea; //!< processed area of the input
+		cv::Rect mInputArea; //!< area of the input the blur reads
+		cv::Rect mLevelArea; //!< processed area on the pyramid level
+		cv::Rect mLevelInputArea;
+		float mMinAreaLimit; //!< bounding box area limits in level pixels
+		float mMaxAreaLimit;
+		PreprocessStage::Params mPreprocessParams; //!< on the pyramid level
+		PreprocessStage::Params mRefineParams; //!< at full resolution
+		bool mBitMaskEnabled; //!< the thresholded image is a bit mask, only in DetectionMode::LABELS
+		Options::Morphology mMorphology; //!< Morphology::NONE without the bit mask
+		int mMorphologyRadius; //!< on the pyramid level
+		ExtractBlobsFn mExtractBlobs; //!< variant for the bounds and convex hull flags
+	};
+	//! Takes the latest options for a frame of \a inputSize. Returns the setup of the last frame unless the
+	//! options or the input size changed.
+	const DetectionSetupRef &acquireSetup( const cv::Size &inputSize );
+	DetectionSetupRef mSetup;
+
+	//! Runs blur, threshold and blob detection on \a input. Only uses \a result, so detections into different results can run concurrently.
+	//! The stripes of a frame run on \a pool if Options::mNumThreads is more than 1. \a background is updated
+	//! if background subtraction is enabled.
+	static void detectBlobs( const InputFrame &input, const DetectionSetup &setup, DetectionResult *result,
+							 BackgroundModel *background, WorkStealingPool *pool = nullptr );
+	//! Recalculates the \a bounds, \a centroid and hull \a points of a blob found on the pyramid level in a full
+	//! resolution window of \a src. Returns false if nothing was found in the window.
+	static bool refineBlob( const cv::Mat &src, const DetectionSetup &setup,
+							DetectionResult *result, cv::Rect *bounds, ci::vec2 *centroid, cv::Mat *points );
+
+	static const int kExtractBounds = 1;
+	static const int kExtractConvexHull = 2;
+	static const int kExtractGeneric = 4;
+	//! Extracts the blobs of the thresholded image of \a result into its blobs, joining the labels of the stripes
+	//! if \a numStripes is more than 1. Compiled for the kExtractBounds and kExtractConvexHull bits of \a kFlags,
+	//! or checking the options in the per blob loop for kExtractGeneric.
+	template< int kFlags >
+	static void extractBlobs( const DetectionSetup &setup, const cv::Mat &src, int numStripes, DetectionResult *result );
+	DetectionResult mDetection;
+	BackgroundModel mBackground; // shared by the results, locked by the detecting thread
+
+	//! Takes over the debug images of \a result and tracks its blobs, emitting the blob signals.
+	void applyResult( DetectionResult &result );
+	//! Adds the statistics of the detection of \a result to mStats.
+	void addDetectionStats( const DetectionResult &result );
+	Stats mStats;
+
+	//! Returns the pool for the stripes of \a options, or nullptr if a frame runs on a single thread.
+	//! Only used by the thread running detectBlobs(), which also works on the stripes.
+	WorkStealingPool *getStripePool( const Options &options );
+	WorkStealingPoolRef mStripePool;
+
+	BlobPool mBlobs;
+	void trackBlobs( BlobPool &newBlobs, double timestamp );
+	void trackBlobsKnn( BlobPool &newBlobs, const std::vector< ci::vec2 > &trackTargets );
+	void trackBlobsAssigned( BlobPool &newBlobs, const std::vector< ci::vec2 > &trackTargets );
+	//! Updates track \a i from new blob \a j and corrects its velocity by the error of the predicted \a target.
+	void updateTrack( size_t i, const BlobPool &newBlobs, size_t j, const ci::vec2 &target );
+	//! Moves the tracks by their velocity to \a timestamp and emits them as an extrapolated frame.
+	void extrapolateTracks( double timestamp );
+	int32_t findClosestBlobKnn( const BlobPool &newBlobs,
+			const ci::vec2 &trackPos, int k, double thresh );
+	//! Starts a track for every new blob not matched to one.
+	void startTracks( BlobPool &newBlobs );
+	std::vector< std::pair< size_t, double > > mKnnNeighbours;
+	SpatialGrid mBlobGrid; // over the new blobs if the match grid is enabled
+	std::vector< int32_t > mBlobTracks; // track index of each new blob, or -1
+	std::vector< int32_t > mTrackBlobs; // new blob index of each track, or -1
 	int32_t mIdCounter;
 
+	BlobMatcher mMatcher;
+
+	// motion model
+	std::vector< ci::vec2 > mTrackTargets;
+	uint64_t mNumUpdates = 0;
+	double mLastFrameTime = 0.0;
+	double mLastDetectionTime = 0.0;
+	float mDetectionTimeStep = 0.f;
+	float mPredictionErrorSum = 0.f;
+	size_t mNumPredictions = 0;
+	float mPredictionError = 0.f;
+
+	mutable std::vector< BlobRef > mBlobsView;
+	mutable bool mBlobsViewDirty = true;
+
+	const DetectionResult *mTrackedResult = nullptr;
+	uint64_t mTrackedBlobsVersion = 0;
+	size_t mNumTiles = 0;
+	size_t mNumDirtyTiles = 0;
+
+	//! Emits the frame signal and the per blob signals of \a frameResult.
+	void emitSignals( const FrameResultRef &frameResult );
+
+	std::shared_ptr< FrameResult > mNextFrameResult; // filled by the tracking functions
+	FrameResultRef mFrameResult;
+	FrameResultCache mFrameResultCache;
+	uint64_t mNumFrames = 0;
+
 	// signals
+	FrameSignal mFrameSig;
 	BlobSignal mBlobsBeganSig;
 	BlobSignal mBlobsMovedSig;
 	BlobSignal mBlobsEndedSig;
@@ -152,6 +624,29 @@ class BlobTracker
 	cv::Mat mInput;
 	cv::Mat mBlurred;
 	cv::Mat mThresholded;
+	BitMask mThresholdedBits; // of the last frame if the bit mask is enabled, unpacked by getImageThresholded()
+	mutable cv::Mat mUnpackedThresholded;
+	mutable bool mThresholdedUnpacked = false;
+
+	// async
+	struct AsyncFrame
+	{
+		InputFrame mInput;
+		DetectionSetupRef mSetup;
+		double mTimestamp = 0.0;
+	};
+
+	void startWorker();
+	void stopWorker();
+	void workerLoop();
+
+	std::thread mWorker;
+	FrameMailbox< AsyncFrame > mMailbox;
+	AsyncFrame mPostFrame; // owned by the caller thread
+	AsyncFrame mWorkerFrame; // owned by the worker thread
+	TripleBuffer< DetectionResult > mResults;
+
+	friend class BlobTrackerPool;
 };
 
 } } // namespace mndl::blobtracker
@@ -0,0 +1,121 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "cinder/Channel.h"
+
+#include "CinderOpenCV.h"
+
+#include "mndl/blobtracker/BlobTracker.h"
+#include "mndl/blobtracker/WorkStealingPool.h"
+
+namespace mndl { namespace blobtracker {
+
+typedef std::shared_ptr< class BlobTrackerPool > BlobTrackerPoolRef;
+
+//! Tracks several camera streams with one BlobTracker each, running their detection on a shared
+//! work-stealing thread pool. Frames of the same stream can be detected concurrently, so a busy
+//! stream uses the cores the others leave idle. Finished frames are tracked in frame order per
+//! stream on the thread calling dispatchEvents(), which emits the signals of the stream's tracker.
+class BlobTrackerPool
+{
+ public:
+	//! Creates a pool of \a numThreads workers, or one per hardware thread if \a numThreads is 0.
+	//! At most \a maxFramesInFlight frames per stream are queued or detected at the same time.
+	static BlobTrackerPoolRef create( size_t numThreads = 0, size_t maxFramesInFlight = 2 )
+	{ return BlobTrackerPoolRef( new BlobTrackerPool( numThreads, maxFramesInFlight ) ); }
+
+	~BlobTrackerPool();
+
+	//! Adds a stream tracked with \a options and returns its id. The options are copied like in
+	//! BlobTracker::create(), change them with setOptions() of the stream's tracker, each frame captures the latest.
+	//! Add the streams before the first update().
+	size_t addStream( const BlobTracker::Options &options = BlobTracker::Options() );
+	size_t getNumStreams() const { return mStreams.size(); }
+	//! Returns the tracker of stream \a streamId, for connecting its signals and reading its blobs.
+	//! Its update functions must not be called.
+	const BlobTrackerRef &getTracker( size_t streamId ) const { return mStreams[ streamId ]->mTracker; }
+
+	//! Queues a copy of \a inputChannel for detection on stream \a streamId and returns immediately.
+	//! If the stream has maxFramesInFlight frames queued or being detected, the latest frame still waiting
+	//! is replaced. Returns false if the frame was dropped because all frames of the stream are being detected.
+	//! Can be called from other threads than dispatchEvents(), the updates of a stream are serialized by its lock
+	//! and each frame is tracked with the options it was detected with.
+	bool update( size_t streamId, const ci::Channel8u &inputChannel )
+	{ return update( streamId, InputFrame( inputChannel ) ); }
+	//! Queues a copy of \a inputSurface, converted to luma during detection, see update().
+	bool update( size_t streamId, const ci::Surface8u &inputSurface )
+	{ return update( streamId, InputFrame( inputSurface ) ); }
+	//! Queues a copy of \a inputDepth, thresholded to the depth band during detection, see update().
+	bool update( size_t streamId, const ci::Channel16u &inputDepth )
+	{ return update( streamId, InputFrame( inputDepth ) ); }
+	bool update( size_t streamId, const InputFrame &input );
+
+	//! Tracks the finished frames of all streams and emits the blob signals on the calling thread.
+	//! A frame is only tracked after the earlier frames of its stream. Returns the number of frames tracked.
+	size_t dispatchEvents();
+
+	//! Returns the number of frames of stream \a streamId dropped or replaced before detection.
+	uint64_t getNumDroppedFrames( size_t streamId ) const;
+
+	const WorkStealingPoolRef &getWorkStealingPool() const { return mPool; }
+
+ protected:
+	BlobTrackerPool( size_t numThreads, size_t maxFramesInFlight );
+
+	struct Slot
+	{
+		enum class State
+		{
+			FREE,
+			QUEUED,
+			RUNNING,
+			DONE,
+			APPLIED //!< held by the tracker's debug images until the next frame is applied
+		};
+
+		State mState = State::FREE;
+		uint64_t mSequence = 0;
+		InputFrame mInput;
+		BlobTracker::DetectionSetupRef mSetup;
+		BlobTracker::DetectionResult mResult;
+	};
+
+	struct Stream
+	{
+		BlobTrackerRef mTracker;
+		mutable std::mutex mMutex; // guards the slot states, sequence numbers and counters
+		std::vector< Slot > mSlots;
+		uint64_t mNextSequence = 0;
+		uint64_t mNumDroppedFrames = 0;
+	};
+
+	//! Detects the frame in slot \a slotIndex of \a stream, runs on \a pool.
+	static void detect( Stream *stream, size_t slotIndex, WorkStealingPool *pool );
+
+	size_t mMaxFramesInFlight;
+	std::vector< std::unique_ptr< Stream > > mStreams;
+	WorkStealingPoolRef mPool; // declared last, the workers are joined before the streams go away
+};
+
+} } // namespace mndl::blobtracker
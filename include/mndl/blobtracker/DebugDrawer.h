@@ -22,11 +22,18 @@
 #include "cinder/Function.h"
 #include "cinder/Vector.h"
 #include "cinder/gl/Texture.h"
+#include "cinder/gl/TextureFont.h"
+#include "cinder/gl/VboMesh.h"
 
 #include "BlobTracker.h"
+#include "DebugGeometry.h"
 
 namespace mndl { namespace blobtracker {
 
+typedef std::shared_ptr< class DebugDrawer > DebugDrawerRef;
+
+//! Draws the debug image of a tracker with its blobs. The texture and the vertex buffer are kept between
+//! frames and updated in place, the blob lines are built by DebugGeometry and drawn in one call.
 class DebugDrawer
 {
  public:
@@ -52,10 +59,35 @@ class DebugDrawer
 
 		DrawMode mDrawMode = DrawMode::THRESHOLDED;
 		bool mDrawProportionalFit = false;
+		bool mDrawIds = true; //!< the ids are drawn with a texture font in one batch
+		DebugGeometry::Style mStyle;
 	};
 
-	static void draw( const BlobTrackerRef &blobTracker, const ci::Area &bounds, const Options &options = Options() );
+	static DebugDrawerRef create() { return DebugDrawerRef( new DebugDrawer() ); }
+
+	//! Draws the debug image of \a blobTracker selected by the draw mode and its blobs into \a bounds.
+	void draw( const BlobTrackerRef &blobTracker, const ci::Area &bounds, const Options &options = Options() );
+
+	//! Returns the lines of the last draw.
+	const DebugGeometry & getGeometry() const { return mGeometry; }
+
+ protected:
+	DebugDrawer() {}
+
+	//! Uploads \a img to the texture, recreating it only if the size changed.
+	void updateTexture( const cv::Mat &img );
+	//! Uploads and draws the lines of mGeometry.
+	void drawGeometry();
+	void drawIds( const BlobPool &blobs, const ci::Rectf &outputArea, float normalizationScale,
+				  const ci::ColorA &color );
+
+	ci::gl::TextureRef mTexture;
+	DebugGeometry mGeometry;
+	ci::gl::VboRef mVbo;
+	ci::gl::VboMeshRef mVboMesh;
+	size_t mVboCapacity = 0; // in vertices
+	ci::gl::TextureFontRef mFont;
+	std::vector< std::pair< ci::Font::Glyph, ci::vec2 > > mGlyphs;
 };
 
 } } // namespace mndl::blobtracker
-
@@ -0,0 +1,85 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "cinder/Color.h"
+#include "cinder/Rect.h"
+#include "cinder/Vector.h"
+
+#include "mndl/blobtracker/BlobPool.h"
+
+namespace mndl { namespace blobtracker {
+
+//! Builds the debug lines of the tracked blobs on the CPU, without a GL context. The region of interest,
+//! the blob bounds, convex hulls and centroid markers end up in one list of line vertices, drawn by
+//! DebugDrawer with a single draw call. The buffer is reused, so rebuilding does not allocate once it
+//! has grown to the largest frame.
+class DebugGeometry
+{
+ public:
+	//! Line vertex, every two consecutive vertices are a line segment.
+	struct Vertex
+	{
+		ci::vec2 mPos;
+		ci::ColorA mColor;
+	};
+
+	struct Style
+	{
+		Style() {}
+
+		ci::ColorA mRoiColor = ci::ColorA( 0.f, 1.f, 0.f, .8f );
+		ci::ColorA mBoundsColor = ci::ColorA( 1.f, 1.f, 0.f, .5f );
+		ci::ColorA mHullColor = ci::ColorA( 1.f, 0.f, 1.f, .5f );
+		ci::ColorA mMarkerColor = ci::ColorA( 1.f, 0.f, 0.f, .9f );
+		float mMarkerSize = 3.f; //!< half the size of the centroid cross in output pixels
+	};
+
+	//! Replaces the lines with the region of interest \a normalizedRoi and the blobs of \a blobs. Blob
+	//! coordinates in [ 0, \a normalizationScale ] are mapped to \a outputArea. Bounds and hulls are only
+	//! added if \a boundsEnabled and \a convexHullEnabled are true, like the tracker calculates them.
+	void build( const BlobPool &blobs, const ci::Rectf &normalizedRoi, float normalizationScale,
+				bool boundsEnabled, bool convexHullEnabled, const ci::Rectf &outputArea,
+				const Style &style = Style() );
+
+	void clear() { mVertices.clear(); }
+
+	//! Adds the outline of \a rect in output coordinates.
+	void addRect( const ci::Rectf &rect, const ci::ColorA &color );
+	//! Adds the \a numPoints points at \a points as a polyline, closed if \a closed is true.
+	void addPolyLine( const ci::vec2 *points, size_t numPoints, bool closed, const ci::ColorA &color );
+	//! Adds a cross of half size \a size centered at \a pos.
+	void addMarker( const ci::vec2 &pos, float size, const ci::ColorA &color );
+
+	const std::vector< Vertex > & getVertices() const { return mVertices; }
+	size_t getNumVertices() const { return mVertices.size(); }
+
+ protected:
+	void addLine( const ci::vec2 &a, const ci::vec2 &b, const ci::ColorA &color )
+	{
+		mVertices.push_back( Vertex{ a, color } );
+		mVertices.push_back( Vertex{ b, color } );
+	}
+
+	std::vector< Vertex > mVertices;
+	std::vector< ci::vec2 > mPoints; // mapped hull points
+};
+
+} } // namespace mndl::blobtracker
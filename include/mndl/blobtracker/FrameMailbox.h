@@ -0,0 +1,93 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+
+namespace mndl { namespace blobtracker {
+
+//! Single slot mailbox between a producer and a consumer thread where the latest item wins.
+//! Items are swapped in and out instead of copied, so their buffers circulate between the
+//! producer, the slot and the consumer without reallocation.
+template< typename T >
+class FrameMailbox
+{
+ public:
+	//! Swaps \a item into the mailbox. An item still waiting is dropped and handed back in \a item
+	//! for reuse. Returns true if a waiting item was dropped.
+	bool post( T &item )
+	{
+		bool dropped;
+		{
+			std::lock_guard< std::mutex > lock( mMutex );
+			std::swap( mItem, item );
+			dropped = mFull;
+			mFull = true;
+		}
+		mCondition.notify_one();
+		return dropped;
+	}
+
+	//! Takes the waiting item into \a item without blocking. Returns false if the mailbox is empty.
+	bool tryTake( T &item )
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		if ( ! mFull )
+		{
+			return false;
+		}
+		std::swap( mItem, item );
+		mFull = false;
+		return true;
+	}
+
+	//! Blocks until an item arrives and takes it into \a item. Returns false if the mailbox was closed.
+	bool waitTake( T &item )
+	{
+		std::unique_lock< std::mutex > lock( mMutex );
+		mCondition.wait( lock, [ this ] { return mFull || mClosed; } );
+		if ( ! mFull )
+		{
+			return false;
+		}
+		std::swap( mItem, item );
+		mFull = false;
+		return true;
+	}
+
+	//! Wakes up and releases all waiting consumers.
+	void close()
+	{
+		{
+			std::lock_guard< std::mutex > lock( mMutex );
+			mClosed = true;
+		}
+		mCondition.notify_all();
+	}
+
+ private:
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	T mItem;
+	bool mFull = false;
+	bool mClosed = false;
+};
+
+} } // namespace mndl::blobtracker
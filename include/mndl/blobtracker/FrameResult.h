@@ -0,0 +1,180 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "cinder/Rect.h"
+#include "cinder/Vector.h"
+
+#include "mndl/blobtracker/BlobPool.h"
+
+namespace mndl { namespace blobtracker {
+
+//! Returns true if \a ref is the only reference to its object, which can then be reused. Unlike the deprecated
+//! shared_ptr::unique(), the acquire fence orders the reuse after the accesses of the threads that released
+//! their references.
+template< typename T >
+bool isSoleOwner( const std::shared_ptr< T > &ref )
+{
+	if ( ref.use_count() != 1 )
+	{
+		return false;
+	}
+	std::atomic_thread_fence( std::memory_order_acquire );
+	return true;
+}
+
+//! Read-only view of \a size consecutive elements starting at \a data.
+template< typename T >
+class Span
+{
+ public:
+	Span() : mData( nullptr ), mSize( 0 ) {}
+	Span( const T *data, size_t size ) : mData( data ), mSize( size ) {}
+
+	const T *begin() const { return mData; }
+	const T *end() const { return mData + mSize; }
+	size_t size() const { return mSize; }
+	bool empty() const { return mSize == 0; }
+	const T & operator[]( size_t i ) const { return mData[ i ]; }
+
+ private:
+	const T *mData;
+	size_t mSize;
+};
+
+typedef std::shared_ptr< const class FrameResult > FrameResultRef;
+
+//! The blob changes of one tracked frame. Frame results are immutable once published, so they can be
+//! held and read from any thread. The tracker reuses the objects nobody holds anymore, see FrameResultCache.
+class FrameResult
+{
+ public:
+	struct BlobState
+	{
+		BlobHandle mHandle; //!< handle in BlobTracker::getBlobPool(), invalid for ended blobs
+		int32_t mId;
+		ci::vec2 mPos; //!< centroid normalized to the image resolution
+		ci::vec2 mPrevPos;
+		ci::Rectf mBounds;
+		uint32_t mFirstHullPoint; //!< index of the first convex hull point in getHullPoints()
+		uint32_t mNumHullPoints;
+		bool mExtrapolated; //!< true if the position was predicted by the motion model, not detected
+	};
+
+	//! Returns the number of the frame, counted from 0 by the tracker.
+	uint64_t getFrameNumber() const { return mFrameNumber; }
+	//! Returns the time in seconds the frame was passed to the tracker, see getCurrentTime().
+	double getTimestamp() const { return mTimestamp; }
+	//! Returns true if detection was skipped for the frame and the moved blobs were extrapolated,
+	//! see BlobTracker::Options::setDetectionInterval().
+	bool isExtrapolated() const { return mExtrapolated; }
+
+	//! Returns the blobs that started a track in this frame.
+	Span< BlobState > getBegan() const { return Span< BlobState >( mBegan.data(), mBegan.size() ); }
+	//! Returns the tracked blobs that moved in this frame.
+	Span< BlobState > getMoved() const { return Span< BlobState >( mMoved.data(), mMoved.size() ); }
+	//! Returns the blobs whose track ended in this frame, with their last known state.
+	Span< BlobState > getEnded() const { return Span< BlobState >( mEnded.data(), mEnded.size() ); }
+
+	//! Returns the convex hull points of all blobs of the frame.
+	const std::vector< ci::vec2 > & getHullPoints() const { return mHullPoints; }
+	//! Returns the convex hull points of \a blob, empty if the convex hull is disabled.
+	Span< ci::vec2 > getHullPoints( const BlobState &blob ) const
+	{
+		return Span< ci::vec2 >( mHullPoints.data() + blob.mFirstHullPoint, blob.mNumHullPoints );
+	}
+
+	//! Returns the steady clock time in seconds, the clock of the timestamps.
+	static double getCurrentTime()
+	{
+		return std::chrono::duration< double >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+	}
+
+ protected:
+	void clear()
+	{
+		mBegan.clear();
+		mMoved.clear();
+		mEnded.clear();
+		mHullPoints.clear();
+		mExtrapolated = false;
+	}
+
+	//! Appends the state of the blob at \a index of \a pool to \a blobs.
+	void append( std::vector< BlobState > &blobs, const BlobPool &pool, size_t index )
+	{
+		const std::vector< ci::vec2 > &hull = pool.mConvexHulls[ index ].getPoints();
+		BlobState state = { pool.getHandle( index ), pool.mIds[ index ], pool.mPositions[ index ],
+							pool.mPrevPositions[ index ], pool.mBounds[ index ],
+							uint32_t( mHullPoints.size() ), uint32_t( hull.size() ), mExtrapolated };
+		blobs.push_back( state );
+		mHullPoints.insert( mHullPoints.end(), hull.begin(), hull.end() );
+	}
+
+	uint64_t mFrameNumber = 0;
+	double mTimestamp = 0.0;
+	bool mExtrapolated = false;
+	std::vector< BlobState > mBegan;
+	std::vector< BlobState > mMoved;
+	std::vector< BlobState > mEnded;
+	std::vector< ci::vec2 > mHullPoints;
+
+	friend class BlobTracker;
+	friend class TrackPlayer;
+	friend class FrameResultCache;
+};
+
+//! Recycles the frame results nobody else holds anymore. At most \a maxSize results are kept, the ones allocated
+//! beyond while the application holds on to the others are freed when it drops them.
+class FrameResultCache
+{
+ public:
+	explicit FrameResultCache( size_t maxSize = 8 ) : mMaxSize( maxSize ) {}
+
+	//! Returns a cleared frame result nobody else holds.
+	std::shared_ptr< FrameResult > acquire()
+	{
+		for ( std::shared_ptr< FrameResult > &frameResult : mFrameResults )
+		{
+			if ( isSoleOwner( frameResult ) )
+			{
+				frameResult->clear();
+				return frameResult;
+			}
+		}
+
+		std::shared_ptr< FrameResult > frameResult( new FrameResult() );
+		if ( mFrameResults.size() < mMaxSize )
+		{
+			mFrameResults.push_back( frameResult );
+		}
+		return frameResult;
+	}
+
+ private:
+	size_t mMaxSize;
+	std::vector< std::shared_ptr< FrameResult > > mFrameResults;
+};
+
+} } // namespace mndl::blobtracker
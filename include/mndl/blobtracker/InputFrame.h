@@ -0,0 +1,69 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#include "cinder/Channel.h"
+#include "cinder/Surface.h"
+
+#include "CinderOpenCV.h"
+
+namespace mndl { namespace blobtracker {
+
+//! References the pixels of an input frame in one of the formats the tracker reads. The frame is converted
+//! to 8-bit grayscale by the first pass over it, which only visits the processed area.
+struct InputFrame
+{
+	enum class Format
+	{
+		GRAY, //!< 8-bit single channel, read as it is
+		COLOR, //!< 8-bit RGB or RGBA in any channel order, converted to luma
+		DEPTH //!< 16-bit depth, the pixels inside the depth range are white, the others black
+	};
+
+	InputFrame() {}
+	explicit InputFrame( const ci::Channel8u &channel );
+	explicit InputFrame( const ci::Surface8u &surface );
+	explicit InputFrame( const ci::Channel16u &channel );
+
+	//! Copies the pixels to \a frame, reusing its buffer.
+	void copyTo( InputFrame &frame ) const;
+
+	//! Writes \a area of the frame as 8-bit grayscale to the same area of \a dst, which has the size of the frame.
+	//! Mirrors the frame horizontally if \a flip is true. Depth readings in [ \a depthNear, \a depthFar ] become
+	//! 255, the others and 0, which depth cameras report for no reading, become 0. The rows are converted by a
+	//! variant compiled for the flip and the pixel layout, or by the generic one if \a specialized is false.
+	void convert( const cv::Rect &area, bool flip, uint16_t depthNear, uint16_t depthFar, cv::Mat &dst,
+				  bool specialized = true ) const;
+
+	int getWidth() const { return mData.cols; }
+	int getHeight() const { return mData.rows; }
+	cv::Size getSize() const { return mData.size(); }
+
+	//! The pixels, CV_8UC1, CV_8UC3 or CV_8UC4 for colour, CV_16UC1 for depth. A channel of an interleaved
+	//! image has one element per channel, the first one is read.
+	cv::Mat mData;
+	Format mFormat = Format::GRAY;
+	//! Offsets of the colour components inside a COLOR pixel.
+	int mRedOffset = 0;
+	int mGreenOffset = 1;
+	int mBlueOffset = 2;
+};
+
+} } // namespace mndl::blobtracker
@@ -0,0 +1,129 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "CinderOpenCV.h"
+
+#include "mndl/blobtracker/BitMask.h"
+
+namespace mndl { namespace blobtracker {
+
+typedef std::shared_ptr< class PreprocessStage > PreprocessStageRef;
+
+//! Turns the input image into the binary blob mask. Stages keep scratch buffers, an instance
+//! must not be used by more than one thread at a time.
+class PreprocessStage
+{
+ public:
+	struct Params
+	{
+		int mBlurSize = 10;
+		int mThreshold = 150;
+		bool mThresholdInvertEnabled = false;
+		//! Compares the blurred pixels with the mean of the input over \a mAdaptiveBlockSize instead of \a mThreshold.
+		bool mAdaptiveThresholdEnabled = false;
+		int mAdaptiveBlockSize = 51;
+		int mAdaptiveOffset = 10;
+		//! Runs the kernels compiled for the flags above instead of the generic ones checking them.
+		bool mSpecializationEnabled = true;
+
+		//! Returns the size of the largest kernel reading the pixels around each output pixel.
+		int getKernelSize() const
+		{
+			return mAdaptiveThresholdEnabled ? std::max( mBlurSize, mAdaptiveBlockSize ) : mBlurSize;
+		}
+	};
+
+	virtual ~PreprocessStage() {}
+
+	//! Blurs and thresholds \a area of the 8-bit \a input into the same area of \a blurred and \a thresholded.
+	//! Both outputs are allocated by the caller with the size of \a input. Pixels outside \a area are read
+	//! by the blur kernel, the image borders are reflected like in cv::blur. \a blurred is only
+	//! guaranteed to be written if \a keepBlurred is true.
+	virtual void process( const cv::Mat &input, const cv::Rect &area, const Params &params,
+						  cv::Mat &blurred, cv::Mat &thresholded, bool keepBlurred ) = 0;
+	//! Like process(), but writes the mask into the same area of the bit \a mask, which must have the size of
+	//! \a input. The default thresholds into a scratch byte mask and packs it.
+	virtual void processBits( const cv::Mat &input, const cv::Rect &area, const Params &params,
+							  cv::Mat &blurred, BitMask &mask, bool keepBlurred );
+
+ protected:
+	cv::Mat mScratchMask;
+};
+
+//! Separate cv::blur and cv::threshold passes. The adaptive threshold blurs the input again with the block size
+//! and compares the two blurred images.
+class OpenCvPreprocessStage : public PreprocessStage
+{
+ public:
+	static PreprocessStageRef create() { return PreprocessStageRef( new OpenCvPreprocessStage() ); }
+
+	void process( const cv::Mat &input, const cv::Rect &area, const Params &params,
+				  cv::Mat &blurred, cv::Mat &thresholded, bool keepBlurred ) override;
+
+ protected:
+	cv::Mat mMean;
+	cv::Mat mDifference;
+};
+
+//! Single pass box blur and threshold. The blur is separable running sums, so its cost does not
+//! depend on the blur size, and the mask is written directly without an intermediate blurred image.
+//! The column sums and the threshold are vectorized with AVX2 or SSE2 when the compiler targets them.
+//! Rounding follows OpenCV's normalized 8-bit box filter, so the mask matches cv::blur followed by cv::threshold
+//! for blur and block sizes other than powers of two. Newer OpenCV versions shift the sums of those kernels instead
+//! of dividing them, so the blurred pixels and the local means can differ by one from them, and so can the mask
+//! where they are next to the threshold.
+//! The column pass is compiled for each combination of inverting, keeping the blurred image and the rounding,
+//! and picked once per call.
+//! The adaptive threshold takes the blurred pixels and the local means from the rows of an integral image
+//! computed in the same pass, so its cost does not depend on the block size either.
+//! The bit mask is packed from each thresholded row while it is still in the cache, no byte mask is written.
+class FusedPreprocessStage : public PreprocessStage
+{
+ public:
+	static PreprocessStageRef create() { return PreprocessStageRef( new FusedPreprocessStage() ); }
+
+	void process( const cv::Mat &input, const cv::Rect &area, const Params &params,
+				  cv::Mat &blurred, cv::Mat &thresholded, bool keepBlurred ) override;
+	void processBits( const cv::Mat &input, const cv::Rect &area, const Params &params,
+					  cv::Mat &blurred, BitMask &mask, bool keepBlurred ) override;
+
+ protected:
+	//! Writes the mask to \a thresholded if it is not null, otherwise packs it into \a mask.
+	void processArea( const cv::Mat &input, const cv::Rect &area, const Params &params,
+					  cv::Mat &blurred, cv::Mat *thresholded, BitMask *mask, bool keepBlurred );
+	//! Copies \a width pixels of input row \a y from column \a x0 to mPaddedRow, reflecting the columns outside
+	//! the image.
+	const uint8_t * padRow( const cv::Mat &input, int y, int x0, int width );
+	//! Computes the horizontal box sums of input row \a y for the columns of \a area into \a dst.
+	void sumRow( const cv::Mat &input, int y, const cv::Rect &area, int kernelSize, uint32_t *dst );
+	void processAdaptive( const cv::Mat &input, const cv::Rect &area, const Params &params,
+						  cv::Mat &blurred, cv::Mat *thresholded, BitMask *mask, bool keepBlurred );
+
+	std::vector< uint8_t > mPaddedRow;
+	std::vector< uint32_t > mRowSums; // ring of kernelSize + 1 rows of horizontal sums
+	std::vector< uint32_t > mColumnSums;
+	std::vector< uint32_t > mIntegralRows; // ring of the integral image rows the adaptive kernels span
+	std::vector< uint8_t > mMaskRow; // thresholded row before packing
+};
+
+} } // namespace mndl::blobtracker
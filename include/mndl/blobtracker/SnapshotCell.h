@@ -0,0 +1,105 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace mndl { namespace blobtracker {
+
+//! Lock-free cell handing immutable snapshots of a T from one writer thread to one reader thread.
+//! The writer publishes a snapshot with an atomic pointer swap, the reader takes a reference to the
+//! latest one without waiting for the writer. The cells the swap replaced are reclaimed by the writer
+//! once the reader is not in the middle of taking them, which the reader announces with a hazard pointer.
+template< typename T >
+class SnapshotCell
+{
+ public:
+	typedef std::shared_ptr< const T > Ref;
+
+	explicit SnapshotCell( Ref snapshot ) :
+		mLatest( new Node{ std::move( snapshot ) } )
+	{}
+
+	~SnapshotCell()
+	{
+		for ( Node *node : mRetired )
+		{
+			delete node;
+		}
+		delete mLatest.load( std::memory_order_relaxed );
+	}
+
+	SnapshotCell( const SnapshotCell & ) = delete;
+	SnapshotCell & operator=( const SnapshotCell & ) = delete;
+
+	//! Replaces the latest snapshot with \a snapshot. Only called by the writer thread.
+	void publish( Ref snapshot )
+	{
+		mRetired.push_back( mLatest.exchange( new Node{ std::move( snapshot ) } ) );
+
+		// the reader may still be copying the snapshot of the cell it announced
+		const Node *hazard = mHazard.load();
+		size_t numKept = 0;
+		for ( Node *node : mRetired )
+		{
+			if ( node == hazard )
+			{
+				mRetired[ numKept++ ] = node;
+			}
+			else
+			{
+				delete node;
+			}
+		}
+		mRetired.resize( numKept );
+	}
+
+	//! Returns the latest snapshot. Only called by the reader thread.
+	Ref load()
+	{
+		// the cell is announced before it is checked to be still the latest, so a writer retiring it
+		// afterwards sees the announcement and keeps it
+		Node *node = mLatest.load();
+		Node *announced;
+		do
+		{
+			announced = node;
+			mHazard.store( announced );
+			node = mLatest.load();
+		} while ( node != announced );
+
+		Ref snapshot = node->mSnapshot;
+		mHazard.store( nullptr, std::memory_order_release );
+		return snapshot;
+	}
+
+ private:
+	struct Node
+	{
+		Ref mSnapshot;
+	};
+
+	std::atomic< Node * > mLatest;
+	std::atomic< const Node * > mHazard { nullptr };
+	std::vector< Node * > mRetired; // owned by the writer
+};
+
+} } // namespace mndl::blobtracker
@@ -0,0 +1,174 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "cinder/Vector.h"
+
+namespace mndl { namespace blobtracker {
+
+//! Uniform grid over a set of points, for finding the points near a position without comparing all of them.
+//! Building sorts the points into square cells by counting, in linear time, with the cell size chosen
+//! for a few points per cell. The buffers are reused, so rebuilding does not allocate once they have grown
+//! to the largest point set.
+class SpatialGrid
+{
+ public:
+	//! Sorts \a points into cells of about \a pointsPerCell points on average. The points are copied.
+	void build( const std::vector< ci::vec2 > &points, float pointsPerCell = 2.f );
+
+	//! Returns the index of the point closest to \a pos within \a maxDistance, the lower index of equally close
+	//! ones, or -1 if there is none. Searches the rings of cells around \a pos outwards, until the ring is farther
+	//! than the closest point found.
+	int32_t findNearest( const ci::vec2 &pos, float maxDistance ) const;
+	//! Replaces \a nearest with the squared distances and the indices of the \a k points closest to \a pos within
+	//! \a maxDistance, closest first, the lower index of equally close ones first. Searches the rings like
+	//! findNearest(), until the ring is farther than the k-th closest point found, so the work depends on \a k
+	//! and not on how many points are within \a maxDistance.
+	void findNearest( const ci::vec2 &pos, float maxDistance, size_t k,
+					  std::vector< std::pair< float, uint32_t > > *nearest ) const;
+
+	//! Calls \a fn with the index and the squared distance of each point within \a radius of \a pos.
+	template< typename Fn >
+	void forEachInRadius( const ci::vec2 &pos, float radius, Fn fn ) const
+	{
+		if ( mIndices.empty() )
+		{
+			return;
+		}
+		int x1, y1, x2, y2;
+		getCellRange( pos, radius, &x1, &y1, &x2, &y2 );
+		const float radiusSq = radius * radius;
+		for ( int y = y1; y <= y2; y++ )
+		{
+			for ( int x = x1; x <= x2; x++ )
+			{
+				const size_t cell = size_t( y ) * mNumCols + x;
+				for ( uint32_t k = mCellStarts[ cell ]; k < mCellStarts[ cell + 1 ]; k++ )
+				{
+					const ci::vec2 d = mPoints[ k ] - pos;
+					const float distSq = d.x * d.x + d.y * d.y;
+					if ( distSq <= radiusSq )
+					{
+						fn( mIndices[ k ], distSq );
+					}
+				}
+			}
+		}
+	}
+
+	size_t getNumPoints() const { return mIndices.size(); }
+	float getCellSize() const { return mCellSize; }
+
+ protected:
+	//! Returns the cell of offset \a v from the origin along an axis of \a numCells cells, -1 or \a numCells if outside.
+	int toCell( float v, int numCells ) const
+	{
+		// clamped before the conversion, \a v may be far outside
+		v = std::floor( v * mInvCellSize );
+		return int( std::min( std::max( v, -1.f ), float( numCells ) ) );
+	}
+	//! Returns the cells overlapping the square of half size \a radius around \a pos, clamped to the grid.
+	//! The range is empty, x1 > x2 or y1 > y2, if the square is outside.
+	void getCellRange( const ci::vec2 &pos, float radius, int *x1, int *y1, int *x2, int *y2 ) const;
+
+	//! Calls \a visit with the squared distance and the index of each point in the rings of cells around the cell
+	//! closest to \a pos, ring by ring outwards. Stops before a ring whose points are all farther than the square
+	//! root of what \a maxDistSq returns.
+	template< typename VisitFn, typename MaxFn >
+	void searchRings( const ci::vec2 &pos, VisitFn visit, MaxFn maxDistSq ) const
+	{
+		// the rings are around the closest cell, pos may be outside the grid
+		const int cx = std::min( std::max( toCell( pos.x - mOrigin.x, mNumCols ), 0 ), mNumCols - 1 );
+		const int cy = std::min( std::max( toCell( pos.y - mOrigin.y, mNumRows ), 0 ), mNumRows - 1 );
+		const ci::vec2 cellMin = mOrigin + ci::vec2( float( cx ), float( cy ) ) * mCellSize;
+		const ci::vec2 outside( std::max( std::max( cellMin.x - pos.x, pos.x - cellMin.x - mCellSize ), 0.f ),
+								std::max( std::max( cellMin.y - pos.y, pos.y - cellMin.y - mCellSize ), 0.f ) );
+		const float cellDistance = std::sqrt( outside.x * outside.x + outside.y * outside.y );
+		const int maxRing = std::max( std::max( cx, mNumCols - 1 - cx ), std::max( cy, mNumRows - 1 - cy ) );
+
+		auto visitCell = [ & ]( int x, int y )
+		{
+			const size_t cell = size_t( y ) * mNumCols + x;
+			for ( uint32_t k = mCellStarts[ cell ]; k < mCellStarts[ cell + 1 ]; k++ )
+			{
+				const ci::vec2 d = mPoints[ k ] - pos;
+				visit( d.x * d.x + d.y * d.y, mIndices[ k ] );
+			}
+		};
+
+		for ( int r = 0; r <= maxRing; r++ )
+		{
+			// the points of ring r are at least r - 1 cells away, and not closer than the center cell
+			const float ringDistance = std::max( float( r - 1 ) * mCellSize, cellDistance );
+			if ( ringDistance * ringDistance > maxDistSq() )
+			{
+				break;
+			}
+			if ( r == 0 )
+			{
+				visitCell( cx, cy );
+				continue;
+			}
+
+			const int x1 = std::max( cx - r, 0 );
+			const int x2 = std::min( cx + r, mNumCols - 1 );
+			const int y1 = std::max( cy - r + 1, 0 );
+			const int y2 = std::min( cy + r - 1, mNumRows - 1 );
+			for ( int x = x1; x <= x2; x++ )
+			{
+				if ( cy - r >= 0 )
+				{
+					visitCell( x, cy - r );
+				}
+				if ( cy + r < mNumRows )
+				{
+					visitCell( x, cy + r );
+				}
+			}
+			for ( int y = y1; y <= y2; y++ )
+			{
+				if ( cx - r >= 0 )
+				{
+					visitCell( cx - r, y );
+				}
+				if ( cx + r < mNumCols )
+				{
+					visitCell( cx + r, y );
+				}
+			}
+		}
+	}
+
+	ci::vec2 mOrigin;
+	float mCellSize = 1.f;
+	float mInvCellSize = 1.f;
+	int mNumCols = 0;
+	int mNumRows = 0;
+	std::vector< uint32_t > mCellStarts; // mNumCols * mNumRows + 1 offsets into the sorted points
+	std::vector< ci::vec2 > mPoints; // sorted by cell
+	std::vector< uint32_t > mIndices; // of the sorted points in the input
+	std::vector< uint32_t > mPointCells; // build scratch
+};
+
+} } // namespace mndl::blobtracker
@@ -0,0 +1,200 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+//! Define as 0 to compile out the recording of the statistics, BlobTracker::getStats() then stays empty.
+#ifndef MNDL_BLOBTRACKER_STATS
+#define MNDL_BLOBTRACKER_STATS 1
+#endif
+
+//! Expands to its argument, a statement, only if the statistics are compiled in.
+#if MNDL_BLOBTRACKER_STATS
+#define MNDL_BLOBTRACKER_STAT( ... ) __VA_ARGS__
+#else
+#define MNDL_BLOBTRACKER_STAT( ... )
+#endif
+
+namespace mndl { namespace blobtracker {
+
+//! Histogram of unsigned integer samples in power of two bins. Bin 0 counts the zeros, bin i the samples
+//! in [ 2^(i-1), 2^i ). The size is fixed, adding a sample never allocates.
+class Histogram
+{
+ public:
+	static const int kNumBins = 65;
+
+	void add( uint64_t sample )
+	{
+		mBins[ getBinIndex( sample ) ]++;
+		mMin = ( mCount == 0 ) ? sample : std::min( mMin, sample );
+		mMax = std::max( mMax, sample );
+		mSum += sample;
+		mLast = sample;
+		mCount++;
+	}
+	void clear() { *this = Histogram(); }
+
+	uint64_t getCount() const { return mCount; }
+	uint64_t getSum() const { return mSum; }
+	//! Returns the smallest sample, 0 if there are none.
+	uint64_t getMin() const { return mMin; }
+	uint64_t getMax() const { return mMax; }
+	//! Returns the sample added last, 0 if there are none.
+	uint64_t getLast() const { return mLast; }
+	double getMean() const { return ( mCount > 0 ) ? double( mSum ) / double( mCount ) : 0.0; }
+	//! Returns an upper bound of the \a q quantile, \a q in [ 0, 1 ]. This is the upper end of the bin the
+	//! quantile falls in, at most the largest sample, so it is off by less than a factor of two.
+	uint64_t getQuantile( double q ) const
+	{
+		uint64_t rank = std::max( uint64_t( q * double( mCount ) + .5 ), uint64_t( 1 ) );
+		uint64_t n = 0;
+		for ( int i = 0; i < kNumBins; i++ )
+		{
+			n += mBins[ i ];
+			if ( n >= rank )
+			{
+				uint64_t upper = ( i == 0 ) ? 0 : ( i < 64 ) ? ( uint64_t( 1 ) << i ) - 1 : UINT64_MAX;
+				return std::min( upper, mMax );
+			}
+		}
+		return mMax;
+	}
+	uint64_t getBin( int i ) const { return mBins[ i ]; }
+
+	//! Returns the bin of \a sample, the number of significant bits.
+	static int getBinIndex( uint64_t sample )
+	{
+		int bits = 0;
+		for ( int shift = 32; shift > 0; shift >>= 1 )
+		{
+			if ( sample >> shift )
+			{
+				sample >>= shift;
+				bits += shift;
+			}
+		}
+		return bits + int( sample );
+	}
+
+ private:
+	uint64_t mBins[ kNumBins ] = {};
+	uint64_t mCount = 0;
+	uint64_t mSum = 0;
+	uint64_t mMin = 0;
+	uint64_t mMax = 0;
+	uint64_t mLast = 0;
+};
+
+//! Timings and counters of a BlobTracker, accumulated since its creation or BlobTracker::resetStats().
+//! Times are in nanoseconds of the steady clock. Each histogram gets a sample per frame the stage ran
+//! or the count was taken in.
+struct Stats
+{
+	enum class Stage : int
+	{
+		INPUT = 0, //!< flip, copy, blanking, background subtraction and downscaling of the input
+		PREPROCESS, //!< blur and threshold, and labelling when the frame is split into stripes
+		EXTRACT, //!< contour tracing or labelling, blob statistics, refinement and the convex hulls
+		HULL, //!< the convex hulls only
+		DETECT, //!< all of the detection, on the detecting thread
+		TRACK, //!< matching the blobs to the tracks
+		SIGNALS, //!< emitting the frame and blob signals, including the callbacks
+		UPDATE, //!< update() or dispatchEvents() on the calling thread
+		COUNT
+	};
+	static const int kNumStages = static_cast< int >( Stage::COUNT );
+
+	static const char *getStageName( Stage stage )
+	{
+		static const char *names[ kNumStages ] = { "input", "preprocess", "extract", "hull", "detect", "track",
+												   "signals", "update" };
+		return names[ static_cast< int >( stage ) ];
+	}
+
+	//! Returns the steady clock time in nanoseconds.
+	static uint64_t now()
+	{
+		return uint64_t( std::chrono::duration_cast< std::chrono::nanoseconds >(
+				std::chrono::steady_clock::now().time_since_epoch() ).count() );
+	}
+
+	const Histogram & getStageTime( Stage stage ) const { return mStageTimes[ static_cast< int >( stage ) ]; }
+	void addStageTime( Stage stage, uint64_t nanoseconds ) { mStageTimes[ static_cast< int >( stage ) ].add( nanoseconds ); }
+
+	void clear() { *this = Stats(); }
+
+	Histogram mStageTimes[ kNumStages ];
+	Histogram mContours; //!< contours or components found per detection, before rejection
+	Histogram mRejectedByArea; //!< contours or components outside the area limits per detection
+	Histogram mRejectedByRoi; //!< blobs with the centroid outside the region of interest per detection
+	Histogram mReallocations; //!< detection images and blob columns reallocated per detection
+	Histogram mDirtyTiles; //!< tiles processed again per detection in incremental mode
+	Histogram mMatches; //!< tracks continued per tracked frame
+	Histogram mBirths; //!< tracks started per tracked frame
+	Histogram mDeaths; //!< tracks ended per tracked frame
+	Histogram mBlobs; //!< tracks after each tracked frame
+
+	uint64_t mNumDetections = 0;
+	uint64_t mNumTrackedFrames = 0;
+	uint64_t mNumExtrapolatedFrames = 0; //!< update() calls skipping detection, see Options::setDetectionInterval()
+	uint64_t mNumUnchangedFrames = 0; //!< incremental frames without changed tiles, not tracked again
+};
+
+//! Timings and counters of one detection, written by the detecting thread and added to the Stats by the
+//! thread tracking the result.
+struct DetectionStats
+{
+	//! Clears the statistics and starts timing \a stage.
+	void start( Stats::Stage stage )
+	{
+		*this = DetectionStats();
+		mStart = mStageStart = Stats::now();
+		mStage = stage;
+	}
+	//! Ends the current stage and starts \a stage. The times of a stage entered more than once add up.
+	void enter( Stats::Stage stage )
+	{
+		uint64_t t = Stats::now();
+		mStageTimes[ static_cast< int >( mStage ) ] += t - mStageStart;
+		mStage = stage;
+		mStageStart = t;
+	}
+	//! Ends the current stage and records the time since start() as Stats::Stage::DETECT.
+	void finish()
+	{
+		enter( Stats::Stage::DETECT );
+		mStageTimes[ static_cast< int >( Stats::Stage::DETECT ) ] = mStageStart - mStart;
+	}
+
+	uint64_t mStageTimes[ Stats::kNumStages ] = {};
+	uint32_t mContours = 0;
+	uint32_t mRejectedByArea = 0;
+	uint32_t mRejectedByRoi = 0;
+	uint32_t mReallocations = 0;
+
+ private:
+	uint64_t mStart = 0;
+	uint64_t mStageStart = 0;
+	Stats::Stage mStage = Stats::Stage::INPUT;
+};
+
+} } // namespace mndl::blobtracker
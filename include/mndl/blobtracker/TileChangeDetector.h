@@ -0,0 +1,59 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "CinderOpenCV.h"
+
+namespace mndl { namespace blobtracker {
+
+//! Finds the tiles of an 8-bit image that changed since the previous call. Tiles are compared with a
+//! reference copy by the sum of absolute differences, vectorized with AVX2 or SSE2 when the compiler
+//! targets them. Only the changed tiles are copied to the reference.
+class TileChangeDetector
+{
+ public:
+	//! Compares \a area of \a image with the reference in tiles of \a tileSize pixels, aligned to the top left
+	//! corner of the area. A tile is dirty if the mean absolute difference of its pixels is above \a threshold.
+	//! If \a reset is true, or the image size, area or tile size changed, all tiles are dirty. Returns the number
+	//! of dirty tiles.
+	size_t update( const cv::Mat &image, const cv::Rect &area, int tileSize, float threshold, bool reset );
+
+	//! Returns the dirty tiles of the last update in image coordinates, horizontally adjacent tiles merged.
+	const std::vector< cv::Rect > & getDirtyRects() const { return mDirtyRects; }
+	size_t getNumTiles() const { return mNumTiles; }
+	size_t getNumDirtyTiles() const { return mNumDirtyTiles; }
+
+	//! Forgets the reference, the next update reports all tiles dirty.
+	void invalidate() { mReference.release(); }
+
+ protected:
+	//! Returns the sum of absolute differences of the \a n bytes at \a a and \a b.
+	static uint32_t sumAbsDiff( const uint8_t *a, const uint8_t *b, int n );
+
+	cv::Mat mReference;
+	cv::Rect mArea;
+	int mTileSize = 0;
+	size_t mNumTiles = 0;
+	size_t mNumDirtyTiles = 0;
+	std::vector< uint32_t > mTileSums; // one row of tiles
+	std::vector< cv::Rect > mDirtyRects;
+};
+
+} } // namespace mndl::blobtracker
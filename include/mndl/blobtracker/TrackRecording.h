@@ -0,0 +1,174 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "cinder/Filesystem.h"
+#include "cinder/Signals.h"
+
+#include "mndl/blobtracker/Blob.h"
+#include "mndl/blobtracker/FrameResult.h"
+
+namespace mndl { namespace blobtracker {
+
+//! Track recordings are little-endian binary files on every host. A 16 byte header is followed by one record per frame,
+//! holding the frame number, the timestamp and the began, moved and ended blobs with their id, positions,
+//! bounds and convex hull points. An index of the record offsets closes the file. Recordings without the
+//! index, cut short by a crash, are still read up to the last whole record.
+
+typedef std::shared_ptr< class TrackRecorder > TrackRecorderRef;
+
+//! Appends the frames tracked by a BlobTracker to a track recording, e.g.
+//! \code tracker->connectFrame( &TrackRecorder::write, recorder.get() ); \endcode
+class TrackRecorder
+{
+ public:
+	//! Creates a recorder writing to \a path, replacing the file. Returns nullptr if the file cannot be created.
+	static TrackRecorderRef create( const ci::fs::path &path );
+
+	//! Closes the recording.
+	~TrackRecorder();
+
+	//! Appends \a frame. The record buffer is reused, only the index of the record offsets grows by one entry
+	//! per frame, until close() writes it.
+	void write( const FrameResultRef &frame );
+	//! Writes the buffered records to the file.
+	void flush();
+	//! Writes the index and closes the file, later frames are ignored.
+	void close();
+
+	uint64_t getNumFrames() const { return mOffsets.size(); }
+	//! Returns false if writing failed, the recording is then closed.
+	bool isGood() const { return mGood; }
+
+ protected:
+	TrackRecorder( std::FILE *file );
+
+	void writeBytes( const void *data, size_t size );
+
+	std::FILE *mFile;
+	bool mGood = true;
+	uint64_t mOffset = 0;
+	std::vector< uint64_t > mOffsets; // of the records, written as the index
+	std::vector< uint8_t > mRecord; // reused for each record
+};
+
+typedef std::shared_ptr< class TrackPlayer > TrackPlayerRef;
+
+//! Replays a track recording through the same signals as BlobTracker. The file is memory-mapped, so
+//! frames are decoded on demand without reading the recording up front. The replayed frames keep their
+//! recorded frame numbers and timestamps, the blob handles are invalid. Seeking and looping do not end
+//! the tracks alive at the jump.
+class TrackPlayer
+{
+ public:
+	//! Opens the recording at \a path. Returns nullptr if it cannot be mapped or is not a track recording.
+	static TrackPlayerRef create( const ci::fs::path &path );
+
+	~TrackPlayer();
+
+	size_t getNumFrames() const { return mIndex.size(); }
+	//! Returns the recorded timestamp of frame \a frameIndex in seconds.
+	double getFrameTime( size_t frameIndex ) const;
+	//! Returns the index of the next frame played.
+	size_t getFrameIndex() const { return mFrameIndex; }
+	//! Returns true if all frames were played and looping is disabled.
+	bool isDone() const { return mFrameIndex >= mIndex.size(); }
+
+	//! Continues playback from frame \a frameIndex, restarting the clock of update().
+	void seek( size_t frameIndex );
+	//! Sets the playback speed of update() relative to the recorded time, 1 by default.
+	void setSpeed( double speed );
+	double getSpeed() const { return mSpeed; }
+	//! Starts from the first frame again after the last one. Disabled by default.
+	void setLoop( bool loop = true ) { mLoop = loop; }
+
+	//! Plays the frames due at the current time scaled by the speed, emitting their signals on the calling
+	//! thread. The clock starts at the first call. Returns the number of frames played.
+	size_t update();
+	//! Plays the next frame regardless of its time, for replaying as fast as the receivers allow.
+	//! Returns false if there are no more frames.
+	bool playNextFrame();
+
+	//! Returns the frame played last.
+	const FrameResultRef & getFrameResult() const { return mFrameResult; }
+
+	typedef void( BlobCallback )( BlobEvent );
+	typedef ci::signals::Signal< BlobCallback > BlobSignal;
+	typedef void( FrameCallback )( const FrameResultRef & );
+	typedef ci::signals::Signal< FrameCallback > FrameSignal;
+
+	template< typename T, typename Y >
+	ci::signals::Connection connectBlobsBegan( T fn, Y *inst )
+	{ return mBlobsBeganSig.connect( std::bind( fn, inst, std::placeholders::_1 ) ); }
+
+	template< typename T, typename Y >
+	ci::signals::Connection connectBlobsMoved( T fn, Y *inst )
+	{ return mBlobsMovedSig.connect( std::bind( fn, inst, std::placeholders::_1 ) ); }
+
+	template< typename T, typename Y >
+	ci::signals::Connection connectBlobsEnded( T fn, Y *inst )
+	{ return mBlobsEndedSig.connect( std::bind( fn, inst, std::placeholders::_1 ) ); }
+
+	//! Connects a callback receiving each played frame, called before the per blob signals.
+	template< typename T, typename Y >
+	ci::signals::Connection connectFrame( T fn, Y *inst )
+	{ return mFrameSig.connect( std::bind( fn, inst, std::placeholders::_1 ) ); }
+
+	template< typename T, typename Y >
+	void connectBlobCallbacks( T fnBegan, T fnMoved, T fnEnded, Y *inst )
+	{
+		connectBlobsBegan( fnBegan, inst );
+		connectBlobsMoved( fnMoved, inst );
+		connectBlobsEnded( fnEnded, inst );
+	}
+
+ protected:
+	class MappedFile;
+
+	TrackPlayer( std::unique_ptr< MappedFile > file, std::vector< uint64_t > index );
+
+	//! Decodes frame \a frameIndex into a frame result nobody else holds.
+	std::shared_ptr< FrameResult > decodeFrame( size_t frameIndex );
+	void emitSignals( const FrameResultRef &frameResult );
+
+	std::unique_ptr< MappedFile > mFile;
+	std::vector< uint64_t > mIndex; // record offsets
+
+	size_t mFrameIndex = 0;
+	double mSpeed = 1.0;
+	bool mLoop = false;
+	bool mClockStarted = false;
+	double mClockStart = 0.0;
+	double mClockFrameTime = 0.0; // recorded time at the clock start
+
+	FrameResultRef mFrameResult;
+	FrameResultCache mFrameResultCache;
+
+	FrameSignal mFrameSig;
+	BlobSignal mBlobsBeganSig;
+	BlobSignal mBlobsMovedSig;
+	BlobSignal mBlobsEndedSig;
+};
+
+} } // namespace mndl::blobtracker
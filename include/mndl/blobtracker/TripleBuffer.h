@@ -0,0 +1,64 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+
+namespace mndl { namespace blobtracker {
+
+//! Lock-free triple buffer for handing results from one writer thread to one reader thread.
+//! The writer never waits for the reader, and the reader always gets the latest published result.
+template< typename T >
+class TripleBuffer
+{
+ public:
+	//! Returns the buffer owned by the writer.
+	T & getWriteBuffer() { return mBuffers[ mWriteIndex ]; }
+
+	//! Publishes the write buffer and takes over the previous exchange buffer for writing.
+	void publish()
+	{
+		mWriteIndex = mExchange.exchange( mWriteIndex | kFresh, std::memory_order_acq_rel ) & kIndexMask;
+	}
+
+	//! Takes over the latest published buffer for reading. Returns false if nothing was published since the last call.
+	bool acquire()
+	{
+		if ( ! ( mExchange.load( std::memory_order_relaxed ) & kFresh ) )
+		{
+			return false;
+		}
+		mReadIndex = mExchange.exchange( mReadIndex, std::memory_order_acq_rel ) & kIndexMask;
+		return true;
+	}
+
+	//! Returns the buffer owned by the reader.
+	T & getReadBuffer() { return mBuffers[ mReadIndex ]; }
+	const T & getReadBuffer() const { return mBuffers[ mReadIndex ]; }
+
+ private:
+	static const int kIndexMask = 3;
+	static const int kFresh = 4;
+
+	T mBuffers[ 3 ];
+	int mWriteIndex = 0;
+	int mReadIndex = 1;
+	std::atomic< int > mExchange { 2 };
+};
+
+} } // namespace mndl::blobtracker
@@ -0,0 +1,160 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cinder/Vector.h"
+
+#include "mndl/blobtracker/FrameMailbox.h"
+#include "mndl/blobtracker/FrameResult.h"
+
+namespace mndl { namespace blobtracker {
+
+typedef std::shared_ptr< class TuioSender > TuioSenderRef;
+
+//! Sends the tracked blobs as TUIO over UDP, e.g.
+//! \code tracker->connectFrame( &TuioSender::send, sender.get() ); \endcode
+//! Each frame is packed into OSC bundles on the calling thread and sent from a thread of the sender. TUIO 1.1
+//! bundles hold the source, the alive ids, the set messages of the /tuio/2Dblb profile and the frame sequence
+//! number. TUIO 2.0 bundles hold the frame, the /tuio2/bnd messages and the alive ids. A frame is split into
+//! several bundles at the maximum packet size, each repeating the alive ids, TUIO 1.1 marks all but the last one
+//! with frame sequence number -1. The buffers are reused and each is reserved to the largest frame of all alive
+//! blobs so far, so sending does not allocate once the most blobs have been alive.
+class TuioSender
+{
+ public:
+	struct Options
+	{
+	 public:
+		Options() {}
+
+		enum class Protocol : int
+		{
+			TUIO_1_1 = 0, //!< /tuio/2Dblb profile
+			TUIO_2_0 //!< /tuio2/bnd messages
+		};
+
+		//! Sets the protocol version. Protocol::TUIO_1_1 by default.
+		void setProtocol( Protocol protocol ) { mProtocol = protocol; }
+		Protocol getProtocol() const { return mProtocol; }
+		//! Sets the source name sent with each bundle, "BlobTracker" by default. TUIO 1.1 omits the source message if empty.
+		void setSourceName( const std::string &sourceName ) { mSourceName = sourceName; }
+		const std::string & getSourceName() const { return mSourceName; }
+		//! Sets the largest bundle in bytes, 1472 by default, the UDP payload of an Ethernet frame. If the alive ids
+		//! take more than half of it, each bundle holds this many bytes of blob messages besides the alive ids.
+		void setMaxPacketSize( size_t maxPacketSize ) { mMaxPacketSize = maxPacketSize; }
+		size_t getMaxPacketSize() const { return mMaxPacketSize; }
+		//! Sets the normalization scale of the tracker, see BlobTracker::Options::setNormalizationScale(). TUIO
+		//! coordinates are in [ 0, 1 ]. 1.0 by default.
+		void setNormalizationScale( float normalizationScale ) { mNormalizationScale = normalizationScale; }
+		float getNormalizationScale() const { return mNormalizationScale; }
+		//! Sets the sensor size in pixels sent by TUIO 2.0 frame messages. Zero by default.
+		void setSensorSize( const ci::ivec2 &sensorSize ) { mSensorSize = sensorSize; }
+		const ci::ivec2 & getSensorSize() const { return mSensorSize; }
+
+		Protocol mProtocol = Protocol::TUIO_1_1;
+		std::string mSourceName = "BlobTracker";
+		size_t mMaxPacketSize = 1472;
+		float mNormalizationScale = 1.f;
+		ci::ivec2 mSensorSize = ci::ivec2( 0 );
+	};
+
+	//! Creates a sender to \a host, a name or an address, on UDP port \a port. The options are copied. Returns
+	//! nullptr if the host cannot be resolved or the socket cannot be created.
+	static TuioSenderRef create( const std::string &host, uint16_t port = 3333, const Options &options = Options() );
+
+	//! Sends the bundles still waiting and stops the sending thread.
+	~TuioSender();
+
+	//! Packs the alive blobs after \a frame and hands the bundles to the sending thread. If the thread has not
+	//! taken the bundles of the previous frame yet, they are replaced, and the next frame sends all alive blobs.
+	void send( const FrameResultRef &frame );
+
+	//! Returns the number of frames packed.
+	uint64_t getNumFrames() const { return mNumFrames; }
+	//! Returns the number of packed frames replaced before the sending thread took them.
+	uint64_t getNumDroppedFrames() const { return mNumDroppedFrames; }
+	uint64_t getNumPacketsSent() const { return mNumPacketsSent; }
+	uint64_t getNumBytesSent() const { return mNumBytesSent; }
+	//! Returns the number of packets the socket refused.
+	uint64_t getNumSendErrors() const { return mNumSendErrors; }
+	//! Returns the number of blobs alive after the last frame.
+	size_t getNumAlive() const { return mTracks.size(); }
+
+ protected:
+	class Socket;
+
+	//! The bundles of a frame, \a mEnds holds the end offset of each in \a mData.
+	struct Packets
+	{
+		std::vector< uint8_t > mData;
+		std::vector< size_t > mEnds;
+	};
+
+	//! Alive blob in TUIO units.
+	struct Track
+	{
+		int32_t mId;
+		ci::vec2 mPos;
+		ci::vec2 mSize;
+		ci::vec2 mVelocity; //!< per second
+		float mAcceleration; //!< of the speed per second
+		bool mChanged; //!< sent with the next frame
+	};
+
+	TuioSender( std::unique_ptr< Socket > socket, const Options &options );
+
+	void updateTracks( const FrameResult &frame );
+	void pack( const FrameResult &frame, Packets &packets );
+	void beginBundle( uint32_t frameId, uint64_t timeTag, Packets &packets ) const;
+	void packTrack( const Track &track, Packets &packets ) const;
+	void endBundle( int32_t frameSequence, Packets &packets ) const;
+	//! Returns the size of the bundle element packTrack() appends.
+	size_t getTrackMessageSize() const;
+	//! Returns the size of the messages endBundle() appends.
+	size_t getBundleTailSize() const;
+	void sendPackets();
+
+	std::unique_ptr< Socket > mSocket;
+	Options mOptions;
+
+	std::vector< Track > mTracks; // sorted by id
+	double mLastTimestamp = 0.0;
+	bool mSendAll = true;
+
+	Packets mPackets; // packed by send()
+	// of the largest frame of all alive blobs so far, the buffers circulating through the mailbox are reserved to it
+	size_t mMaxDataSize = 0;
+	size_t mMaxNumBundles = 0;
+	FrameMailbox< Packets > mMailbox;
+	std::thread mThread;
+
+	uint64_t mNumFrames = 0;
+	uint64_t mNumDroppedFrames = 0;
+	std::atomic< uint64_t > mNumPacketsSent { 0 };
+	std::atomic< uint64_t > mNumBytesSent { 0 };
+	std::atomic< uint64_t > mNumSendErrors { 0 };
+};
+
+} } // namespace mndl::blobtracker
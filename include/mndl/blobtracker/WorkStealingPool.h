@@ -0,0 +1,83 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mndl { namespace blobtracker {
+
+typedef std::shared_ptr< class WorkStealingPool > WorkStealingPoolRef;
+
+//! Fixed-size thread pool where each worker has its own task queue. Workers take their own tasks
+//! newest first and steal the oldest tasks of the others when they run out, so work submitted
+//! to a busy worker is picked up by the idle ones.
+class WorkStealingPool
+{
+ public:
+	typedef std::function< void() > Task;
+
+	//! Creates a pool of \a numThreads workers, or one per hardware thread if \a numThreads is 0.
+	static WorkStealingPoolRef create( size_t numThreads = 0 )
+	{ return WorkStealingPoolRef( new WorkStealingPool( numThreads ) ); }
+
+	//! Runs the tasks still queued, then joins the workers.
+	~WorkStealingPool();
+
+	//! Queues \a task. Tasks submitted from a worker go to its own queue, others are distributed round-robin.
+	void submit( Task task );
+
+	//! Runs queued tasks on the calling thread until \a remaining drops to zero. Lets a task wait for the
+	//! subtasks it submitted without blocking a worker.
+	void wait( const std::atomic< size_t > &remaining );
+
+	size_t getNumThreads() const { return mThreads.size(); }
+
+ protected:
+	WorkStealingPool( size_t numThreads );
+
+	//! Returns the index of the calling worker, or the number of workers if called from another thread.
+	size_t getWorkerIndex() const;
+	//! Takes a task from the queue of worker \a index or steals one from the others. Returns false if all queues are empty.
+	bool tryPop( size_t index, Task &task );
+	void workerLoop( size_t index );
+
+	struct Queue
+	{
+		std::mutex mMutex;
+		std::deque< Task > mTasks;
+	};
+
+	std::vector< std::unique_ptr< Queue > > mQueues;
+	std::vector< std::thread > mThreads;
+	std::atomic< size_t > mNextQueue { 0 };
+
+	std::mutex mIdleMutex;
+	std::condition_variable mIdleCondition;
+	std::atomic< size_t > mNumPending { 0 };
+	bool mStopping = false;
+};
+
+} } // namespace mndl::blobtracker
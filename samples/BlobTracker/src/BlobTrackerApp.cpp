@@ -10,6 +10,8 @@
 
 #include "mndl/blobtracker/BlobTracker.h"
 #include "mndl/blobtracker/DebugDrawer.h"
+#include "mndl/blobtracker/TrackRecording.h"
+#include "mndl/blobtracker/TuioSender.h"
 
 using namespace ci;
 using namespace ci::app;
@@ -31,19 +33,34 @@ class BlobTrackerApp : public App
 
 	mndl::blobtracker::BlobTracker::Options mBlobTrackerOptions;
 	mndl::blobtracker::BlobTrackerRef mBlobTracker;
+	mndl::blobtracker::DebugDrawerRef mDebugDrawer;
 	mndl::blobtracker::DebugDrawer::Options mDebugOptions;
 
 	qtime::MovieSurfaceRef mMovie;
 
 	float mFps;
+	bool mAsync = false;
 
-	void blobsBegan( mndl::blobtracker::BlobEvent event );
-	void blobsMoved( mndl::blobtracker::BlobEvent event );
-	void blobsEnded( mndl::blobtracker::BlobEvent event );
+	// mean stage times in milliseconds, refreshed every second
+	float mStageTimes[ mndl::blobtracker::Stats::kNumStages ] = {};
+	double mStatsTime = 0.0;
+	void updateStats();
+
+	void frameTracked( const mndl::blobtracker::FrameResultRef &frame );
 
 	std::unordered_map< int32_t, PolyLine2 > mStrokes;
 
 	void loadMovie( const fs::path &moviePath );
+
+	mndl::blobtracker::TrackRecorderRef mRecorder;
+	signals::Connection mRecorderConnection;
+	void toggleRecording();
+	mndl::blobtracker::TrackPlayerRef mPlayer;
+	void loadRecording( const fs::path &path );
+
+	mndl::blobtracker::TuioSenderRef mTuioSender;
+	signals::Connection mTuioConnection;
+	void toggleTuio();
 };
 
 void BlobTrackerApp::prepareSettings( Settings *settings )
@@ -56,9 +73,8 @@ void BlobTrackerApp::setup()
 	disableFrameRate();
 
 	mBlobTracker = mndl::blobtracker::BlobTracker::create( mBlobTrackerOptions );
-	mBlobTracker->connectBlobCallbacks( &BlobTrackerApp::blobsBegan,
-										&BlobTrackerApp::blobsMoved,
-										&BlobTrackerApp::blobsEnded, this );
+	mBlobTracker->connectFrame( &BlobTrackerApp::frameTracked, this );
+	mDebugDrawer = mndl::blobtracker::DebugDrawer::create();
 
 	setupParams();
 }
@@ -66,6 +82,7 @@ void BlobTrackerApp::setup()
 void BlobTrackerApp::loadMovie( const fs::path &moviePath )
 {
 	mStrokes.clear();
+	mPlayer.reset();
 
 	mMovie = qtime::MovieSurface::create( moviePath );
 	mMovie->setLoop();
@@ -80,14 +97,45 @@ void BlobTrackerApp::setupParams()
 	mParams->addSeparator();
 
 	mParams->addText( "Blob tracker" );
+	mParams->addParam( "Async", &mAsync );
+	mParams->addParam( "Threads", &mBlobTrackerOptions.mNumThreads ).min( 1 ).max( 16 );
 	mParams->addParam( "Flip", &mBlobTrackerOptions.mFlip );
 	mParams->addParam( "Threshold", &mBlobTrackerOptions.mThreshold ).min( 0 ).max( 255 );
 	mParams->addParam( "Threshold inverts", &mBlobTrackerOptions.mThresholdInvertEnabled );
+	mParams->addParam( "Adaptive", &mBlobTrackerOptions.mAdaptiveThresholdEnabled ).group( "Adaptive threshold" );
+	mParams->addParam( "Block size", &mBlobTrackerOptions.mAdaptiveThresholdBlockSize ).min( 3 ).max( 255 ).step( 2 ).group( "Adaptive threshold" );
+	mParams->addParam( "Offset", &mBlobTrackerOptions.mAdaptiveThresholdOffset ).min( -64 ).max( 64 ).group( "Adaptive threshold" );
+	mParams->setOptions( "Adaptive threshold", "opened=false" );
+	mParams->addParam( "Background", &mBlobTrackerOptions.mBackgroundSubtractionEnabled ).group( "Background" );
+	mParams->addParam( "Learning rate", &mBlobTrackerOptions.mBackgroundLearningRate ).min( 0.f ).max( .25f ).step( .001f ).group( "Background" );
+	mParams->addParam( "Freeze", &mBlobTrackerOptions.mBackgroundFreezeEnabled ).group( "Background" );
+	mParams->addButton( "Reset background", [ & ]() { mBlobTracker->resetBackground(); }, "group=Background" );
 	mParams->addParam( "Blur size", &mBlobTrackerOptions.mBlurSize ).min( 1 ).max( 15 );
+	std::vector< std::string > preprocessModeNames = { "opencv", "fused" };
+	mParams->addParam( "Preprocess mode", preprocessModeNames, reinterpret_cast< int * >( &mBlobTrackerOptions.mPreprocessMode ) );
+	mParams->addParam( "Incremental", &mBlobTrackerOptions.mIncrementalEnabled );
+	mParams->addParam( "Tile size", &mBlobTrackerOptions.mTileSize ).min( 8 ).max( 128 );
+	std::vector< std::string > detectionModeNames = { "contours", "labels" };
+	mParams->addParam( "Detection mode", detectionModeNames, reinterpret_cast< int * >( &mBlobTrackerOptions.mDetectionMode ) );
+	mParams->addParam( "Bit mask", &mBlobTrackerOptions.mBitMaskEnabled ).group( "Bit mask" );
+	std::vector< std::string > morphologyNames = { "none", "open", "close" };
+	mParams->addParam( "Morphology", morphologyNames, reinterpret_cast< int * >( &mBlobTrackerOptions.mMorphology ) ).group( "Bit mask" );
+	mParams->addParam( "Radius", &mBlobTrackerOptions.mMorphologyRadius ).min( 1 ).max( 63 ).group( "Bit mask" );
+	mParams->setOptions( "Bit mask", "opened=false" );
 	mParams->addParam( "Min area", &mBlobTrackerOptions.mMinArea ).min( 0.f ).max( 1.f ).step( 0.0001f );
 	mParams->addParam( "Max area", &mBlobTrackerOptions.mMaxArea ).min( 0.f ).max( 1.f ).step( 0.001f );
 	mParams->addParam( "Convex hull", &mBlobTrackerOptions.mConvexHullEnabled );
 	mParams->addParam( "Bounds", &mBlobTrackerOptions.mBoundsEnabled );
+	std::vector< std::string > matchModeNames = { "knn", "greedy", "hungarian" };
+	mParams->addParam( "Match mode", matchModeNames, reinterpret_cast< int * >( &mBlobTrackerOptions.mMatchMode ) );
+	mParams->addParam( "Max match distance", &mBlobTrackerOptions.mMaxMatchDistance ).min( 0.f ).max( 1.f ).step( 0.005f );
+	mParams->addParam( "Prediction", &mBlobTrackerOptions.mPredictionEnabled );
+	mParams->addParam( "Detection interval", &mBlobTrackerOptions.mDetectionInterval ).min( 1 ).max( 8 );
+	mParams->addParam( "Pyramid", &mBlobTrackerOptions.mPyramidEnabled ).group( "Pyramid" );
+	mParams->addParam( "Max level", &mBlobTrackerOptions.mMaxPyramidLevel ).min( 0 ).max( 5 ).group( "Pyramid" );
+	mParams->addParam( "Min blob size", &mBlobTrackerOptions.mPyramidMinBlobSize ).min( 1.f ).max( 64.f ).group( "Pyramid" );
+	mParams->addParam( "Refinement", &mBlobTrackerOptions.mPyramidRefinementEnabled ).group( "Pyramid" );
+	mParams->setOptions( "Pyramid", "opened=false" );
 	mParams->addParam( "Top left x", &mBlobTrackerOptions.mNormalizedRegionOfInterest.x1 )
 		.min( 0.f ).max( 1.f ).step( 0.001f ).group( "Region of Interest" );
 	mParams->addParam( "Top left y", &mBlobTrackerOptions.mNormalizedRegionOfInterest.y1 )
@@ -98,7 +146,16 @@ void BlobTrackerApp::setupParams()
 		.min( 0.f ).max( 1.f ).step( 0.001f ).group( "Region of Interest" );
 	mParams->addParam( "Blank outside Roi", &mBlobTrackerOptions.mBlankOutsideRoi )
 		.group( "Region of Interest" );
+	mParams->addParam( "Crop to Roi", &mBlobTrackerOptions.mCropToRoi )
+		.group( "Region of Interest" );
 	mParams->setOptions( "Region of Interest", "opened=false" );
+	for ( int i = 0; i < mndl::blobtracker::Stats::kNumStages; i++ )
+	{
+		auto stage = static_cast< mndl::blobtracker::Stats::Stage >( i );
+		mParams->addParam( std::string( mndl::blobtracker::Stats::getStageName( stage ) ) + " ms",
+						   &mStageTimes[ i ], true ).group( "Stats" );
+	}
+	mParams->setOptions( "Stats", "opened=false" );
 	mParams->addSeparator();
 
 	mParams->addText( "Debug" );
@@ -111,6 +168,7 @@ void BlobTrackerApp::setupParams()
 	mDebugOptions.mDrawMode = mndl::blobtracker::DebugDrawer::Options::DrawMode::ORIGINAL;
 	mParams->addParam( "Draw mode", drawModeNames, reinterpret_cast< int * >( &mDebugOptions.mDrawMode ) );
 	mParams->addParam( "Draw proportional fit", &mDebugOptions.mDrawProportionalFit );
+	mParams->addParam( "Draw ids", &mDebugOptions.mDrawIds );
 	mParams->addSeparator();
 
 	mParams->addButton( "Load movie", [ & ]()
@@ -121,6 +179,67 @@ void BlobTrackerApp::setupParams()
 					loadMovie( moviePath );
 				}
 			} );
+	mParams->addButton( "Record tracks", [ & ]() { toggleRecording(); } );
+	mParams->addButton( "Send TUIO", [ & ]() { toggleTuio(); } );
+	mParams->addButton( "Replay tracks", [ & ]()
+			{
+				fs::path path = app::getOpenFilePath();
+				if ( fs::exists( path ) )
+				{
+					loadRecording( path );
+				}
+			} );
+}
+
+void BlobTrackerApp::toggleRecording()
+{
+	if ( mRecorder )
+	{
+		mRecorderConnection.disconnect();
+		mRecorder.reset();
+		return;
+	}
+
+	fs::path path = app::getSaveFilePath();
+	if ( ! path.empty() )
+	{
+		mRecorder = mndl::blobtracker::TrackRecorder::create( path );
+		if ( mRecorder )
+		{
+			mRecorderConnection = mBlobTracker->connectFrame( &mndl::blobtracker::TrackRecorder::write, mRecorder.get() );
+		}
+	}
+}
+
+void BlobTrackerApp::toggleTuio()
+{
+	if ( mTuioSender )
+	{
+		mTuioConnection.disconnect();
+		mTuioSender.reset();
+		return;
+	}
+
+	mndl::blobtracker::TuioSender::Options options;
+	options.setNormalizationScale( mBlobTrackerOptions.getNormalizationScale() );
+	mTuioSender = mndl::blobtracker::TuioSender::create( "localhost", 3333, options );
+	if ( mTuioSender )
+	{
+		mTuioConnection = mBlobTracker->connectFrame( &mndl::blobtracker::TuioSender::send, mTuioSender.get() );
+	}
+}
+
+void BlobTrackerApp::loadRecording( const fs::path &path )
+{
+	mStrokes.clear();
+	mMovie.reset();
+
+	mPlayer = mndl::blobtracker::TrackPlayer::create( path );
+	if ( mPlayer )
+	{
+		mPlayer->setLoop();
+		mPlayer->connectFrame( &BlobTrackerApp::frameTracked, this );
+	}
 }
 
 void BlobTrackerApp::update()
@@ -129,8 +248,47 @@ void BlobTrackerApp::update()
 
 	if ( mMovie && mMovie->checkNewFrame() )
 	{
-		mBlobTracker->update( Channel8u( *mMovie->getSurface() ) );
+		// the params edit the options in place, the tracker takes a copy with each frame
+		mBlobTracker->setOptions( mBlobTrackerOptions );
+		if ( mAsync )
+		{
+			mBlobTracker->updateAsync( *mMovie->getSurface() );
+		}
+		else
+		{
+			mBlobTracker->update( *mMovie->getSurface() );
+		}
+	}
+
+	if ( mAsync )
+	{
+		mBlobTracker->dispatchEvents();
+	}
+
+	if ( mPlayer )
+	{
+		mPlayer->update();
 	}
+
+	updateStats();
+}
+
+void BlobTrackerApp::updateStats()
+{
+	double time = getElapsedSeconds();
+	if ( time - mStatsTime < 1.0 )
+	{
+		return;
+	}
+	mStatsTime = time;
+
+	const mndl::blobtracker::Stats &stats = mBlobTracker->getStats();
+	for ( int i = 0; i < mndl::blobtracker::Stats::kNumStages; i++ )
+	{
+		auto stage = static_cast< mndl::blobtracker::Stats::Stage >( i );
+		mStageTimes[ i ] = float( stats.getStageTime( stage ).getMean() * 1e-6 );
+	}
+	mBlobTracker->resetStats();
 }
 
 void BlobTrackerApp::draw()
@@ -155,35 +313,28 @@ void BlobTrackerApp::draw()
 		}
 	}
 
-	mndl::blobtracker::DebugDrawer::draw( mBlobTracker, getWindowBounds(), mDebugOptions );
+	mDebugDrawer->draw( mBlobTracker, getWindowBounds(), mDebugOptions );
 	mParams->draw();
 }
 
-void BlobTrackerApp::blobsBegan( mndl::blobtracker::BlobEvent event )
+void BlobTrackerApp::frameTracked( const mndl::blobtracker::FrameResultRef &frame )
 {
-	int32_t id = event.getId();
-	mStrokes[ id ] = PolyLine2();
-	mStrokes[ id ].push_back( event.getPos() * vec2( getWindowSize() ) );
-}
-
-void BlobTrackerApp::blobsMoved( mndl::blobtracker::BlobEvent event )
-{
-	int32_t id = event.getId();
-	auto strokeIt = mStrokes.find( id );
-	if ( strokeIt != mStrokes.end() )
+	vec2 windowSize( getWindowSize() );
+	for ( const auto &blob : frame->getEnded() )
 	{
-		strokeIt->second.push_back( event.getPos() * vec2( getWindowSize() ) );
+		mStrokes.erase( blob.mId );
 	}
-	else
+	for ( const auto &blob : frame->getMoved() )
 	{
-		blobsBegan( event );
+		// strokes are cleared when a new movie is loaded
+		mStrokes[ blob.mId ].push_back( blob.mPos * windowSize );
+	}
+	for ( const auto &blob : frame->getBegan() )
+	{
+		PolyLine2 &stroke = mStrokes[ blob.mId ];
+		stroke.getPoints().clear();
+		stroke.push_back( blob.mPos * windowSize );
 	}
-}
-
-void BlobTrackerApp::blobsEnded( mndl::blobtracker::BlobEvent event )
-{
-	int32_t id = event.getId();
-	mStrokes.erase( id );
 }
 
 void BlobTrackerApp::keyDown( KeyEvent event )
@@ -0,0 +1,145 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstdlib>
+
+#if defined( MNDL_BLOBTRACKER_NO_SIMD )
+#elif defined( __AVX2__ )
+#define MNDL_BLOBTRACKER_AVX2
+#include <immintrin.h>
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && ( _M_IX86_FP >= 2 ) )
+#define MNDL_BLOBTRACKER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "mndl/blobtracker/BackgroundModel.h"
+
+using namespace std;
+
+namespace mndl { namespace blobtracker {
+
+namespace {
+
+//! Fractional bits of the background, 8.7 fixed point keeps the difference to the input in 16 bits.
+const int kFractionBits = 7;
+
+} // anonymous namespace
+
+void BackgroundModel::applyRow( const uint8_t *input, int16_t *background, uint8_t *foreground, int n,
+								int rate, int freezeThreshold )
+{
+	// the update is the difference times the rate, rounded down like _mm_mulhi_epi16
+	const int learnBelow = std::min( std::max( freezeThreshold + 1, 0 ), 256 );
+	int x = 0;
+#if defined( MNDL_BLOBTRACKER_AVX2 )
+	const __m256i rate16 = _mm256_set1_epi16( short( rate ) );
+	const __m256i half16 = _mm256_set1_epi16( 1 << ( kFractionBits - 1 ) );
+	const __m256i learnBelow16 = _mm256_set1_epi16( short( learnBelow ) );
+	for ( ; x <= n - 16; x += 16 )
+	{
+		__m256i in = _mm256_cvtepu8_epi16( _mm_loadu_si128( reinterpret_cast< const __m128i * >( input + x ) ) );
+		__m256i *b = reinterpret_cast< __m256i * >( background + x );
+		__m256i bg = _mm256_loadu_si256( b );
+		__m256i diff = _mm256_sub_epi16( _mm256_slli_epi16( in, kFractionBits ), bg );
+		__m256i bgRounded = _mm256_srli_epi16( _mm256_add_epi16( bg, half16 ), kFractionBits );
+		__m256i fg = _mm256_sub_epi16( _mm256_max_epi16( in, bgRounded ), _mm256_min_epi16( in, bgRounded ) );
+		__m256i learn = _mm256_cmpgt_epi16( learnBelow16, fg );
+		bg = _mm256_add_epi16( bg, _mm256_and_si256( _mm256_mulhi_epi16( diff, rate16 ), learn ) );
+		_mm256_storeu_si256( b, bg );
+		// packus works within 128-bit lanes, gather the low halves
+		__m256i bytes = _mm256_permute4x64_epi64( _mm256_packus_epi16( fg, fg ), _MM_SHUFFLE( 3, 1, 2, 0 ) );
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( foreground + x ), _mm256_castsi256_si128( bytes ) );
+	}
+#elif defined( MNDL_BLOBTRACKER_SSE2 )
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rate8 = _mm_set1_epi16( short( rate ) );
+	const __m128i half8 = _mm_set1_epi16( 1 << ( kFractionBits - 1 ) );
+	const __m128i learnBelow8 = _mm_set1_epi16( short( learnBelow ) );
+	for ( ; x <= n - 16; x += 16 )
+	{
+		__m128i bytes = _mm_loadu_si128( reinterpret_cast< const __m128i * >( input + x ) );
+		__m128i fg[ 2 ];
+		for ( int j = 0; j < 2; j++ )
+		{
+			__m128i in = ( j == 0 ) ? _mm_unpacklo_epi8( bytes, zero ) : _mm_unpackhi_epi8( bytes, zero );
+			__m128i *b = reinterpret_cast< __m128i * >( background + x + j * 8 );
+			__m128i bg = _mm_loadu_si128( b );
+			__m128i diff = _mm_sub_epi16( _mm_slli_epi16( in, kFractionBits ), bg );
+			__m128i bgRounded = _mm_srli_epi16( _mm_add_epi16( bg, half8 ), kFractionBits );
+			fg[ j ] = _mm_sub_epi16( _mm_max_epi16( in, bgRounded ), _mm_min_epi16( in, bgRounded ) );
+			__m128i learn = _mm_cmpgt_epi16( learnBelow8, fg[ j ] );
+			bg = _mm_add_epi16( bg, _mm_and_si128( _mm_mulhi_epi16( diff, rate8 ), learn ) );
+			_mm_storeu_si128( b, bg );
+		}
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( foreground + x ), _mm_packus_epi16( fg[ 0 ], fg[ 1 ] ) );
+	}
+#endif
+
+	for ( ; x < n; x++ )
+	{
+		int in = input[ x ];
+		int bg = background[ x ];
+		int diff = ( in << kFractionBits ) - bg;
+		int fg = std::abs( in - ( ( bg + ( 1 << ( kFractionBits - 1 ) ) ) >> kFractionBits ) );
+		foreground[ x ] = uint8_t( fg );
+		if ( fg < learnBelow )
+		{
+			background[ x ] = int16_t( bg + ( ( diff * rate ) >> 16 ) );
+		}
+	}
+}
+
+void BackgroundModel::apply( const cv::Mat &input, const cv::Rect &area, float learningRate, int freezeThreshold,
+							 cv::Mat &foreground )
+{
+	lock_guard< mutex > lock( mMutex );
+
+	const int w = area.width;
+	const int h = area.height;
+	if ( mBackground.empty() || ( mSize != input.size() ) || ( mArea != area ) )
+	{
+		mBackground.resize( size_t( w ) * size_t( h ) );
+		for ( int y = 0; y < h; y++ )
+		{
+			const uint8_t *src = input.ptr< uint8_t >( area.y + y ) + area.x;
+			int16_t *bg = mBackground.data() + size_t( y ) * w;
+			for ( int x = 0; x < w; x++ )
+			{
+				bg[ x ] = int16_t( src[ x ] << kFractionBits );
+			}
+		}
+		mSize = input.size();
+		mArea = area;
+	}
+
+	// 0.16 fixed point, kept below 0.5 to fit the signed 16-bit multiplier
+	const int rate = std::min( std::max( int( learningRate * 65536.f + .5f ), 0 ), 32767 );
+	for ( int y = 0; y < h; y++ )
+	{
+		applyRow( input.ptr< uint8_t >( area.y + y ) + area.x, mBackground.data() + size_t( y ) * w,
+				  foreground.ptr< uint8_t >( area.y + y ) + area.x, w, rate, freezeThreshold );
+	}
+}
+
+void BackgroundModel::reset()
+{
+	lock_guard< mutex > lock( mMutex );
+	mBackground.clear();
+}
+
+} } // namespace mndl::blobtracker
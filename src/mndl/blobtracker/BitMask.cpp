@@ -0,0 +1,290 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstring>
+
+#if defined( MNDL_BLOBTRACKER_NO_SIMD )
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && ( _M_IX86_FP >= 2 ) )
+#define MNDL_BLOBTRACKER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "mndl/blobtracker/BitMask.h"
+
+using namespace std;
+
+namespace mndl { namespace blobtracker {
+
+namespace {
+
+//! Returns the bits of word \a i covering the pixels [ \a x1, \a x2 ).
+inline uint64_t wordMask( int i, int x1, int x2 )
+{
+	const int from = std::min( std::max( x1 - ( i << 6 ), 0 ), 64 );
+	const int to = std::min( std::max( x2 - ( i << 6 ), 0 ), 64 );
+	if ( from >= to )
+	{
+		return 0;
+	}
+	const uint64_t below = ( to == 64 ) ? ~uint64_t( 0 ) : ( ( uint64_t( 1 ) << to ) - 1 );
+	return below & ~( ( uint64_t( 1 ) << from ) - 1 );
+}
+
+//! The 8 bytes of 0 and 255 of each pattern of 8 pixels.
+struct ByteTable
+{
+	ByteTable()
+	{
+		for ( int b = 0; b < 256; b++ )
+		{
+			for ( int k = 0; k < 8; k++ )
+			{
+				mBytes[ b ][ k ] = ( ( b >> k ) & 1 ) ? 255 : 0;
+			}
+		}
+	}
+
+	uint8_t mBytes[ 256 ][ 8 ];
+};
+
+const ByteTable &getByteTable()
+{
+	static const ByteTable table;
+	return table;
+}
+
+//! Filters \a numWords words of a row, preceded and followed by one more word in \a words, with the
+//! pixels within \a radius on both sides. Shifting in the bits of the neighbouring words moves the
+//! pixels across the word boundaries.
+template< bool kErode >
+void morphRow( const uint64_t *words, int numWords, int radius, uint64_t *dst )
+{
+	for ( int j = 0; j < numWords; j++ )
+	{
+		const uint64_t prev = words[ j ];
+		const uint64_t cur = words[ j + 1 ];
+		const uint64_t next = words[ j + 2 ];
+		uint64_t acc = cur;
+		for ( int k = 1; k <= radius; k++ )
+		{
+			const uint64_t left = ( cur << k ) | ( prev >> ( 64 - k ) ); // pixel x - k
+			const uint64_t right = ( cur >> k ) | ( next << ( 64 - k ) ); // pixel x + k
+			acc = kErode ? ( acc & left & right ) : ( acc | left | right );
+		}
+		dst[ j ] = acc;
+	}
+}
+
+//! Combines the \a numRows filtered rows from \a rows of \a numWords words each into \a dst.
+template< bool kErode >
+void morphColumns( const uint64_t *rows, int numWords, int numRows, uint64_t *dst )
+{
+	std::memcpy( dst, rows, numWords * sizeof( uint64_t ) );
+	for ( int k = 1; k < numRows; k++ )
+	{
+		const uint64_t *row = rows + size_t( k ) * numWords;
+		for ( int j = 0; j < numWords; j++ )
+		{
+			dst[ j ] = kErode ? ( dst[ j ] & row[ j ] ) : ( dst[ j ] | row[ j ] );
+		}
+	}
+}
+
+} // anonymous namespace
+
+void BitMask::create( const cv::Size &size )
+{
+	if ( ( size.width == mWidth ) && ( size.height == mHeight ) )
+	{
+		return;
+	}
+	mWidth = std::max( size.width, 0 );
+	mHeight = std::max( size.height, 0 );
+	mWordsPerRow = size_t( ( mWidth + 63 ) / 64 );
+	mWords.assign( mWordsPerRow * mHeight, 0 );
+}
+
+void BitMask::copyTo( BitMask &dst ) const
+{
+	dst.mWidth = mWidth;
+	dst.mHeight = mHeight;
+	dst.mWordsPerRow = mWordsPerRow;
+	dst.mWords.assign( mWords.begin(), mWords.end() );
+}
+
+void BitMask::fill( const cv::Rect &area, bool value )
+{
+	const cv::Rect rect = area & cv::Rect( 0, 0, mWidth, mHeight );
+	if ( rect.area() <= 0 )
+	{
+		return;
+	}
+	const int i0 = rect.x >> 6;
+	const int i1 = ( rect.x + rect.width - 1 ) >> 6;
+	for ( int y = rect.y; y < rect.y + rect.height; y++ )
+	{
+		uint64_t *row = getRow( y );
+		for ( int i = i0; i <= i1; i++ )
+		{
+			const uint64_t m = wordMask( i, rect.x, rect.x + rect.width );
+			row[ i ] = value ? ( row[ i ] | m ) : ( row[ i ] & ~m );
+		}
+	}
+}
+
+void BitMask::packRow( const uint8_t *src, int x, int y, int n )
+{
+	uint64_t *row = getRow( y );
+	const int x2 = x + n;
+#if defined( MNDL_BLOBTRACKER_SSE2 )
+	const __m128i zero = _mm_setzero_si128();
+#endif
+	while ( x < x2 )
+	{
+		// the pixels of the word from x
+		const int bit = x & 63;
+		const int count = std::min( 64 - bit, x2 - x );
+		uint64_t bits = 0;
+		int k = 0;
+#if defined( MNDL_BLOBTRACKER_SSE2 )
+		for ( ; k + 16 <= count; k += 16 )
+		{
+			__m128i v = _mm_loadu_si128( reinterpret_cast< const __m128i * >( src + k ) );
+			uint32_t zeros = uint32_t( _mm_movemask_epi8( _mm_cmpeq_epi8( v, zero ) ) );
+			bits |= uint64_t( zeros ^ 0xffff ) << k;
+		}
+#endif
+		for ( ; k < count; k++ )
+		{
+			bits |= uint64_t( src[ k ] != 0 ) << k;
+		}
+
+		const uint64_t m = ( ( count == 64 ) ? ~uint64_t( 0 ) : ( ( uint64_t( 1 ) << count ) - 1 ) ) << bit;
+		uint64_t &word = row[ x >> 6 ];
+		word = ( word & ~m ) | ( bits << bit );
+		src += count;
+		x += count;
+	}
+}
+
+void BitMask::pack( const cv::Mat &mask, const cv::Rect &area )
+{
+	for ( int y = area.y; y < area.y + area.height; y++ )
+	{
+		packRow( mask.ptr< uint8_t >( y ) + area.x, area.x, y, area.width );
+	}
+}
+
+void BitMask::unpack( const cv::Rect &area, cv::Mat &dst ) const
+{
+	const ByteTable &table = getByteTable();
+	const int x2 = area.x + area.width;
+	for ( int y = area.y; y < area.y + area.height; y++ )
+	{
+		const uint64_t *row = getRow( y );
+		uint8_t *d = dst.ptr< uint8_t >( y );
+		int x = area.x;
+		for ( ; ( x < x2 ) && ( x & 7 ); x++ )
+		{
+			d[ x ] = get( x, y ) ? 255 : 0;
+		}
+		// whole bytes of 8 pixels
+		for ( ; x + 8 <= x2; x += 8 )
+		{
+			std::memcpy( d + x, table.mBytes[ ( row[ x >> 6 ] >> ( x & 63 ) ) & 0xff ], 8 );
+		}
+		for ( ; x < x2; x++ )
+		{
+			d[ x ] = get( x, y ) ? 255 : 0;
+		}
+	}
+}
+
+void BitMorphology::apply( const BitMask &src, BitMask &dst, const cv::Rect &area, const cv::Rect &bounds,
+						   int radius, bool erode )
+{
+	const cv::Rect image( 0, 0, dst.getWidth(), dst.getHeight() );
+	const cv::Rect inside = bounds & image;
+	const cv::Rect rect = area & inside;
+	if ( rect.area() <= 0 )
+	{
+		return;
+	}
+	radius = std::min( std::max( radius, 0 ), 63 );
+	const uint64_t fill = erode ? ~uint64_t( 0 ) : 0;
+
+	// the words of the area, with one more on both sides to shift in
+	const int i0 = rect.x >> 6;
+	const int numWords = ( ( rect.x + rect.width - 1 ) >> 6 ) - i0 + 1;
+	const int numPadded = numWords + 2;
+	mBoundsMasks.resize( numPadded );
+	for ( int j = 0; j < numPadded; j++ )
+	{
+		mBoundsMasks[ j ] = wordMask( i0 - 1 + j, inside.x, inside.x + inside.width );
+	}
+
+	// filter the rows within the radius horizontally, the pixels outside the bounds are filled
+	const int numRows = rect.height + 2 * radius;
+	mRows.resize( size_t( numRows ) * numWords );
+	mRowWords.resize( numPadded );
+	for ( int r = 0; r < numRows; r++ )
+	{
+		const int y = rect.y - radius + r;
+		uint64_t *dst = mRows.data() + size_t( r ) * numWords;
+		if ( ( y < inside.y ) || ( y >= inside.y + inside.height ) )
+		{
+			std::fill( dst, dst + numWords, fill );
+			continue;
+		}
+		const uint64_t *row = src.getRow( y );
+		for ( int j = 0; j < numPadded; j++ )
+		{
+			const uint64_t m = mBoundsMasks[ j ];
+			mRowWords[ j ] = ( m != 0 ) ? ( ( row[ i0 - 1 + j ] & m ) | ( fill & ~m ) ) : fill;
+		}
+		if ( erode )
+		{
+			morphRow< true >( mRowWords.data(), numWords, radius, dst );
+		}
+		else
+		{
+			morphRow< false >( mRowWords.data(), numWords, radius, dst );
+		}
+	}
+
+	// then vertically into the area, keeping the pixels outside it
+	for ( int y = 0; y < rect.height; y++ )
+	{
+		if ( erode )
+		{
+			morphColumns< true >( mRows.data() + size_t( y ) * numWords, numWords, 2 * radius + 1, mRowWords.data() );
+		}
+		else
+		{
+			morphColumns< false >( mRows.data() + size_t( y ) * numWords, numWords, 2 * radius + 1, mRowWords.data() );
+		}
+		uint64_t *row = dst.getRow( rect.y + y ) + i0;
+		for ( int j = 0; j < numWords; j++ )
+		{
+			const uint64_t m = wordMask( i0 + j, rect.x, rect.x + rect.width );
+			row[ j ] = ( row[ j ] & ~m ) | ( mRowWords[ j ] & m );
+		}
+	}
+}
+
+} } // namespace mndl::blobtracker
@@ -0,0 +1,333 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstring>
+
+#include "mndl/blobtracker/BlobLabeler.h"
+
+using namespace ci;
+using namespace std;
+
+namespace mndl { namespace blobtracker {
+
+int32_t BlobLabeler::findRoot( int32_t label )
+{
+	int32_t root = label;
+	while ( mParents[ root ] != root )
+	{
+		root = mParents[ root ];
+	}
+	while ( mParents[ label ] != root )
+	{
+		int32_t next = mParents[ label ];
+		mParents[ label ] = root;
+		label = next;
+	}
+	return root;
+}
+
+void BlobLabeler::merge( int32_t a, int32_t b )
+{
+	a = findRoot( a );
+	b = findRoot( b );
+	if ( a == b )
+	{
+		return;
+	}
+	if ( b < a )
+	{
+		std::swap( a, b );
+	}
+
+	// the older label survives, the statistics of the other one are folded into it
+	mParents[ b ] = a;
+	Stats &sa = mStats[ a ];
+	const Stats &sb = mStats[ b ];
+	sa.mArea += sb.mArea;
+	sa.mSumX += sb.mSumX;
+	sa.mSumY += sb.mSumY;
+	sa.mX1 = std::min( sa.mX1, sb.mX1 );
+	sa.mY1 = std::min( sa.mY1, sb.mY1 );
+	sa.mX2 = std::max( sa.mX2, sb.mX2 );
+	sa.mY2 = std::max( sa.mY2, sb.mY2 );
+}
+
+void BlobLabeler::addRun( int32_t y, int32_t x1, int32_t x2, size_t &prev, size_t prevEnd )
+{
+	int32_t label = int32_t( mParents.size() );
+	mParents.push_back( label );
+	int64_t len = x2 - x1;
+	mStats.push_back( { len, ( int64_t( x1 ) + x2 - 1 ) * len / 2, int64_t( y ) * len, x1, y, x2 - 1, y } );
+	mRuns.push_back( { y, x1, x2, label } );
+
+	// runs of the previous row touching this one, diagonals included
+	while ( ( prev < prevEnd ) && ( mRuns[ prev ].mX2 < x1 ) )
+	{
+		prev++;
+	}
+	for ( size_t p = prev; ( p < prevEnd ) && ( mRuns[ p ].mX1 <= x2 ); p++ )
+	{
+		merge( mRuns[ p ].mLabel, label );
+	}
+}
+
+void BlobLabeler::joinRows( size_t prevBegin, size_t prevEnd, size_t begin, size_t end )
+{
+	size_t prev = prevBegin;
+	for ( size_t r = begin; r < end; r++ )
+	{
+		// runs of the previous row touching this one, diagonals included
+		const Run &run = mRuns[ r ];
+		while ( ( prev < prevEnd ) && ( mRuns[ prev ].mX2 < run.mX1 ) )
+		{
+			prev++;
+		}
+		for ( size_t p = prev; ( p < prevEnd ) && ( mRuns[ p ].mX1 <= run.mX2 ); p++ )
+		{
+			merge( mRuns[ p ].mLabel, run.mLabel );
+		}
+	}
+}
+
+void BlobLabeler::clear()
+{
+	mRuns.clear();
+	mParents.clear();
+	mStats.clear();
+	mTop = mBottom = 0;
+	mLastRowBegin = 0;
+}
+
+void BlobLabeler::scan( const cv::Mat &mask, const cv::Point &offset )
+{
+	clear();
+	mTop = offset.y;
+	mBottom = offset.y + mask.rows;
+
+	const int w = mask.cols;
+	size_t prevBegin = 0;
+	size_t prevEnd = 0;
+	for ( int y = 0; y < mask.rows; y++ )
+	{
+		const uint8_t *row = mask.ptr< uint8_t >( y );
+		const int32_t ry = y + offset.y;
+		const size_t curBegin = mRuns.size();
+		size_t prev = prevBegin;
+		int x = 0;
+		while ( x < w )
+		{
+			// skip the background eight pixels at a time
+			uint64_t word;
+			while ( ( x + 8 <= w ) && ( std::memcpy( &word, row + x, 8 ), word == 0 ) )
+			{
+				x += 8;
+			}
+			while ( ( x < w ) && ( row[ x ] == 0 ) )
+			{
+				x++;
+			}
+			if ( x == w )
+			{
+				break;
+			}
+			const int x1 = x;
+			while ( ( x < w ) && ( row[ x ] != 0 ) )
+			{
+				x++;
+			}
+			addRun( ry, x1 + offset.x, x + offset.x, prev, prevEnd );
+		}
+		prevBegin = curBegin;
+		prevEnd = mRuns.size();
+	}
+	mLastRowBegin = prevBegin;
+}
+
+void BlobLabeler::scan( const BitMask &mask, const cv::Rect &area )
+{
+	clear();
+	mTop = area.y;
+	mBottom = area.y + std::max( area.height, 0 );
+	if ( area.width <= 0 )
+	{
+		mBottom = mTop;
+		return;
+	}
+
+	// the pixels outside the area are cleared from the first and the last word
+	const int x2 = area.x + area.width;
+	const int i0 = area.x >> 6;
+	const int i1 = ( x2 - 1 ) >> 6;
+	const uint64_t firstMask = ~uint64_t( 0 ) << ( area.x & 63 );
+	const uint64_t lastMask = ~uint64_t( 0 ) >> ( 63 - ( ( x2 - 1 ) & 63 ) );
+	size_t prevBegin = 0;
+	size_t prevEnd = 0;
+	for ( int y = area.y; y < mBottom; y++ )
+	{
+		const uint64_t *row = mask.getRow( y );
+		const size_t curBegin = mRuns.size();
+		size_t prev = prevBegin;
+		int runStart = -1; // of the run continuing into the next word
+		for ( int i = i0; i <= i1; i++ )
+		{
+			uint64_t bits = row[ i ];
+			bits &= ( i == i0 ) ? firstMask : ~uint64_t( 0 );
+			bits &= ( i == i1 ) ? lastMask : ~uint64_t( 0 );
+			const int base = i << 6;
+			while ( true )
+			{
+				if ( runStart < 0 )
+				{
+					// an empty word is skipped at once
+					if ( bits == 0 )
+					{
+						break;
+					}
+					const int start = countTrailingZeros( bits );
+					runStart = base + start;
+					bits |= ( uint64_t( 1 ) << start ) - 1;
+				}
+				// the run ends at the lowest clear bit, the pixels before it are set
+				if ( bits == ~uint64_t( 0 ) )
+				{
+					break;
+				}
+				const int end = countTrailingZeros( ~bits );
+				addRun( y, runStart, base + end, prev, prevEnd );
+				runStart = -1;
+				bits &= ~( ( uint64_t( 1 ) << end ) - 1 );
+			}
+		}
+		if ( runStart >= 0 )
+		{
+			addRun( y, runStart, x2, prev, prevEnd );
+		}
+		prevBegin = curBegin;
+		prevEnd = mRuns.size();
+	}
+	mLastRowBegin = prevBegin;
+}
+
+void BlobLabeler::append( const BlobLabeler &stripe )
+{
+	const bool seam = ! mRuns.empty() && ( stripe.mTop == mBottom );
+	const size_t prevBegin = mLastRowBegin;
+	const size_t prevEnd = mRuns.size();
+	const int32_t base = int32_t( mParents.size() );
+	if ( mRuns.empty() && mParents.empty() )
+	{
+		mTop = stripe.mTop;
+	}
+
+	for ( int32_t parent : stripe.mParents )
+	{
+		mParents.push_back( parent + base );
+	}
+	mStats.insert( mStats.end(), stripe.mStats.begin(), stripe.mStats.end() );
+	for ( const Run &run : stripe.mRuns )
+	{
+		mRuns.push_back( { run.mY, run.mX1, run.mX2, run.mLabel + base } );
+	}
+
+	if ( seam )
+	{
+		size_t firstRowEnd = prevEnd;
+		while ( ( firstRowEnd < mRuns.size() ) && ( mRuns[ firstRowEnd ].mY == stripe.mTop ) )
+		{
+			firstRowEnd++;
+		}
+		joinRows( prevBegin, prevEnd, prevEnd, firstRowEnd );
+	}
+
+	if ( stripe.mBottom > stripe.mTop )
+	{
+		mLastRowBegin = ( stripe.mLastRowBegin < stripe.mRuns.size() ) ?
+			prevEnd + stripe.mLastRowBegin : mRuns.size();
+		mBottom = stripe.mBottom;
+	}
+}
+
+const vector< BlobLabeler::Component > & BlobLabeler::finish( float minBoundsArea, float maxBoundsArea,
+		bool collectPoints )
+{
+	mComponents.clear();
+	mPoints.clear();
+	mNumRejected = 0;
+
+	// keep the roots within the area limits
+	mComponentIndices.assign( mParents.size(), -1 );
+	for ( size_t l = 0; l < mParents.size(); l++ )
+	{
+		if ( mParents[ l ] != int32_t( l ) )
+		{
+			continue;
+		}
+		const Stats &s = mStats[ l ];
+		cv::Rect bounds( s.mX1, s.mY1, s.mX2 - s.mX1 + 1, s.mY2 - s.mY1 + 1 );
+		float area = float( bounds.width ) * float( bounds.height );
+		if ( ( area < minBoundsArea ) || ( area >= maxBoundsArea ) )
+		{
+			mNumRejected++;
+			continue;
+		}
+		mComponentIndices[ l ] = int32_t( mComponents.size() );
+		vec2 centroid( double( s.mSumX ) / s.mArea, double( s.mSumY ) / s.mArea );
+		mComponents.push_back( { bounds, s.mArea, centroid, 0, 0 } );
+	}
+
+	if ( collectPoints && ! mComponents.empty() )
+	{
+		// count, offset, then fill the run end points of the kept components
+		for ( Run &run : mRuns )
+		{
+			run.mLabel = mComponentIndices[ findRoot( run.mLabel ) ];
+			if ( run.mLabel != -1 )
+			{
+				mComponents[ run.mLabel ].mNumPoints += ( run.mX2 - run.mX1 > 1 ) ? 2 : 1;
+			}
+		}
+		size_t numPoints = 0;
+		for ( Component &c : mComponents )
+		{
+			c.mFirstPoint = numPoints;
+			numPoints += c.mNumPoints;
+			c.mNumPoints = 0;
+		}
+		mPoints.resize( numPoints );
+		for ( const Run &run : mRuns )
+		{
+			if ( run.mLabel == -1 )
+			{
+				continue;
+			}
+			Component &c = mComponents[ run.mLabel ];
+			cv::Point *pts = &mPoints[ c.mFirstPoint + c.mNumPoints ];
+			pts[ 0 ] = cv::Point( run.mX1, run.mY );
+			c.mNumPoints++;
+			if ( run.mX2 - run.mX1 > 1 )
+			{
+				pts[ 1 ] = cv::Point( run.mX2 - 1, run.mY );
+				c.mNumPoints++;
+			}
+		}
+	}
+
+	return mComponents;
+}
+
+} } // namespace mndl::blobtracker
@@ -0,0 +1,212 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <limits>
+
+#include "mndl/blobtracker/BlobMatcher.h"
+
+using namespace ci;
+using namespace std;
+
+namespace mndl { namespace blobtracker {
+
+void BlobMatcher::computeCosts( const vector< vec2 > &trackPos, const vector< vec2 > &blobPos,
+								float maxDistance )
+{
+	mNumTracks = trackPos.size();
+	mNumBlobs = blobPos.size();
+	mMaxCost = maxDistance * maxDistance;
+	mCandidatesCollected = false;
+
+	mCosts.resize( mNumTracks * mNumBlobs );
+	float *cost = mCosts.data();
+	for ( size_t t = 0; t < mNumTracks; t++ )
+	{
+		const vec2 &pT = trackPos[ t ];
+		for ( size_t b = 0; b < mNumBlobs; b++ )
+		{
+			vec2 d = blobPos[ b ] - pT;
+			*cost++ = d.x * d.x + d.y * d.y;
+		}
+	}
+}
+
+void BlobMatcher::computeCandidates( const vector< vec2 > &trackPos, const SpatialGrid &blobGrid, float maxDistance,
+									  size_t maxCandidates )
+{
+	mNumTracks = trackPos.size();
+	mNumBlobs = blobGrid.getNumPoints();
+	mMaxCost = maxDistance * maxDistance;
+	mCandidatesCollected = true;
+
+	mCandidates.clear();
+	for ( size_t t = 0; t < mNumTracks; t++ )
+	{
+		blobGrid.findNearest( trackPos[ t ], maxDistance, maxCandidates, &mNearest );
+		for ( const pair< float, uint32_t > &blob : mNearest )
+		{
+			mCandidates.push_back( { blob.first, uint32_t( t ), blob.second } );
+		}
+	}
+}
+
+const vector< int32_t > & BlobMatcher::matchGreedy()
+{
+	mAssignment.assign( mNumTracks, -1 );
+
+	if ( ! mCandidatesCollected )
+	{
+		mCandidates.clear();
+		for ( size_t t = 0; t < mNumTracks; t++ )
+		{
+			for ( size_t b = 0; b < mNumBlobs; b++ )
+			{
+				if ( ! isGated( t, b ) )
+				{
+					mCandidates.push_back( { mCosts[ t * mNumBlobs + b ], uint32_t( t ), uint32_t( b ) } );
+				}
+			}
+		}
+	}
+	std::sort( mCandidates.begin(), mCandidates.end() );
+
+	mBlobTaken.assign( mNumBlobs, false );
+	size_t numMatchesLeft = std::min( mNumTracks, mNumBlobs );
+	for ( const Candidate &c : mCandidates )
+	{
+		if ( numMatchesLeft == 0 )
+		{
+			break;
+		}
+		if ( ( mAssignment[ c.mTrack ] == -1 ) && ! mBlobTaken[ c.mBlob ] )
+		{
+			mAssignment[ c.mTrack ] = c.mBlob;
+			mBlobTaken[ c.mBlob ] = true;
+			numMatchesLeft--;
+		}
+	}
+
+	return mAssignment;
+}
+
+/** Shortest augmenting path Hungarian algorithm, O(n^2 m) for n rows and m >= n columns.
+ * Gated pairs get a cost larger than any valid assignment could sum up to, so the
+ * solver first maximizes the number of valid matches, then minimizes their total cost.
+ * Assignments that still end up on a gated pair are discarded.
+ */
+const vector< int32_t > & BlobMatcher::matchHungarian()
+{
+	mAssignment.assign( mNumTracks, -1 );
+	if ( ( mNumTracks == 0 ) || ( mNumBlobs == 0 ) )
+	{
+		return mAssignment;
+	}
+
+	// rows are the smaller dimension
+	const bool transposed = mNumTracks > mNumBlobs;
+	const size_t n = transposed ? mNumBlobs : mNumTracks;
+	const size_t m = transposed ? mNumTracks : mNumBlobs;
+	const double gatedCost = ( double( mMaxCost ) + 1.0 ) * double( n + 1 );
+	auto cost = [ & ]( size_t row, size_t col ) -> double
+	{
+		size_t t = transposed ? col : row;
+		size_t b = transposed ? row : col;
+		float c = mCosts[ t * mNumBlobs + b ];
+		return ( c > mMaxCost ) ? gatedCost : double( c );
+	};
+
+	const double inf = numeric_limits< double >::max();
+	mU.assign( n + 1, 0.0 );
+	mV.assign( m + 1, 0.0 );
+	mP.assign( m + 1, 0 );
+	mWay.assign( m + 1, 0 );
+
+	// arrays are 1-based, column 0 is the virtual start of each augmenting path
+	for ( size_t i = 1; i <= n; i++ )
+	{
+		mP[ 0 ] = int32_t( i );
+		size_t j0 = 0;
+		mMinV.assign( m + 1, inf );
+		mUsed.assign( m + 1, false );
+		do
+		{
+			mUsed[ j0 ] = true;
+			size_t i0 = mP[ j0 ];
+			size_t j1 = 0;
+			double delta = inf;
+			for ( size_t j = 1; j <= m; j++ )
+			{
+				if ( ! mUsed[ j ] )
+				{
+					double cur = cost( i0 - 1, j - 1 ) - mU[ i0 ] - mV[ j ];
+					if ( cur < mMinV[ j ] )
+					{
+						mMinV[ j ] = cur;
+						mWay[ j ] = int32_t( j0 );
+					}
+					if ( mMinV[ j ] < delta )
+					{
+						delta = mMinV[ j ];
+						j1 = j;
+					}
+				}
+			}
+			for ( size_t j = 0; j <= m; j++ )
+			{
+				if ( mUsed[ j ] )
+				{
+					mU[ mP[ j ] ] += delta;
+					mV[ j ] -= delta;
+				}
+				else
+				{
+					mMinV[ j ] -= delta;
+				}
+			}
+			j0 = j1;
+		} while ( mP[ j0 ] != 0 );
+
+		// invert the augmenting path
+		do
+		{
+			size_t j1 = mWay[ j0 ];
+			mP[ j0 ] = mP[ j1 ];
+			j0 = j1;
+		} while ( j0 != 0 );
+	}
+
+	for ( size_t j = 1; j <= m; j++ )
+	{
+		if ( mP[ j ] == 0 )
+		{
+			continue;
+		}
+		size_t row = mP[ j ] - 1;
+		size_t col = j - 1;
+		size_t t = transposed ? col : row;
+		size_t b = transposed ? row : col;
+		if ( ! isGated( t, b ) )
+		{
+			mAssignment[ t ] = int32_t( b );
+		}
+	}
+
+	return mAssignment;
+}
+
+} } // namespace mndl::blobtracker
@@ -0,0 +1,122 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <utility>
+
+#include "mndl/blobtracker/BlobPool.h"
+
+using namespace ci;
+using namespace std;
+
+namespace mndl { namespace blobtracker {
+
+BlobHandle BlobPool::add()
+{
+	uint32_t slot;
+	if ( ! mFreeSlots.empty() )
+	{
+		slot = mFreeSlots.back();
+		mFreeSlots.pop_back();
+	}
+	else
+	{
+		slot = uint32_t( mSlots.size() );
+		mSlots.push_back( { 0, 1 } );
+		// there are never more free slots and spare hulls than slots, so removeAt() does not allocate
+		mFreeSlots.reserve( mSlots.capacity() );
+		mSpareHulls.reserve( mSlots.capacity() );
+	}
+
+	uint32_t index = uint32_t( mIds.size() );
+	mSlots[ slot ].mIndex = index;
+	mIndexSlots.push_back( slot );
+
+	mIds.push_back( -1 );
+	mPositions.push_back( vec2( 0.f ) );
+	mPrevPositions.push_back( vec2( 0.f ) );
+	mVelocities.push_back( vec2( 0.f ) );
+	mBounds.push_back( Rectf() );
+	if ( ! mSpareHulls.empty() )
+	{
+		mConvexHulls.push_back( std::move( mSpareHulls.back() ) );
+		mSpareHulls.pop_back();
+		mConvexHulls.back().getPoints().clear();
+		mConvexHulls.back().setClosed( false );
+	}
+	else
+	{
+		mConvexHulls.push_back( PolyLine2f() );
+	}
+
+	return BlobHandle( slot, mSlots[ slot ].mGeneration );
+}
+
+void BlobPool::removeAt( size_t index )
+{
+	// the slot is invalidated for the handles still held, 0 is skipped on wrap around
+	uint32_t slot = mIndexSlots[ index ];
+	if ( ++mSlots[ slot ].mGeneration == 0 )
+	{
+		mSlots[ slot ].mGeneration = 1;
+	}
+	mFreeSlots.push_back( slot );
+
+	size_t last = mIds.size() - 1;
+	if ( index != last )
+	{
+		uint32_t lastSlot = mIndexSlots[ last ];
+		mSlots[ lastSlot ].mIndex = uint32_t( index );
+		mIndexSlots[ index ] = lastSlot;
+		mIds[ index ] = mIds[ last ];
+		mPositions[ index ] = mPositions[ last ];
+		mPrevPositions[ index ] = mPrevPositions[ last ];
+		mVelocities[ index ] = mVelocities[ last ];
+		mBounds[ index ] = mBounds[ last ];
+		std::swap( mConvexHulls[ index ], mConvexHulls[ last ] );
+	}
+
+	mIndexSlots.pop_back();
+	mIds.pop_back();
+	mPositions.pop_back();
+	mPrevPositions.pop_back();
+	mVelocities.pop_back();
+	mBounds.pop_back();
+	mSpareHulls.push_back( std::move( mConvexHulls.back() ) );
+	mConvexHulls.pop_back();
+}
+
+void BlobPool::clear()
+{
+	while ( ! mIds.empty() )
+	{
+		removeAt( mIds.size() - 1 );
+	}
+}
+
+void BlobPool::update( size_t index, const BlobPool &src, size_t srcIndex )
+{
+	mPrevPositions[ index ] = mPositions[ index ];
+	mPositions[ index ] = src.mPositions[ srcIndex ];
+	mBounds[ index ] = src.mBounds[ srcIndex ];
+
+	const PolyLine2f &srcHull = src.mConvexHulls[ srcIndex ];
+	PolyLine2f &hull = mConvexHulls[ index ];
+	hull.getPoints().assign( srcHull.getPoints().begin(), srcHull.getPoints().end() );
+	hull.setClosed( srcHull.isClosed() );
+}
+
+} } // namespace mndl::blobtracker
@@ -18,12 +18,14 @@
  and Patricio Gonzalez Vivo for ofxBlobTracker,
  https://github.com/patriciogonzalezvivo/ofxBlobTracker
 */
-#include <list>
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
 
 #include "cinder/Area.h"
 #include "cinder/Rect.h"
 #include "cinder/app/App.h"
-#include "cinder/ip/Fill.h"
+#include "cinder/CinderMath.h"
 
 #include "mndl/blobtracker/BlobTracker.h"
 
@@ -33,257 +35,1264 @@ using namespace std;
 namespace mndl { namespace blobtracker {
 
 BlobTracker::BlobTracker( const Options &options ) :
-	mIdCounter( 1 ),
-	mOptions( options )
+	mOptionsCell( std::make_shared< Options >( options ) ),
+	mOptions( mOptionsCell.load() ),
+	mIdCounter( 1 )
 {}
 
-void BlobTracker::update( const Channel8u &inputChannel )
+BlobTracker::~BlobTracker()
 {
-	cv::Mat input( toOcv( inputChannel ) );
-	if ( mOptions.mFlip )
+	stopWorker();
+}
+
+void BlobTracker::update( const InputFrame &input )
+{
+	MNDL_BLOBTRACKER_STAT( uint64_t start = Stats::now() );
+	const DetectionSetupRef &setup = acquireSetup( input.getSize() );
+	// this thread also tracks
+	mOptions = setup->mOptions;
+
+	// between detections the tracks coast on their velocity
+	bool detectionDue = ( mOptions->mDetectionInterval <= 1 ) ||
+						( mNumUpdates % uint64_t( mOptions->mDetectionInterval ) == 0 );
+	mNumUpdates++;
+	if ( ! detectionDue )
 	{
-		cv::flip( input, input, 1 );
+		extrapolateTracks( FrameResult::getCurrentTime() );
+		MNDL_BLOBTRACKER_STAT( mStats.mNumExtrapolatedFrames++ );
 	}
-	if ( mOptions.mBlankOutsideRoi )
+	else
 	{
-		int w = inputChannel.getWidth();
-		int h = inputChannel.getHeight();
-		Channel8u src( fromOcv( input ) );
-		Area insideArea( mOptions.mNormalizedRegionOfInterest.scaled( inputChannel.getSize() ) );
+		mDetection.mTimestamp = FrameResult::getCurrentTime();
+		mDetection.mSetup = setup;
+		detectBlobs( input, *setup, &mDetection, &mBackground, getStripePool( *mOptions ) );
+		applyResult( mDetection );
+	}
+
+	MNDL_BLOBTRACKER_STAT( mStats.addStageTime( Stats::Stage::UPDATE, Stats::now() - start ) );
+}
+
+void BlobTracker::updateAsync( const InputFrame &input )
+{
+	if ( ! mWorker.joinable() )
+	{
+		startWorker();
+	}
+
+	input.copyTo( mPostFrame.mInput );
+	mPostFrame.mSetup = acquireSetup( input.getSize() );
+	mPostFrame.mTimestamp = FrameResult::getCurrentTime();
+	mMailbox.post( mPostFrame );
+}
 
-		uint8_t fillColor = mOptions.mThresholdInvertEnabled ? 255 : 0;
-		ci::ip::fill( &src, fillColor, Area( ivec2( 0, 0 ),
-										  ivec2( w, insideArea.y1 ) ) );
-		ci::ip::fill( &src, fillColor, Area( ivec2( 0, insideArea.y1 ),
-										  ivec2( insideArea.x1, insideArea.y2 ) ) );
-		ci::ip::fill( &src, fillColor, Area( ivec2( 0, insideArea.y2 ),
-										  ivec2( w, h ) ) );
-		ci::ip::fill( &src, fillColor, Area( ivec2( insideArea.x2, insideArea.y1 ),
-										  ivec2( w, insideArea.y2 ) ) );
-		input = toOcv( src );
+bool BlobTracker::dispatchEvents()
+{
+	if ( ! mResults.acquire() )
+	{
+		return false;
 	}
 
-	mInput = input.clone();
+	MNDL_BLOBTRACKER_STAT( uint64_t start = Stats::now() );
+	applyResult( mResults.getReadBuffer() );
+	MNDL_BLOBTRACKER_STAT( mStats.addStageTime( Stats::Stage::UPDATE, Stats::now() - start ) );
+	return true;
+}
 
-	cv::Mat thresholded;
-	cv::blur( input, mBlurred, cv::Size( mOptions.mBlurSize, mOptions.mBlurSize ) );
-	cv::threshold( mBlurred, thresholded, mOptions.mThreshold, 255,
-			mOptions.mThresholdInvertEnabled ? CV_THRESH_BINARY_INV : CV_THRESH_BINARY );
-	mThresholded = thresholded.clone();
+void BlobTracker::applyResult( DetectionResult &result )
+{
+	// the frame is tracked with the options it was detected with
+	mOptions = result.mSetup->mOptions;
+	if ( mOptions->mDebugImagesEnabled && ( result.mLabelMask != nullptr ) )
+	{
+		// the result's mask is overwritten by the next detection, getImageThresholded() unpacks the copy
+		mInput = result.mInput;
+		mBlurred = result.mBlurred;
+		mThresholded = cv::Mat();
+		result.mLabelMask->copyTo( mThresholdedBits );
+		mThresholdedUnpacked = false;
+	}
+	else if ( mOptions->mDebugImagesEnabled )
+	{
+		mInput = result.mInput;
+		mBlurred = result.mBlurred;
+		mThresholded = result.mThresholded;
+		mThresholdedBits.create( cv::Size() );
+	}
+	else
+	{
+		mInput = mBlurred = mThresholded = cv::Mat();
+		mThresholdedBits.create( cv::Size() );
+	}
+	mNumTiles = result.mNumTiles;
+	mNumDirtyTiles = result.mNumDirtyTiles;
+	MNDL_BLOBTRACKER_STAT( addDetectionStats( result ) );
 
-	vector< vector< cv::Point > > contours;
-	cv::findContours( thresholded, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE );
+	// an unchanged incremental frame still has the blobs tracked last
+	if ( ( &result == mTrackedResult ) && ( result.mBlobsVersion == mTrackedBlobsVersion ) )
+	{
+		MNDL_BLOBTRACKER_STAT( mStats.mNumUnchangedFrames++ );
+		return;
+	}
+	mTrackedResult = &result;
+	mTrackedBlobsVersion = result.mBlobsVersion;
+	mNextFrameResult = mFrameResultCache.acquire();
+	mNextFrameResult->mFrameNumber = mNumFrames++;
+	mNextFrameResult->mTimestamp = result.mTimestamp;
+	MNDL_BLOBTRACKER_STAT( uint64_t trackStart = Stats::now() );
+	trackBlobs( result.mBlobs, result.mTimestamp );
+	mBlobsViewDirty = true;
+#if MNDL_BLOBTRACKER_STATS
+	mStats.addStageTime( Stats::Stage::TRACK, Stats::now() - trackStart );
+	mStats.mMatches.add( mNextFrameResult->mMoved.size() );
+	mStats.mBirths.add( mNextFrameResult->mBegan.size() );
+	mStats.mDeaths.add( mNextFrameResult->mEnded.size() );
+	mStats.mBlobs.add( mBlobs.getSize() );
+	mStats.mNumTrackedFrames++;
+#endif
 
-	float surfArea = inputChannel.getWidth() * inputChannel.getHeight();
-	float minAreaLimit = surfArea * mOptions.mMinArea;
-	float maxAreaLimit = surfArea * mOptions.mMaxArea;
+	// the frame result is immutable from here
+	mFrameResult = std::move( mNextFrameResult );
+	emitSignals( mFrameResult );
+}
 
-	// normalizes blob coordinates from camera 2d coords to [0, mOptions.mNormalizationScale]
-	ci::RectMapping normMapping( Rectf( inputChannel.getBounds() ),
-								 Rectf( 0.f, 0.f, mOptions.mNormalizationScale, mOptions.mNormalizationScale ) );
-	ci::Rectf roi = mOptions.mNormalizedRegionOfInterest * mOptions.mNormalizationScale;
-	vector< BlobRef > newBlobs;
-	for ( vector< cv::Point > contourPnts : contours )
+const BlobTracker::DetectionSetupRef &BlobTracker::acquireSetup( const cv::Size &inputSize )
+{
+	// one snapshot of the options for the whole frame, the derived values are only recalculated for a new one.
+	// mOptions belongs to the tracking thread, which takes the snapshot from the result
+	OptionsRef options = mOptionsCell.load();
+	if ( ! mSetup || ( mSetup->mOptions != options ) || ( mSetup->mInputSize != inputSize ) )
+	{
+		mSetup = std::make_shared< DetectionSetup >( options, inputSize );
+	}
+	return mSetup;
+}
+
+void BlobTracker::extrapolateTracks( double timestamp )
+{
+	mNextFrameResult = mFrameResultCache.acquire();
+	mNextFrameResult->mFrameNumber = mNumFrames++;
+	mNextFrameResult->mTimestamp = timestamp;
+	mNextFrameResult->mExtrapolated = true;
+
+	// the velocities are left over from before if prediction has been disabled since
+	float dt = mOptions->mPredictionEnabled ? float( timestamp - mLastFrameTime ) : 0.f;
+	mLastFrameTime = timestamp;
+	for ( size_t i = 0; i < mBlobs.getSize(); i++ )
+	{
+		vec2 delta = mBlobs.mVelocities[ i ] * dt;
+		mBlobs.mPrevPositions[ i ] = mBlobs.mPositions[ i ];
+		mBlobs.mPositions[ i ] += delta;
+		if ( mOptions->mBoundsEnabled )
+		{
+			mBlobs.mBounds[ i ].offset( delta );
+		}
+		for ( vec2 &pt : mBlobs.mConvexHulls[ i ].getPoints() )
+		{
+			pt += delta;
+		}
+
+		if ( glm::length( delta ) > 0.001f )
+		{
+			mNextFrameResult->append( mNextFrameResult->mMoved, mBlobs, i );
+		}
+	}
+	mBlobsViewDirty = true;
+
+	mFrameResult = std::move( mNextFrameResult );
+	emitSignals( mFrameResult );
+}
+
+void BlobTracker::emitSignals( const FrameResultRef &frameResult )
+{
+	MNDL_BLOBTRACKER_STAT( uint64_t start = Stats::now() );
+	mFrameSig.emit( frameResult );
+
+	// same order as the tracking steps
+	const FrameResult &frame = *frameResult;
+	for ( const FrameResult::BlobState &blob : frame.getEnded() )
+	{
+		mBlobsEndedSig.emit( BlobEvent( frameResult, blob ) );
+	}
+	for ( const FrameResult::BlobState &blob : frame.getMoved() )
+	{
+		mBlobsMovedSig.emit( BlobEvent( frameResult, blob ) );
+	}
+	for ( const FrameResult::BlobState &blob : frame.getBegan() )
+	{
+		mBlobsBeganSig.emit( BlobEvent( frameResult, blob ) );
+	}
+	MNDL_BLOBTRACKER_STAT( mStats.addStageTime( Stats::Stage::SIGNALS, Stats::now() - start ) );
+}
+
+void BlobTracker::addDetectionStats( const DetectionResult &result )
+{
+	const DetectionStats &stats = result.mStats;
+	for ( int i = 0; i < Stats::kNumStages; i++ )
+	{
+		// the stages the detection skipped get no sample
+		if ( stats.mStageTimes[ i ] > 0 )
+		{
+			mStats.mStageTimes[ i ].add( stats.mStageTimes[ i ] );
+		}
+	}
+	mStats.mContours.add( stats.mContours );
+	mStats.mRejectedByArea.add( stats.mRejectedByArea );
+	mStats.mRejectedByRoi.add( stats.mRejectedByRoi );
+	mStats.mReallocations.add( stats.mReallocations );
+	if ( result.mNumTiles > 0 )
+	{
+		mStats.mDirtyTiles.add( result.mNumDirtyTiles );
+	}
+	mStats.mNumDetections++;
+}
+
+cv::Mat BlobTracker::getImageThresholded() const
+{
+	if ( mThresholdedBits.empty() )
+	{
+		return mThresholded;
+	}
+	if ( ! mThresholdedUnpacked )
+	{
+		mUnpackedThresholded.create( mThresholdedBits.getSize(), CV_8UC1 );
+		mThresholdedBits.unpack( cv::Rect( 0, 0, mThresholdedBits.getWidth(), mThresholdedBits.getHeight() ),
+								 mUnpackedThresholded );
+		mThresholdedUnpacked = true;
+	}
+	return mUnpackedThresholded;
+}
+
+const vector< BlobRef > & BlobTracker::getBlobs() const
+{
+	if ( mBlobsViewDirty )
+	{
+		size_t numBlobs = mBlobs.getSize();
+		mBlobsView.resize( numBlobs );
+		for ( size_t i = 0; i < numBlobs; i++ )
+		{
+			// the objects the application no longer holds are reused
+			BlobRef &blob = mBlobsView[ i ];
+			if ( blob && isSoleOwner( blob ) )
+			{
+				blob->set( mBlobs, i );
+			}
+			else
+			{
+				blob = Blob::create( mBlobs, i );
+			}
+		}
+		mBlobsViewDirty = false;
+	}
+	return mBlobsView;
+}
+
+void BlobTracker::startWorker()
+{
+	mWorker = thread( &BlobTracker::workerLoop, this );
+}
+
+void BlobTracker::stopWorker()
+{
+	if ( mWorker.joinable() )
+	{
+		mMailbox.close();
+		mWorker.join();
+	}
+}
+
+void BlobTracker::workerLoop()
+{
+	while ( mMailbox.waitTake( mWorkerFrame ) )
+	{
+		DetectionResult &result = mResults.getWriteBuffer();
+		result.mTimestamp = mWorkerFrame.mTimestamp;
+		result.mSetup = mWorkerFrame.mSetup;
+		const DetectionSetup &setup = *mWorkerFrame.mSetup;
+		detectBlobs( mWorkerFrame.mInput, setup, &result, &mBackground, getStripePool( *setup.mOptions ) );
+		mResults.publish();
+	}
+}
+
+WorkStealingPool *BlobTracker::getStripePool( const Options &options )
+{
+	if ( options.mNumThreads <= 1 )
+	{
+		return nullptr;
+	}
+
+	// the detecting thread works on the stripes too
+	size_t numWorkers = size_t( options.mNumThreads - 1 );
+	if ( ! mStripePool || ( mStripePool->getNumThreads() != numWorkers ) )
+	{
+		mStripePool = WorkStealingPool::create( numWorkers );
+	}
+	return mStripePool.get();
+}
+
+namespace {
+
+//! Returns the normalized region of interest in pixels, clamped to the image.
+cv::Rect roiToPixels( const Rectf &normalizedRoi, int w, int h )
+{
+	Area area( normalizedRoi.scaled( vec2( w, h ) ) );
+	int x1 = math< int32_t >::clamp( area.x1, 0, w );
+	int y1 = math< int32_t >::clamp( area.y1, 0, h );
+	int x2 = math< int32_t >::clamp( area.x2, x1, w );
+	int y2 = math< int32_t >::clamp( area.y2, y1, h );
+	return cv::Rect( x1, y1, x2 - x1, y2 - y1 );
+}
+
+//! Grows \a rect by \a margin on each side, clamped to the image.
+cv::Rect growRect( const cv::Rect &rect, int margin, int w, int h )
+{
+	int x1 = std::max( rect.x - margin, 0 );
+	int y1 = std::max( rect.y - margin, 0 );
+	int x2 = std::min( rect.x + rect.width + margin, w );
+	int y2 = std::min( rect.y + rect.height + margin, h );
+	return cv::Rect( x1, y1, x2 - x1, y2 - y1 );
+}
+
+//! Stripes are not made thinner than this, so the work per task outweighs the scheduling and seam merging.
+const int kMinStripeHeight = 32;
+
+//! Returns \a rect in the coordinates of an image downscaled by \a scale, clamped to \a size.
+//! The result covers every block \a rect touches if \a cover is true, otherwise only the blocks fully inside.
+cv::Rect shrinkRect( const cv::Rect &rect, int scale, const cv::Size &size, bool cover )
+{
+	int round = cover ? 0 : scale - 1;
+	int x1 = std::min( ( rect.x + round ) / scale, size.width );
+	int y1 = std::min( ( rect.y + round ) / scale, size.height );
+	int x2 = std::min( ( rect.x + rect.width + scale - 1 - round ) / scale, size.width );
+	int y2 = std::min( ( rect.y + rect.height + scale - 1 - round ) / scale, size.height );
+	return cv::Rect( x1, y1, std::max( x2 - x1, 0 ), std::max( y2 - y1, 0 ) );
+}
+
+//! Returns the deepest pyramid level where the smallest blob allowed by the minimum area is still
+//! options.mPyramidMinBlobSize pixels wide.
+int choosePyramidLevel( const BlobTracker::Options &options, int w, int h )
+{
+	float minBlobSize = math< float >::sqrt( float( w ) * float( h ) * options.mMinArea );
+	int level = 0;
+	while ( ( level < options.mMaxPyramidLevel ) &&
+			( ( w >> ( level + 1 ) ) > 0 ) && ( ( h >> ( level + 1 ) ) > 0 ) &&
+			( minBlobSize / float( 2 << level ) >= options.mPyramidMinBlobSize ) )
+	{
+		level++;
+	}
+	return level;
+}
+
+//! Returns whether \a options threshold into a bit mask.
+bool isBitMaskUsed( const BlobTracker::Options &options )
+{
+	return options.mBitMaskEnabled && ( options.mDetectionMode == BlobTracker::Options::DetectionMode::LABELS );
+}
+
+//! Returns whether the images blurred and thresholded with \a a are valid for \a b.
+bool samePreprocessing( const BlobTracker::Options &a, const BlobTracker::Options &b )
+{
+	return ( a.mBlurSize == b.mBlurSize ) && ( a.mThreshold == b.mThreshold ) &&
+		   ( a.mThresholdInvertEnabled == b.mThresholdInvertEnabled ) &&
+		   ( a.mAdaptiveThresholdEnabled == b.mAdaptiveThresholdEnabled ) &&
+		   ( a.mAdaptiveThresholdBlockSize == b.mAdaptiveThresholdBlockSize ) &&
+		   ( a.mAdaptiveThresholdOffset == b.mAdaptiveThresholdOffset ) && ( a.mPreprocessMode == b.mPreprocessMode ) &&
+		   ( a.mDebugImagesEnabled == b.mDebugImagesEnabled ) &&
+		   ( a.mBackgroundSubtractionEnabled == b.mBackgroundSubtractionEnabled ) &&
+		   ( isBitMaskUsed( a ) == isBitMaskUsed( b ) ) && ( a.mMorphology == b.mMorphology ) &&
+		   ( a.mMorphologyRadius == b.mMorphologyRadius );
+}
+
+//! Returns whether the blobs extracted from the same thresholded image with \a a are valid for \a b.
+bool sameExtraction( const BlobTracker::Options &a, const BlobTracker::Options &b )
+{
+	const Rectf &roiA = a.mNormalizedRegionOfInterest;
+	const Rectf &roiB = b.mNormalizedRegionOfInterest;
+	return ( a.mBoundsEnabled == b.mBoundsEnabled ) && ( a.mConvexHullEnabled == b.mConvexHullEnabled ) &&
+		   ( a.mNormalizationScale == b.mNormalizationScale ) &&
+		   ( a.mMinArea == b.mMinArea ) && ( a.mMaxArea == b.mMaxArea ) &&
+		   ( roiA.x1 == roiB.x1 ) && ( roiA.y1 == roiB.y1 ) && ( roiA.x2 == roiB.x2 ) && ( roiA.y2 == roiB.y2 ) &&
+		   ( a.mDetectionMode == b.mDetectionMode ) && ( a.mPyramidRefinementEnabled == b.mPyramidRefinementEnabled );
+}
+
+} // anonymous namespace
+
+template< int kFlags >
+void BlobTracker::extractBlobs( const DetectionSetup &setup, const cv::Mat &src, int numStripes, DetectionResult *result )
+{
+	const Options &options = *setup.mOptions;
+	// compile-time flags unless generic
+	const bool boundsEnabled = ( kFlags & kExtractGeneric ) ? options.mBoundsEnabled : ( ( kFlags & kExtractBounds ) != 0 );
+	const bool convexHullEnabled = ( kFlags & kExtractGeneric ) ?
+		options.mConvexHullEnabled : ( ( kFlags & kExtractConvexHull ) != 0 );
+	const cv::Mat thresholded = setup.mBitMaskEnabled ? cv::Mat() : result->mThresholded( setup.mLevelArea );
+	const cv::Rect &levelArea = setup.mLevelArea;
+	const int level = setup.mLevel;
+	const int levelScale = setup.mLevelScale;
+	const float minAreaLimit = setup.mMinAreaLimit;
+	const float maxAreaLimit = setup.mMaxAreaLimit;
+	const bool labelsEnabled = options.mDetectionMode == Options::DetectionMode::LABELS;
+	const ci::RectMapping &normMapping = setup.mNormMapping;
+	const ci::Rectf &roi = setup.mRoi;
+	BlobPool &newBlobs = result->mBlobs;
+	result->clearBlobs();
+
+	// adds a blob from its bounds and centroid in level pixels, the hull is calculated from \a points
+	auto addBlob = [ & ]( cv::Rect cvRect, vec2 centroid, cv::Mat points )
+	{
+		// level pixel centers are at the center of their block
+		float pointScale = float( levelScale );
+		float pointOffset = ( levelScale - 1 ) * .5f;
+		if ( ( level > 0 ) && options.mPyramidRefinementEnabled &&
+			 refineBlob( src, setup, result, &cvRect, &centroid, &points ) )
+		{
+			pointScale = 1.f;
+			pointOffset = 0.f;
+		}
+		else
+		{
+			cvRect = cv::Rect( cvRect.x * levelScale, cvRect.y * levelScale,
+							   cvRect.width * levelScale, cvRect.height * levelScale );
+			centroid = centroid * pointScale + vec2( pointOffset );
+		}
+
+		vec2 pos = normMapping.map( centroid );
+		if ( ! roi.contains( pos ) )
+		{
+			MNDL_BLOBTRACKER_STAT( result->mStats.mRejectedByRoi++ );
+			return;
+		}
+
+		size_t i = newBlobs.getIndex( newBlobs.add() );
+		newBlobs.mPositions[ i ] = newBlobs.mPrevPositions[ i ] = pos;
+
+		if ( boundsEnabled )
+		{
+			newBlobs.mBounds[ i ] = normMapping.map( Rectf( cvRect.x, cvRect.y,
+															cvRect.x + cvRect.width, cvRect.y + cvRect.height ) );
+		}
+
+		if ( convexHullEnabled )
+		{
+			MNDL_BLOBTRACKER_STAT( result->mStats.enter( Stats::Stage::HULL ) );
+			cv::convexHull( points, result->mHull );
+			PolyLine2f &hull = newBlobs.mConvexHulls[ i ];
+			for ( const cv::Point &pt : result->mHull )
+			{
+				hull.push_back( normMapping.map( fromOcv( pt ) * pointScale + vec2( pointOffset ) ) );
+			}
+			hull.setClosed();
+			MNDL_BLOBTRACKER_STAT( result->mStats.enter( Stats::Stage::EXTRACT ) );
+		}
+	};
+
+	if ( labelsEnabled )
+	{
+		// the labeler only reads the mask, no copy is needed for the debug image
+		BlobLabeler &labeler = result->mLabeler;
+		if ( numStripes > 1 )
+		{
+			labeler.clear();
+			for ( const DetectionResult::Stripe &stripe : result->mStripes )
+			{
+				labeler.append( stripe.mLabeler );
+			}
+		}
+		else if ( result->mLabelMask != nullptr )
+		{
+			labeler.scan( *result->mLabelMask, levelArea );
+		}
+		else
+		{
+			labeler.scan( thresholded, levelArea.tl() );
+		}
+		const vector< BlobLabeler::Component > &components = labeler.finish( minAreaLimit, maxAreaLimit,
+				convexHullEnabled );
+		const vector< cv::Point > &points = labeler.getPoints();
+#if MNDL_BLOBTRACKER_STATS
+		result->mStats.mContours = uint32_t( components.size() + labeler.getNumRejected() );
+		result->mStats.mRejectedByArea = uint32_t( labeler.getNumRejected() );
+#endif
+		for ( const BlobLabeler::Component &c : components )
+		{
+			cv::Mat pmat;
+			if ( convexHullEnabled )
+			{
+				pmat = cv::Mat( int( c.mNumPoints ), 1, CV_32SC2, const_cast< cv::Point * >( &points[ c.mFirstPoint ] ) );
+			}
+			addBlob( c.mBounds, c.mCentroid, pmat );
+		}
+		return;
+	}
+
+	// findContours modifies its input, trace a copy if the thresholded image is kept
+	cv::Mat contourImage = thresholded;
+	if ( options.mDebugImagesEnabled || options.mIncrementalEnabled )
+	{
+		thresholded.copyTo( result->mContourImage );
+		contourImage = result->mContourImage;
+	}
+	vector< vector< cv::Point > > &contours = result->mContours;
+	cv::findContours( contourImage, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE, levelArea.tl() );
+	MNDL_BLOBTRACKER_STAT( result->mStats.mContours = uint32_t( contours.size() ) );
+
+	for ( const vector< cv::Point > &contourPnts : contours )
 	{
-		BlobRef b = Blob::create();
 		cv::Mat pmat = cv::Mat( contourPnts );
 		cv::Rect cvRect = cv::boundingRect( pmat );
 		float area = cvRect.width * cvRect.height;
 		if ( ( minAreaLimit <= area ) && ( area < maxAreaLimit ) )
 		{
 			cv::Moments m = cv::moments( pmat );
-			b->mPos = vec2( m.m10 / m.m00, m.m01 / m.m00 );
-			b->mPos = b->mPrevPos = normMapping.map( b->mPos );
-			if ( ! roi.contains( b->mPos ) )
+			addBlob( cvRect, vec2( m.m10 / m.m00, m.m01 / m.m00 ), pmat );
+		}
+		else
+		{
+			MNDL_BLOBTRACKER_STAT( result->mStats.mRejectedByArea++ );
+		}
+	}
+}
+
+BlobTracker::DetectionSetup::DetectionSetup( const OptionsRef &options, const cv::Size &inputSize ) :
+	mOptions( options ),
+	mInputSize( inputSize ),
+	mNormMapping( Rectf( 0.f, 0.f, inputSize.width, inputSize.height ),
+				  Rectf( 0.f, 0.f, options->mNormalizationScale, options->mNormalizationScale ) ),
+	mRoi( options->mNormalizedRegionOfInterest * options->mNormalizationScale )
+{
+	const int w = inputSize.width;
+	const int h = inputSize.height;
+	mRoiRect = roiToPixels( options->mNormalizedRegionOfInterest, w, h );
+
+	// blobs are detected on the input downscaled by mLevelScale
+	mLevel = options->mPyramidEnabled ? choosePyramidLevel( *options, w, h ) : 0;
+	mLevelScale = 1 << mLevel;
+	mLevelSize = cv::Size( w >> mLevel, h >> mLevel );
+	// the kernels shrink with the level
+	auto levelKernelSize = [ & ]( int kernelSize )
+	{
+		return ( mLevel > 0 ) ? std::max( ( kernelSize + mLevelScale / 2 ) / mLevelScale, 1 ) : kernelSize;
+	};
+
+	mPreprocessParams.mBlurSize = levelKernelSize( options->mBlurSize );
+	mPreprocessParams.mThreshold = options->mThreshold;
+	mPreprocessParams.mThresholdInvertEnabled = options->mThresholdInvertEnabled;
+	mPreprocessParams.mAdaptiveThresholdEnabled = options->mAdaptiveThresholdEnabled;
+	mPreprocessParams.mAdaptiveBlockSize = levelKernelSize( options->mAdaptiveThresholdBlockSize );
+	mPreprocessParams.mAdaptiveOffset = options->mAdaptiveThresholdOffset;
+	mPreprocessParams.mSpecializationEnabled = options->mPipelineSpecializationEnabled;
+	mRefineParams = mPreprocessParams;
+	mRefineParams.mBlurSize = options->mBlurSize;
+	mRefineParams.mAdaptiveBlockSize = options->mAdaptiveThresholdBlockSize;
+	mBitMaskEnabled = isBitMaskUsed( *options );
+	mMorphology = mBitMaskEnabled ? options->mMorphology : Options::Morphology::NONE;
+	mMorphologyRadius = std::min( std::max( ( options->mMorphologyRadius + mLevelScale / 2 ) / mLevelScale, 0 ), 63 );
+	if ( mMorphologyRadius == 0 )
+	{
+		mMorphology = Options::Morphology::NONE;
+	}
+
+	// processed area, and the area of the input the box blur and the local means read
+	mArea = cv::Rect( 0, 0, w, h );
+	mInputArea = mArea;
+	if ( options->mCropToRoi )
+	{
+		mArea = mRoiRect;
+		int margin = mRefineParams.getKernelSize() / 2 + 1;
+		if ( mLevel > 0 )
+		{
+			// the level kernels read whole blocks around the downscaled area
+			margin = std::max( margin, ( mPreprocessParams.getKernelSize() / 2 + 2 ) * mLevelScale );
+		}
+		mInputArea = growRect( mArea, margin, w, h );
+	}
+
+	// the level covers the blocks the area touches, and is downscaled from the blocks fully inside the read area
+	mLevelArea = mArea;
+	mLevelInputArea = mInputArea;
+	if ( mLevel > 0 )
+	{
+		mLevelArea = shrinkRect( mArea, mLevelScale, mLevelSize, true );
+		mLevelInputArea = shrinkRect( mInputArea, mLevelScale, mLevelSize, false );
+	}
+
+	// the area limits are relative to the input size, scale them to the level
+	float surfArea = float( w ) * float( h );
+	float levelAreaScale = 1.f / float( mLevelScale * mLevelScale );
+	mMinAreaLimit = surfArea * options->mMinArea * levelAreaScale;
+	mMaxAreaLimit = surfArea * options->mMaxArea * levelAreaScale;
+
+	// the extraction variant compiled for the bounds and hull flags
+	static const ExtractBlobsFn kExtractBlobs[] = {
+		extractBlobs< 0 >, extractBlobs< kExtractBounds >, extractBlobs< kExtractConvexHull >,
+		extractBlobs< kExtractBounds | kExtractConvexHull >, extractBlobs< kExtractGeneric > };
+	const int flags = ( options->mBoundsEnabled ? kExtractBounds : 0 ) |
+					  ( options->mConvexHullEnabled ? kExtractConvexHull : 0 );
+	mExtractBlobs = kExtractBlobs[ options->mPipelineSpecializationEnabled ? flags : kExtractGeneric ];
+}
+
+void BlobTracker::detectBlobs( const InputFrame &input, const DetectionSetup &setup, DetectionResult *result,
+							   BackgroundModel *background, WorkStealingPool *pool )
+{
+#if MNDL_BLOBTRACKER_STATS
+	// finishes the statistics on every return
+	struct StatsScope
+	{
+		~StatsScope()
+		{
+			mResult->mStats.finish();
+			mResult->mStats.mReallocations = mResult->countReallocations();
+		}
+		DetectionResult *mResult;
+	} statsScope = { result };
+	result->mStats.start( Stats::Stage::INPUT );
+#endif
+
+	// the areas and the pyramid level were derived from the options once for the input size
+	const Options &options = *setup.mOptions;
+	const int w = input.getWidth();
+	const int h = input.getHeight();
+	const bool converted = ( input.mFormat != InputFrame::Format::GRAY );
+	const cv::Rect &roiRect = setup.mRoiRect;
+	const int level = setup.mLevel;
+	const int levelScale = setup.mLevelScale;
+	const cv::Size &levelSize = setup.mLevelSize;
+	const int levelKernelSize = setup.mPreprocessParams.getKernelSize();
+	const cv::Rect &area = setup.mArea;
+	const cv::Rect &inputArea = setup.mInputArea;
+	const cv::Rect &levelArea = setup.mLevelArea;
+	const bool bitMaskEnabled = setup.mBitMaskEnabled;
+	const bool morphologyEnabled = setup.mMorphology != Options::Morphology::NONE;
+	result->mLabelMask = bitMaskEnabled ? ( morphologyEnabled ? &result->mMorphologyMask : &result->mBitMask ) : nullptr;
+
+	// the thresholded image is either bytes or bits, the morphology passes write two more bit masks
+	auto createMasks = [ & ]
+	{
+		if ( ! bitMaskEnabled )
+		{
+			result->mThresholded.create( levelSize, CV_8UC1 );
+			return;
+		}
+		result->mBitMask.create( levelSize );
+		if ( morphologyEnabled )
+		{
+			result->mMorphologyScratch.create( levelSize );
+			result->mMorphologyMask.create( levelSize );
+		}
+	};
+
+	if ( options.mCropToRoi )
+	{
+		// clear the buffers outside the area when it changes, so the debug images stay clean. The bit masks
+		// start cleared when their size changes
+		bool reallocated = ( result->mBlurred.size() != levelSize ) ||
+						   ( ! bitMaskEnabled && ( result->mThresholded.size() != levelSize ) );
+		result->mBlurred.create( levelSize, CV_8UC1 );
+		createMasks();
+		if ( reallocated || ( result->mCropArea != area ) )
+		{
+			result->mBlurred.setTo( cv::Scalar( 0 ) );
+			if ( ! result->mThresholded.empty() )
 			{
-				continue;
+				result->mThresholded.setTo( cv::Scalar( 0 ) );
 			}
+			for ( BitMask *mask : { &result->mBitMask, &result->mMorphologyScratch, &result->mMorphologyMask } )
+			{
+				mask->fill( cv::Rect( 0, 0, mask->getWidth(), mask->getHeight() ), false );
+			}
+			if ( options.mFlip || options.mDebugImagesEnabled || converted )
+			{
+				result->mInput.create( input.getSize(), CV_8UC1 );
+				result->mInput.setTo( cv::Scalar( 0 ) );
+			}
+			result->mCropArea = area;
+		}
+
+		if ( area.area() == 0 )
+		{
+			result->clearBlobs();
+			return;
+		}
+	}
+	else
+	{
+		result->mCropArea = cv::Rect();
+	}
+
+	// never write to the input, it may be the caller's channel. Flipping and the conversion of colour and
+	// depth input happen in the same pass, only over the read area
+	cv::Mat src = input.mData;
+	if ( options.mFlip || converted || ( options.mBlankOutsideRoi && ! options.mCropToRoi ) ||
+		 options.mDebugImagesEnabled )
+	{
+		result->mInput.create( input.getSize(), CV_8UC1 );
+		input.convert( inputArea, options.mFlip, options.mDepthNear, options.mDepthFar, result->mInput,
+					   options.mPipelineSpecializationEnabled );
+		src = result->mInput;
+	}
+
+	if ( options.mBlankOutsideRoi && ! options.mCropToRoi )
+	{
+		cv::Scalar fillColor( options.mThresholdInvertEnabled ? 255 : 0 );
+		int x2 = roiRect.x + roiRect.width;
+		int y2 = roiRect.y + roiRect.height;
+		src( cv::Rect( 0, 0, w, roiRect.y ) ).setTo( fillColor );
+		src( cv::Rect( 0, roiRect.y, roiRect.x, roiRect.height ) ).setTo( fillColor );
+		src( cv::Rect( 0, y2, w, h - y2 ) ).setTo( fillColor );
+		src( cv::Rect( x2, roiRect.y, w - x2, roiRect.height ) ).setTo( fillColor );
+	}
+
+	// the difference from the background replaces the input over the read area, before the pyramid, so
+	// refinement sees it too
+	if ( options.mBackgroundSubtractionEnabled && ( background != nullptr ) )
+	{
+		result->mForeground.create( input.getSize(), CV_8UC1 );
+		background->apply( src, inputArea, options.mBackgroundLearningRate,
+						   options.mBackgroundFreezeEnabled ? options.mThreshold : 255, result->mForeground );
+		src = result->mForeground;
+	}
+
+	// downscale the blocks of levelScale x levelScale pixels fully inside the read area
+	cv::Mat levelSrc = src;
+	if ( level > 0 )
+	{
+		const cv::Rect &levelInputArea = setup.mLevelInputArea;
+		if ( levelArea.area() == 0 )
+		{
+			result->clearBlobs();
+			return;
+		}
+		result->mLevelInput.create( levelSize, CV_8UC1 );
+		cv::Mat dst = result->mLevelInput( levelInputArea );
+		cv::Rect blocks( levelInputArea.x * levelScale, levelInputArea.y * levelScale,
+						 levelInputArea.width * levelScale, levelInputArea.height * levelScale );
+		cv::resize( src( blocks ), dst, dst.size(), 0, 0, cv::INTER_AREA );
+		levelSrc = result->mLevelInput;
+	}
+
+	MNDL_BLOBTRACKER_STAT( result->mStats.enter( Stats::Stage::PREPROCESS ) );
+
+	// blurring a view reads the neighbouring pixels of the parent image at the view's edges,
+	// so the cropped result matches the full frame result inside the area
+	result->mBlurred.create( levelSize, CV_8UC1 );
+	createMasks();
+	const PreprocessStage::Params &preprocessParams = setup.mPreprocessParams;
+	const bool labelsEnabled = options.mDetectionMode == Options::DetectionMode::LABELS;
+
+	// thresholds \a rect of the level into the byte or the bit mask with the stage of \a stages
+	auto preprocess = [ & ]( PreprocessStageRef *stages, const cv::Rect &rect )
+	{
+		const PreprocessStageRef &stage = DetectionResult::getPreprocessStage( stages, options.mPreprocessMode );
+		if ( bitMaskEnabled )
+		{
+			stage->processBits( levelSrc, rect, preprocessParams,
+					result->mBlurred, result->mBitMask, options.mDebugImagesEnabled );
+		}
+		else
+		{
+			stage->process( levelSrc, rect, preprocessParams,
+					result->mBlurred, result->mThresholded, options.mDebugImagesEnabled );
+		}
+	};
+	// runs the first or the second morphology pass over \a rect, Morphology::OPEN erodes first
+	auto morph = [ & ]( BitMorphology &morphology, int pass, const cv::Rect &rect )
+	{
+		const BitMask &src = ( pass == 0 ) ? result->mBitMask : result->mMorphologyScratch;
+		BitMask &dst = ( pass == 0 ) ? result->mMorphologyScratch : result->mMorphologyMask;
+		if ( ( pass == 0 ) == ( setup.mMorphology == Options::Morphology::OPEN ) )
+		{
+			morphology.erode( src, dst, rect, levelArea, setup.mMorphologyRadius );
+		}
+		else
+		{
+			morphology.dilate( src, dst, rect, levelArea, setup.mMorphologyRadius );
+		}
+	};
+
+	// incremental processing compares the frame with the last one detected into this result, the images
+	// are still valid outside the changed tiles
+	bool fullFrame = true;
+	TileChangeDetector &tileChanges = result->mTileChanges;
+	if ( options.mIncrementalEnabled )
+	{
+		const OptionsRef &last = result->mTileOptions;
+		bool reset = ! last || ! samePreprocessing( options, *last );
+		bool keepBlobs = last && sameExtraction( options, *last );
+		result->mTileOptions = setup.mOptions;
+
+		// the pixels around a cropped area reach into it through the blur and the local means
+		cv::Rect watchedArea = growRect( levelArea, levelKernelSize / 2 + 1, levelSize.width, levelSize.height );
+		tileChanges.update( levelSrc, watchedArea, options.mTileSize, options.mTileChangeThreshold, reset );
+		result->mNumTiles = tileChanges.getNumTiles();
+		result->mNumDirtyTiles = tileChanges.getNumDirtyTiles();
+		if ( ( result->mNumDirtyTiles == 0 ) && keepBlobs )
+		{
+			// nothing to trace, the blobs of the last frame are kept
+			return;
+		}
+		fullFrame = result->mNumDirtyTiles == result->mNumTiles;
+	}
+	else
+	{
+		tileChanges.invalidate();
+		result->mNumTiles = result->mNumDirtyTiles = 0;
+	}
 
-			if ( mOptions.mBoundsEnabled )
+	// the same holds for stripes, which are labelled separately and joined at the seams
+	const int numStripes = ( ( pool != nullptr ) && fullFrame ) ?
+		std::min( options.mNumThreads, levelArea.height / kMinStripeHeight ) : 1;
+	if ( numStripes > 1 )
+	{
+		result->mStripes.resize( numStripes );
+		// runs \a fn for each stripe on the pool and waits for all of them
+		auto forEachStripe = [ & ]( const function< void ( DetectionResult::Stripe *, const cv::Rect & ) > &fn )
+		{
+			atomic< size_t > remaining( numStripes );
+			for ( int i = 0; i < numStripes; i++ )
+			{
+				int y1 = levelArea.y + levelArea.height * i / numStripes;
+				int y2 = levelArea.y + levelArea.height * ( i + 1 ) / numStripes;
+				cv::Rect stripeArea( levelArea.x, y1, levelArea.width, y2 - y1 );
+				DetectionResult::Stripe *stripe = &result->mStripes[ i ];
+				pool->submit( [ &, stripe, stripeArea ]
+					{
+						fn( stripe, stripeArea );
+						remaining.fetch_sub( 1, memory_order_release );
+					} );
+			}
+			pool->wait( remaining );
+		};
+		auto scanStripe = [ & ]( DetectionResult::Stripe *stripe, const cv::Rect &stripeArea )
+		{
+			if ( result->mLabelMask != nullptr )
+			{
+				stripe->mLabeler.scan( *result->mLabelMask, stripeArea );
+			}
+			else
 			{
-				b->mBounds = normMapping.map( Rectf( cvRect.x, cvRect.y,
-													 cvRect.x + cvRect.width, cvRect.y + cvRect.height ) );
+				stripe->mLabeler.scan( result->mThresholded( stripeArea ), stripeArea.tl() );
 			}
+		};
 
-			if ( mOptions.mConvexHullEnabled )
+		forEachStripe( [ & ]( DetectionResult::Stripe *stripe, const cv::Rect &stripeArea )
 			{
-				vector< cv::Point > cvHull;
-				cv::convexHull( contourPnts, cvHull );
-				b->mConvexHull = std::make_shared< PolyLine2f >();
-				for ( const cv::Point &pt : cvHull )
+				preprocess( stripe->mPreprocessStages, stripeArea );
+				if ( labelsEnabled && ! morphologyEnabled )
 				{
-					b->mConvexHull->push_back( normMapping.map( fromOcv( pt ) ) );
+					scanStripe( stripe, stripeArea );
 				}
-				b->mConvexHull->setClosed();
+			} );
+		if ( morphologyEnabled )
+		{
+			// each pass reads the rows of the neighbouring stripes written by the previous one
+			forEachStripe( [ & ]( DetectionResult::Stripe *stripe, const cv::Rect &stripeArea )
+				{
+					morph( stripe->mMorphology, 0, stripeArea );
+				} );
+			forEachStripe( [ & ]( DetectionResult::Stripe *stripe, const cv::Rect &stripeArea )
+				{
+					morph( stripe->mMorphology, 1, stripeArea );
+					scanStripe( stripe, stripeArea );
+				} );
+		}
+	}
+	else if ( fullFrame )
+	{
+		preprocess( result->mPreprocessStages, levelArea );
+		if ( morphologyEnabled )
+		{
+			morph( result->mMorphology, 0, levelArea );
+			morph( result->mMorphology, 1, levelArea );
+		}
+	}
+	else
+	{
+		// a changed pixel affects the blurred pixels and the local means within the kernel radius, and each
+		// morphology pass spreads it by the morphology radius
+		const int margin = levelKernelSize / 2 + 1;
+		const int radius = setup.mMorphologyRadius;
+		for ( const cv::Rect &dirtyRect : tileChanges.getDirtyRects() )
+		{
+			cv::Rect rect = growRect( dirtyRect, margin, levelSize.width, levelSize.height ) & levelArea;
+			preprocess( result->mPreprocessStages, rect );
+			if ( morphologyEnabled )
+			{
+				morph( result->mMorphology, 0, growRect( rect, radius, levelSize.width, levelSize.height ) & levelArea );
+				morph( result->mMorphology, 1,
+					   growRect( rect, 2 * radius, levelSize.width, levelSize.height ) & levelArea );
 			}
-			newBlobs.push_back( b );
+		}
+	}
+	MNDL_BLOBTRACKER_STAT( result->mStats.enter( Stats::Stage::EXTRACT ) );
+	setup.mExtractBlobs( setup, src, numStripes, result );
+}
+
+bool BlobTracker::refineBlob( const cv::Mat &src, const DetectionSetup &setup,
+							  DetectionResult *result, cv::Rect *bounds, vec2 *centroid, cv::Mat *points )
+{
+	const Options &options = *setup.mOptions;
+	const int levelScale = setup.mLevelScale;
+
+	// the level bounds scaled up with one block of margin, within the processed area of the input
+	cv::Rect window( ( bounds->x - 1 ) * levelScale, ( bounds->y - 1 ) * levelScale,
+					 ( bounds->width + 2 ) * levelScale, ( bounds->height + 2 ) * levelScale );
+	window &= setup.mArea;
+	if ( window.area() == 0 )
+	{
+		return false;
+	}
+
+	result->mRefineBlurred.create( src.size(), CV_8UC1 );
+	result->mRefineThresholded.create( src.size(), CV_8UC1 );
+	DetectionResult::getPreprocessStage( result->mPreprocessStages, options.mPreprocessMode )->process(
+			src, window, setup.mRefineParams, result->mRefineBlurred, result->mRefineThresholded, false );
+
+	// the largest component under the level centroid, or the largest one if none is under it
+	const vector< BlobLabeler::Component > &components = result->mRefineLabeler.label(
+			result->mRefineThresholded( window ), window.tl(), 0.f, FLT_MAX, options.mConvexHullEnabled );
+	vec2 levelCentroid = *centroid * float( levelScale ) + vec2( ( levelScale - 1 ) * .5f );
+	cv::Point centroidPixel( int( levelCentroid.x + .5f ), int( levelCentroid.y + .5f ) );
+	const BlobLabeler::Component *best = nullptr;
+	bool bestCovers = false;
+	for ( const BlobLabeler::Component &c : components )
+	{
+		bool covers = c.mBounds.contains( centroidPixel );
+		if ( ( best == nullptr ) || ( covers && ! bestCovers ) ||
+			 ( ( covers == bestCovers ) && ( c.mArea > best->mArea ) ) )
+		{
+			best = &c;
+			bestCovers = covers;
+		}
+	}
+	if ( best == nullptr )
+	{
+		return false;
+	}
+
+	*bounds = best->mBounds;
+	*centroid = best->mCentroid;
+	if ( options.mConvexHullEnabled )
+	{
+		const vector< cv::Point > &pts = result->mRefineLabeler.getPoints();
+		*points = cv::Mat( int( best->mNumPoints ), 1, CV_32SC2, const_cast< cv::Point * >( &pts[ best->mFirstPoint ] ) );
+	}
+	return true;
+}
+
+const PreprocessStageRef &BlobTracker::DetectionResult::getPreprocessStage( PreprocessStageRef *stages,
+		Options::PreprocessMode mode )
+{
+	PreprocessStageRef &stage = stages[ static_cast< int >( mode ) ];
+	if ( ! stage )
+	{
+		if ( mode == Options::PreprocessMode::FUSED )
+		{
+			stage = FusedPreprocessStage::create();
+		}
+		else
+		{
+			stage = OpenCvPreprocessStage::create();
+		}
+	}
+	return stage;
+}
+
+uint32_t BlobTracker::DetectionResult::countReallocations()
+{
+	const void *data[] = { mInput.data, mForeground.data, mBlurred.data, mThresholded.data, mBitMask.getData(),
+						   mMorphologyScratch.getData(), mMorphologyMask.getData(), mContourImage.data,
+						   mLevelInput.data, mRefineBlurred.data, mRefineThresholded.data, mBlobs.mIds.data() };
+	static_assert( sizeof( data ) == sizeof( mBufferData ), "mBufferData does not fit the buffers" );
+
+	// a buffer released or first allocated counts too
+	uint32_t n = 0;
+	for ( size_t i = 0; i < sizeof( data ) / sizeof( data[ 0 ] ); i++ )
+	{
+		if ( data[ i ] != mBufferData[ i ] )
+		{
+			mBufferData[ i ] = data[ i ];
+			n++;
+		}
+	}
+	return n;
+}
+
+void BlobTracker::trackBlobs( BlobPool &newBlobs, double timestamp )
+{
+	// tracks are matched where the motion model expects them at the time of the frame
+	const vector< vec2 > *trackTargets = &mBlobs.mPositions;
+	mPredictionErrorSum = 0.f;
+	mNumPredictions = 0;
+	if ( mOptions->mPredictionEnabled )
+	{
+		float dt = float( timestamp - mLastFrameTime );
+		mTrackTargets.resize( mBlobs.getSize() );
+		for ( size_t i = 0; i < mBlobs.getSize(); i++ )
+		{
+			mTrackTargets[ i ] = mBlobs.mPositions[ i ] + mBlobs.mVelocities[ i ] * dt;
+		}
+		trackTargets = &mTrackTargets;
+	}
+	mDetectionTimeStep = float( timestamp - mLastDetectionTime );
+	mLastFrameTime = mLastDetectionTime = timestamp;
+
+	if ( mOptions->mMatchMode == Options::MatchMode::KNN )
+	{
+		trackBlobsKnn( newBlobs, *trackTargets );
+	}
+	else
+	{
+		trackBlobsAssigned( newBlobs, *trackTargets );
+	}
+
+	mPredictionError = ( mNumPredictions > 0 ) ? mPredictionErrorSum / mNumPredictions : 0.f;
+}
+
+void BlobTracker::updateTrack( size_t i, const BlobPool &newBlobs, size_t j, const vec2 &target )
+{
+	mBlobs.update( i, newBlobs, j );
+	if ( ! mOptions->mPredictionEnabled )
+	{
+		return;
+	}
+
+	// the target is the last detected position moved by the velocity over the time since,
+	// so correcting by the error over that time gives the velocity between the detections
+	vec2 error = mBlobs.mPositions[ i ] - target;
+	mPredictionErrorSum += glm::length( error );
+	mNumPredictions++;
+	if ( mDetectionTimeStep > 0.f )
+	{
+		mBlobs.mVelocities[ i ] += error / mDetectionTimeStep;
+	}
+}
+
+void BlobTracker::trackBlobsAssigned( BlobPool &newBlobs, const vector< vec2 > &trackTargets )
+{
+	// step 1: solve the track to new blob assignment on the gated cost matrix, or on the pairs found through
+	// the grid, which the greedy matcher does not need the matrix for
+	const float maxDistance = mOptions->mMaxMatchDistance * mOptions->mNormalizationScale;
+	const bool hungarian = mOptions->mMatchMode == Options::MatchMode::HUNGARIAN;
+	if ( mOptions->mMatchGridEnabled && ! hungarian )
+	{
+		mBlobGrid.build( newBlobs.mPositions );
+		mMatcher.computeCandidates( trackTargets, mBlobGrid, maxDistance );
+	}
+	else
+	{
+		mMatcher.computeCosts( trackTargets, newBlobs.mPositions, maxDistance );
+	}
+	const vector< int32_t > &assignment = hungarian ? mMatcher.matchHungarian() : mMatcher.matchGreedy();
+
+	// step 2: end unmatched tracks, update the matched ones in place
+	for ( size_t i = 0; i < mBlobs.getSize(); i++ )
+	{
+		if ( assignment[ i ] == -1 )
+		{
+			mNextFrameResult->append( mNextFrameResult->mEnded, mBlobs, i );
+		}
+	}
+
+	for ( size_t i = 0; i < mBlobs.getSize(); i++ )
+	{
+		if ( assignment[ i ] == -1 ) // dead
+		{
+			continue;
+		}
+
+		newBlobs.mIds[ assignment[ i ] ] = mBlobs.mIds[ i ];
+		updateTrack( i, newBlobs, assignment[ i ], trackTargets[ i ] );
+
+		float posDelta = glm::length( mBlobs.mPositions[ i ] - mBlobs.mPrevPositions[ i ] );
+		if ( posDelta > 0.001f )
+		{
+			mNextFrameResult->append( mNextFrameResult->mMoved, mBlobs, i );
+		}
+	}
+
+	// removing moves the last track into the gap, going backwards only moves the ones already checked
+	for ( size_t i = mBlobs.getSize(); i-- > 0; )
+	{
+		if ( assignment[ i ] == -1 )
+		{
+			mBlobs.removeAt( i );
 		}
 	}
 
-	trackBlobs( newBlobs );
+	// step 3: unmatched new blobs start new tracks
+	startTracks( newBlobs );
 }
 
-void BlobTracker::trackBlobs( vector< BlobRef > newBlobs )
+void BlobTracker::startTracks( BlobPool &newBlobs )
+{
+	for ( size_t j = 0; j < newBlobs.getSize(); j++ )
+	{
+		if ( newBlobs.mIds[ j ] == -1 )
+		{
+			size_t i = mBlobs.getIndex( mBlobs.add() );
+			mBlobs.mIds[ i ] = newBlobs.mIds[ j ] = mIdCounter++;
+			mBlobs.update( i, newBlobs, j );
+			mBlobs.mPrevPositions[ i ] = mBlobs.mPositions[ i ];
+			mNextFrameResult->append( mNextFrameResult->mBegan, mBlobs, i );
+		}
+	}
+}
+
+void BlobTracker::trackBlobsKnn( BlobPool &newBlobs, const vector< vec2 > &trackTargets )
 {
 	// all new blob id's initialized with -1
+	vector< int32_t > &trackIds = mBlobs.mIds;
+	vector< int32_t > &newIds = newBlobs.mIds;
+
+	// the track each new blob is assigned to, instead of searching the tracks for the blob's id
+	vector< int32_t > &blobTracks = mBlobTracks;
+	blobTracks.assign( newBlobs.getSize(), -1 );
+
+	// the grid only finds the nearest blob within the match distance
+	const bool gridEnabled = mOptions->mMatchGridEnabled;
+	const float maxDistance = mOptions->mMaxMatchDistance * mOptions->mNormalizationScale;
+	if ( gridEnabled )
+	{
+		mBlobGrid.build( newBlobs.mPositions );
+	}
 
 	// step 1: match new blobs with existing nearest ones
-	for ( size_t i = 0; i < mBlobs.size(); i++ )
+	for ( size_t i = 0; i < mBlobs.getSize(); i++ )
 	{
-		int32_t winner = findClosestBlobKnn( newBlobs, mBlobs[ i ], 3, 0 );
+		int32_t winner = gridEnabled ? mBlobGrid.findNearest( trackTargets[ i ], maxDistance ) :
+									   findClosestBlobKnn( newBlobs, trackTargets[ i ], 3, 0 );
 
 		if ( winner == -1 ) // track has died
 		{
-			mBlobsEndedSig.emit( BlobEvent( mBlobs[ i ] ) );
-			mBlobs[ i ]->mId = -1; // marked for deletion
+			mNextFrameResult->append( mNextFrameResult->mEnded, mBlobs, i );
+			trackIds[ i ] = -1; // marked for deletion
 		}
 		else
 		{
 			// if winning new blob was labeled winner by another track
 			// then compare with this track to see which is closer
-			if ( newBlobs[ winner ]->mId != -1 )
+			int32_t j = blobTracks[ winner ];
+			if ( j != -1 )
 			{
-				// find the currently assigned blob
-				int j; // j will be the index of it
-				for ( j = 0; j < mBlobs.size(); j++ )
-				{
-					if ( mBlobs[ j ]->mId == newBlobs[ winner ]->mId )
-					{
-						break;
-					}
-				}
+				vec2 p = newBlobs.mPositions[ winner ];
+				vec2 pOld = trackTargets[ j ];
+				vec2 pNew = trackTargets[ i ];
+				// todo squaredistance calculate would be better
+				float distOld = glm::distance( p, pOld );
+				float distNew = glm::distance( p, pNew );
 
-				if ( j == mBlobs.size() ) // got to end without finding it
+				// if this track is closer, update the Id of the blob
+				// otherwise delete this track.. it's dead
+				if ( distNew < distOld ) // update
 				{
-					newBlobs[ winner ]->mId = mBlobs[ i ]->mId;
-					mBlobs[ i ] = newBlobs[ winner ];
+					blobTracks[ winner ] = int32_t( i );
+					/* TODO
+					   now the old winning blob has lost the win.
+					   I should also probably go through all the newBlobs
+					   at the end of this loop and if there are ones without
+					   any winning matches, check if they are close to this
+					   one. Right now I'm not doing that to prevent a
+					   recursive mess. It'll just be a new track.
+					 */
+					mNextFrameResult->append( mNextFrameResult->mEnded, mBlobs, j );
+					// mark the blob for deletion
+					trackIds[ j ] = -1;
 				}
-				else // found it, compare with current blob
+				else // delete
 				{
-					vec2 p = newBlobs[ winner ]->mPos;
-					vec2 pOld = mBlobs[ j ]->mPos;
-					vec2 pNew = mBlobs[ i ]->mPos;
-					// todo squaredistance calculate would be better
-					float distOld = glm::distance( p, pOld );
-					float distNew = glm::distance( p, pNew );
-
-					// if this track is closer, update the Id of the blob
-					// otherwise delete this track.. it's dead
-					if ( distNew < distOld ) // update
-					{
-						newBlobs[ winner ]->mId = mBlobs[ i ]->mId;
-						/* TODO
-						   now the old winning blob has lost the win.
-						   I should also probably go through all the newBlobs
-						   at the end of this loop and if there are ones without
-						   any winning matches, check if they are close to this
-						   one. Right now I'm not doing that to prevent a
-						   recursive mess. It'll just be a new track.
-						 */
-						mBlobsEndedSig.emit( BlobEvent( mBlobs[ j ] ) );
-						// mark the blob for deletion
-						mBlobs[ j ]->mId = -1;
-					}
-					else // delete
-					{
-						mBlobsEndedSig.emit( BlobEvent( mBlobs[ i ] ) );
-						// mark the blob for deletion
-						mBlobs[ i ]->mId = -1;
-					}
+					mNextFrameResult->append( mNextFrameResult->mEnded, mBlobs, i );
+					// mark the blob for deletion
+					trackIds[ i ] = -1;
 				}
 			}
 			else // no conflicts, so simply update
 			{
-				newBlobs[ winner ]->mId = mBlobs[ i ]->mId;
+				blobTracks[ winner ] = int32_t( i );
 			}
 		}
 	}
 
+	// every track still alive won exactly one new blob, which takes over its id
+	vector< int32_t > &trackBlobs = mTrackBlobs;
+	trackBlobs.assign( mBlobs.getSize(), -1 );
+	for ( size_t j = 0; j < newBlobs.getSize(); j++ )
+	{
+		if ( blobTracks[ j ] != -1 )
+		{
+			newIds[ j ] = trackIds[ blobTracks[ j ] ];
+			trackBlobs[ blobTracks[ j ] ] = int32_t( j );
+		}
+	}
+
 	// step 2: blob update
 	//
 	// update all current tracks
-	// remove every track labeled as dead, id = -1
 	// find every track that's alive and copy its data from newBlobs
-	for ( size_t i = 0; i < mBlobs.size(); i++ )
+	for ( size_t i = 0; i < mBlobs.getSize(); i++ )
 	{
-		if ( mBlobs[ i ]->mId == -1 ) // dead
+		if ( trackIds[ i ] == -1 ) // dead
 		{
-			// erase track
-			mBlobs.erase( mBlobs.begin() + i, mBlobs.begin() + i + 1 );
-			i--; // decrement one since we removed an element
+			continue;
 		}
-		else // living, so update its data
-		{
-			for ( int j = 0; j < newBlobs.size(); j++ )
-			{
-				if ( mBlobs[ i ]->mId == newBlobs[ j ]->mId )
-				{
-					// update track
-					// store the last centroid
-					newBlobs[ j ]->mPrevPos = mBlobs[ i ]->mPos;
-					mBlobs[ i ] = newBlobs[ j ];
 
-					vec2 tD = mBlobs[ i ]->mPos - mBlobs[ i ]->mPrevPos;
+		// update track, the last centroid is stored
+		updateTrack( i, newBlobs, trackBlobs[ i ], trackTargets[ i ] );
 
-					// calculate the acceleration
-					float posDelta = glm::length( tD );
-					if ( posDelta > 0.001f )
-					{
-						mBlobsMovedSig.emit( BlobEvent( mBlobs[ i ] ) );
-					}
+		vec2 tD = mBlobs.mPositions[ i ] - mBlobs.mPrevPositions[ i ];
 
-					// TODO: add other blob features
-				}
-			}
+		// calculate the acceleration
+		float posDelta = glm::length( tD );
+		if ( posDelta > 0.001f )
+		{
+			mNextFrameResult->append( mNextFrameResult->mMoved, mBlobs, i );
 		}
+
+		// TODO: add other blob features
 	}
 
-	// step 3: add tracked blobs to touchevents
-	// -- add new living tracks
-	// now every new blob should be either labeled with a tracked id or
-	// have id of -1. if the id is -1, we need to make a new track.
-	for ( size_t i = 0; i < newBlobs.size(); i++ )
+	// remove every track labeled as dead, id = -1
+	// going backwards, as removing moves the last track into the gap
+	for ( size_t i = mBlobs.getSize(); i-- > 0; )
 	{
-		if ( newBlobs[ i ]->mId == -1 )
+		if ( trackIds[ i ] == -1 )
 		{
-			// add new track
-			newBlobs[ i ]->mId = mIdCounter;
-			mIdCounter++;
-
-			mBlobs.push_back( newBlobs[ i ] );
-
-			mBlobsBeganSig.emit( BlobEvent( newBlobs[ i ] ) );
+			mBlobs.removeAt( i );
 		}
 	}
+
+	// step 3: add tracked blobs to touchevents
+	// -- add new living tracks
+	// now every new blob should be either labeled with a tracked id or
+	// have id of -1. if the id is -1, we need to make a new track.
+	startTracks( newBlobs );
 }
 
-/** Finds the blob in newBlobs that is closest to the blob \a track.
+/** Finds the blob in newBlobs that is closest to the track at \a trackPos.
  * \param newBlobs list of blobs detected in the last frame
- * \param track current blob
+ * \param trackPos position of the current blob
  * \param k number of nearest neighbours, must be odd number (1, 3, 5 are common)
  * \param thres optimization threshold
  * Returns the closest blob id if found or -1
  */
-int32_t BlobTracker::findClosestBlobKnn( const vector< BlobRef > &newBlobs, BlobRef track,
+int32_t BlobTracker::findClosestBlobKnn( const BlobPool &newBlobs, const vec2 &trackPos,
 		int k, double thresh )
 {
 	int32_t winner = -1;
 	if ( thresh > 0. )
 		thresh *= thresh;
 
-	// list of neighbour point index and respective distances
-	list< pair< size_t, double > > nbors;
-	list< pair< size_t, double > >::iterator iter;
+	// list of neighbour point index and respective distances, sorted by distance
+	vector< pair< size_t, double > > &nbors = mKnnNeighbours;
+	nbors.clear();
 
 	// find 'k' closest neighbors of testpoint
 	vec2 p;
-	vec2 pT = track->mPos;
+	vec2 pT = trackPos;
 	float distSquared;
 
 	// search for blobs
-	for ( size_t i = 0; i < newBlobs.size(); i++ )
+	for ( size_t i = 0; i < newBlobs.getSize(); i++ )
 	{
-		p = newBlobs[ i ]->mPos;
+		p = newBlobs.mPositions[ i ];
 		// todo squaredistance calculate would be better
 		distSquared = glm::distance( p, pT );
 
@@ -297,11 +1306,12 @@ int32_t BlobTracker::findClosestBlobKnn( const vector< BlobRef > &newBlobs, Blob
 		// so far and add it to the index/distance list if positive
 
 		// search the list for the first point with a longer distance
-		for ( iter = nbors.begin(); iter != nbors.end() && distSquared >= iter->second; ++iter );
+		size_t n = 0;
+		for ( ; n < nbors.size() && distSquared >= nbors[ n ].second; n++ );
 
-		if ( ( iter != nbors.end() ) || ( nbors.size() < k ) )
+		if ( ( n < nbors.size() ) || ( nbors.size() < k ) )
 		{
-			nbors.insert( iter, 1, std::pair< size_t, double >( i, distSquared ));
+			nbors.insert( nbors.begin() + n, pair< size_t, double >( i, distSquared ) );
 			// too many items in list, get rid of farthest neighbor
 			if ( nbors.size() > k )
 			{
@@ -314,26 +1324,29 @@ int32_t BlobTracker::findClosestBlobKnn( const vector< BlobRef > &newBlobs, Blob
 	 * we now have k nearest neighbors who cast a vote, and the majority
 	 * wins. we use each class average distance to the target to break any
 	 * possible ties.
+	 *
+	 * neighbours are distinct new blobs, so every label gets a single vote
+	 * of its own distance, and the label -1 has no votes.
 	 *********************************************************************/
-
-	// a mapping from labels (IDs) to count/distance
-	map< int32_t, pair< size_t, double > > votes;
+	size_t winnerCount = 0;
+	double winnerDist = 0.;
 
 	// remember:
-	// iter->first = index of newBlob
-	// iter->second = distance of newBlob to current tracked blob
-	for ( iter = nbors.begin(); iter != nbors.end(); ++iter )
+	// first = index of newBlob
+	// second = distance of newBlob to current tracked blob
+	for ( const pair< size_t, double > &nbor : nbors )
 	{
-		// add up how many counts each neighbor got
-		size_t count = ++( votes[ iter->first ].first );
-		double dist = ( votes[ iter->first ].second += iter->second );
+		size_t count = 1;
+		double dist = nbor.second;
 
 		// check for a possible tie and break with distance
-		if ( ( count > votes[ winner ].first ) ||
-				( ( count == votes[ winner ].first ) &&
-				  ( dist < votes[ winner ].second ) ) )
+		if ( ( count > winnerCount ) ||
+				( ( count == winnerCount ) &&
+				  ( dist < winnerDist ) ) )
 		{
-			winner = iter->first;
+			winner = nbor.first;
+			winnerCount = count;
+			winnerDist = dist;
 		}
 	}
 
@@ -0,0 +1,173 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+
+#include "mndl/blobtracker/BlobTrackerPool.h"
+
+using namespace ci;
+using namespace std;
+
+namespace mndl { namespace blobtracker {
+
+BlobTrackerPool::BlobTrackerPool( size_t numThreads, size_t maxFramesInFlight ) :
+	mMaxFramesInFlight( std::max< size_t >( maxFramesInFlight, 1 ) ),
+	mPool( WorkStealingPool::create( numThreads ) )
+{}
+
+BlobTrackerPool::~BlobTrackerPool()
+{
+	// finishes the queued detections while the streams are still alive
+	mPool.reset();
+}
+
+size_t BlobTrackerPool::addStream( const BlobTracker::Options &options )
+{
+	unique_ptr< Stream > stream( new Stream() );
+	stream->mTracker = BlobTracker::create( options );
+	// one more slot for the frame held by the tracker
+	stream->mSlots.resize( mMaxFramesInFlight + 1 );
+	mStreams.push_back( std::move( stream ) );
+	return mStreams.size() - 1;
+}
+
+bool BlobTrackerPool::update( size_t streamId, const InputFrame &input )
+{
+	Stream *stream = mStreams[ streamId ].get();
+	size_t slotIndex = stream->mSlots.size();
+	bool replacing = false;
+	{
+		lock_guard< mutex > lock( stream->mMutex );
+
+		// a free slot, or the latest frame that has not started yet
+		for ( size_t i = 0; i < stream->mSlots.size(); i++ )
+		{
+			const Slot &slot = stream->mSlots[ i ];
+			if ( slot.mState == Slot::State::FREE )
+			{
+				slotIndex = i;
+				replacing = false;
+				break;
+			}
+			if ( ( slot.mState == Slot::State::QUEUED ) &&
+				 ( ! replacing || ( slot.mSequence > stream->mSlots[ slotIndex ].mSequence ) ) )
+			{
+				slotIndex = i;
+				replacing = true;
+			}
+		}
+
+		if ( slotIndex == stream->mSlots.size() )
+		{
+			stream->mNumDroppedFrames++;
+			return false;
+		}
+
+		// a queued slot already has its task submitted, the task picks up the new frame
+		Slot &slot = stream->mSlots[ slotIndex ];
+		input.copyTo( slot.mInput );
+		slot.mSetup = stream->mTracker->acquireSetup( input.getSize() );
+		slot.mResult.mTimestamp = FrameResult::getCurrentTime();
+		slot.mSequence = stream->mNextSequence++;
+		slot.mState = Slot::State::QUEUED;
+		if ( replacing )
+		{
+			stream->mNumDroppedFrames++;
+			return true;
+		}
+	}
+
+	WorkStealingPool *pool = mPool.get();
+	mPool->submit( [ stream, slotIndex, pool ] { detect( stream, slotIndex, pool ); } );
+	return true;
+}
+
+void BlobTrackerPool::detect( Stream *stream, size_t slotIndex, WorkStealingPool *pool )
+{
+	Slot &slot = stream->mSlots[ slotIndex ];
+	{
+		lock_guard< mutex > lock( stream->mMutex );
+		slot.mState = Slot::State::RUNNING;
+	}
+
+	// running slots are not touched by the other threads, the result keeps the setup for the tracking
+	slot.mResult.mSetup = slot.mSetup;
+	// the stripes of the frame, if any, run on the same pool, concurrent frames of the stream take turns
+	// updating the tracker's background
+	BlobTracker::detectBlobs( slot.mInput, *slot.mSetup, &slot.mResult, &stream->mTracker->mBackground, pool );
+
+	{
+		lock_guard< mutex > lock( stream->mMutex );
+		slot.mState = Slot::State::DONE;
+	}
+}
+
+size_t BlobTrackerPool::dispatchEvents()
+{
+	size_t numTracked = 0;
+	for ( unique_ptr< Stream > &streamPtr : mStreams )
+	{
+		Stream *stream = streamPtr.get();
+		while ( true )
+		{
+			// the oldest frame not tracked yet, it has to be finished to keep the frame order
+			Slot *next = nullptr;
+			Slot *applied = nullptr;
+			{
+				lock_guard< mutex > lock( stream->mMutex );
+				for ( Slot &slot : stream->mSlots )
+				{
+					if ( slot.mState == Slot::State::APPLIED )
+					{
+						applied = &slot;
+					}
+					else if ( ( slot.mState != Slot::State::FREE ) &&
+							  ( ( next == nullptr ) || ( slot.mSequence < next->mSequence ) ) )
+					{
+						next = &slot;
+					}
+				}
+				if ( ( next == nullptr ) || ( next->mState != Slot::State::DONE ) )
+				{
+					break;
+				}
+				next->mState = Slot::State::APPLIED;
+			}
+
+			// done and applied slots are only touched by this thread
+			stream->mTracker->applyResult( next->mResult );
+			numTracked++;
+
+			if ( applied != nullptr )
+			{
+				lock_guard< mutex > lock( stream->mMutex );
+				applied->mState = Slot::State::FREE;
+			}
+		}
+	}
+	return numTracked;
+}
+
+uint64_t BlobTrackerPool::getNumDroppedFrames( size_t streamId ) const
+{
+	const Stream *stream = mStreams[ streamId ].get();
+	lock_guard< mutex > lock( stream->mMutex );
+	return stream->mNumDroppedFrames;
+}
+
+} } // namespace mndl::blobtracker
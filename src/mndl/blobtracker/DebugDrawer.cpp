@@ -1,11 +1,16 @@
+#include <algorithm>
+#include <cstddef>
+
 #include "cinder/Utilities.h"
 #include "cinder/gl/Context.h"
 #include "cinder/gl/Texture.h"
 #include "cinder/gl/gl.h"
+#include "cinder/gl/scoped.h"
 
 #include "mndl/blobtracker/DebugDrawer.h"
 
 using namespace ci;
+using namespace std;
 
 namespace mndl { namespace blobtracker {
 
@@ -16,47 +21,30 @@ void DebugDrawer::draw( const BlobTrackerRef &blobTracker, const Area &bounds, c
 		return;
 	}
 
-	gl::TextureRef tex;
+	cv::Mat img;
 	switch ( options.mDrawMode )
 	{
 		case Options::DrawMode::ORIGINAL:
-		{
-			cv::Mat img = blobTracker->getImageInput();
-			if ( img.data )
-			{
-				tex = gl::Texture::create( fromOcv( img ) );
-			}
+			img = blobTracker->getImageInput();
 			break;
-		}
 
 		case Options::DrawMode::BLURRED:
-		{
-			cv::Mat img = blobTracker->getImageBlurred();
-			if ( img.data )
-			{
-				tex = gl::Texture::create( fromOcv( img ) );
-			}
+			img = blobTracker->getImageBlurred();
 			break;
-		}
 
 		case Options::DrawMode::THRESHOLDED:
-		{
-			cv::Mat img = blobTracker->getImageThresholded();
-			if ( img.data )
-			{
-				tex = gl::Texture::create( fromOcv( img ) );
-			}
+			img = blobTracker->getImageThresholded();
 			break;
-		}
 
 		default:
 			break;
 	}
 
-	if ( ! tex )
+	if ( ! img.data )
 	{
 		return;
 	}
+	updateTexture( img );
 
 	ci::gl::disableDepthRead();
 	ci::gl::disableDepthWrite();
@@ -66,50 +54,96 @@ void DebugDrawer::draw( const BlobTrackerRef &blobTracker, const Area &bounds, c
 	ctx->pushBoolState( GL_BLEND, blendingEnabled );
 	ctx->pushBlendFuncSeparate( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
 
-	gl::ScopedColor color( ColorA::gray( 1.0f, 0.5f ) );
-
 	Area outputArea = bounds;
 	if ( options.mDrawProportionalFit )
 	{
-		outputArea = Area::proportionalFit( tex->getBounds(), bounds, true, true );
+		outputArea = Area::proportionalFit( mTexture->getBounds(), bounds, true, true );
 	}
 
-	gl::draw( tex, outputArea );
+	{
+		gl::ScopedColor color( ColorA::gray( 1.0f, 0.5f ) );
+		gl::draw( mTexture, outputArea );
+	}
 
+	const auto &trackerOptions = blobTracker->getOptions();
+	const BlobPool &blobs = blobTracker->getBlobPool();
+	mGeometry.build( blobs, trackerOptions.mNormalizedRegionOfInterest, trackerOptions.mNormalizationScale,
+					 trackerOptions.mBoundsEnabled, trackerOptions.mConvexHullEnabled, Rectf( outputArea ),
+					 options.mStyle );
+	drawGeometry();
+	if ( options.mDrawIds )
 	{
-		const auto &trackerOptions = blobTracker->getOptions();
-		float s = trackerOptions.mNormalizationScale;
-		RectMapping blobMapping( Rectf( 0.0f, 0.0f, s, s ), Rectf( outputArea ) );
-		Rectf roi = trackerOptions.mNormalizedRegionOfInterest * s;
-		gl::color( ColorA( 0.0f, 1.0f, 0.0f, 0.8f ) );
-		gl::drawStrokedRect( blobMapping.map( roi ) );
-
-		vec2 offset = outputArea.getUL();
-		vec2 scale = vec2( outputArea.getSize() ) / vec2( s, s );
-		for ( const auto &blob : blobTracker->getBlobs() )
-		{
-			gl::pushModelView();
-			gl::translate( offset );
-			gl::scale( scale );
-			if ( trackerOptions.mBoundsEnabled )
-			{
-				gl::color( ColorA( 1.0f, 1.0f, 0.0f, 0.5f ) );
-				gl::drawStrokedRect( blob->mBounds );
-			}
-			if ( trackerOptions.mConvexHullEnabled && blob->mConvexHull )
-			{
-				gl::color( ColorA( 1.0f, 0.0f, 1.0f, 0.5f ) );
-				gl::draw( *blob->mConvexHull.get() );
-			}
-			gl::popModelView();
-			vec2 pos = blobMapping.map( blob->mPos );
-			gl::drawSolidCircle( pos, 2.0f );
-			gl::drawString( toString< int32_t >( blob->mId ), pos + vec2( 3.0f, -3.0f ),
-					ColorA( 1.0f, 0.0f, 0.0f, 0.9f ) );
-		}
+		drawIds( blobs, Rectf( outputArea ), trackerOptions.mNormalizationScale, options.mStyle.mMarkerColor );
 	}
+
 	ctx->popBoolState( GL_BLEND );
 	ctx->popBlendFuncSeparate();
 }
 
+void DebugDrawer::updateTexture( const cv::Mat &img )
+{
+	// the debug images are continuous single channel images, referenced without a copy
+	Channel8u channel( img.cols, img.rows, img.step, 1, const_cast< uint8_t * >( img.ptr< uint8_t >() ) );
+	if ( mTexture && ( mTexture->getWidth() == img.cols ) && ( mTexture->getHeight() == img.rows ) )
+	{
+		mTexture->update( channel );
+	}
+	else
+	{
+		mTexture = gl::Texture::create( channel );
+	}
+}
+
+void DebugDrawer::drawGeometry()
+{
+	const vector< DebugGeometry::Vertex > &vertices = mGeometry.getVertices();
+	if ( vertices.empty() )
+	{
+		return;
+	}
+
+	// the buffer only grows, by doubling
+	if ( vertices.size() > mVboCapacity )
+	{
+		mVboCapacity = std::max( vertices.size(), 2 * mVboCapacity );
+		geom::BufferLayout layout;
+		layout.append( geom::Attrib::POSITION, 2, sizeof( DebugGeometry::Vertex ),
+					   offsetof( DebugGeometry::Vertex, mPos ) );
+		layout.append( geom::Attrib::COLOR, 4, sizeof( DebugGeometry::Vertex ),
+					   offsetof( DebugGeometry::Vertex, mColor ) );
+		mVbo = gl::Vbo::create( GL_ARRAY_BUFFER, mVboCapacity * sizeof( DebugGeometry::Vertex ), nullptr,
+								GL_DYNAMIC_DRAW );
+		mVboMesh = gl::VboMesh::create( uint32_t( mVboCapacity ), GL_LINES, { { layout, mVbo } } );
+	}
+	mVbo->bufferSubData( 0, vertices.size() * sizeof( DebugGeometry::Vertex ), vertices.data() );
+
+	gl::ScopedGlslProg shader( gl::getStockShader( gl::ShaderDef().color() ) );
+	gl::draw( mVboMesh, 0, GLsizei( vertices.size() ) );
+}
+
+void DebugDrawer::drawIds( const BlobPool &blobs, const Rectf &outputArea, float normalizationScale,
+						   const ColorA &color )
+{
+	if ( ! mFont )
+	{
+		mFont = gl::TextureFont::create( Font::getDefault() );
+	}
+
+	// the glyphs of all ids are placed first and drawn together
+	mGlyphs.clear();
+	const vec2 offset = outputArea.getUpperLeft();
+	const vec2 scale = outputArea.getSize() / vec2( normalizationScale );
+	for ( size_t i = 0; i < blobs.getSize(); i++ )
+	{
+		vec2 pos = offset + blobs.mPositions[ i ] * scale + vec2( 3.0f, -3.0f );
+		for ( const auto &glyph : mFont->getGlyphPlacements( toString< int32_t >( blobs.mIds[ i ] ) ) )
+		{
+			mGlyphs.push_back( make_pair( glyph.first, glyph.second + pos ) );
+		}
+	}
+
+	gl::ScopedColor scopedColor( color );
+	mFont->drawGlyphs( mGlyphs, vec2( 0.f ) );
+}
+
 } } // mndl::blobtracker
@@ -0,0 +1,95 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mndl/blobtracker/DebugGeometry.h"
+
+using namespace ci;
+using namespace std;
+
+namespace mndl { namespace blobtracker {
+
+void DebugGeometry::build( const BlobPool &blobs, const Rectf &normalizedRoi, float normalizationScale,
+						   bool boundsEnabled, bool convexHullEnabled, const Rectf &outputArea, const Style &style )
+{
+	mVertices.clear();
+
+	// blob coordinates to output pixels
+	const vec2 offset = outputArea.getUpperLeft();
+	const vec2 scale = outputArea.getSize() / vec2( normalizationScale );
+	auto map = [ & ]( const vec2 &p ) { return offset + p * scale; };
+	auto mapRect = [ & ]( const Rectf &r ) { return Rectf( map( r.getUpperLeft() ), map( r.getLowerRight() ) ); };
+
+	addRect( mapRect( normalizedRoi * normalizationScale ), style.mRoiColor );
+
+	const size_t numBlobs = blobs.getSize();
+	if ( boundsEnabled )
+	{
+		for ( size_t i = 0; i < numBlobs; i++ )
+		{
+			addRect( mapRect( blobs.mBounds[ i ] ), style.mBoundsColor );
+		}
+	}
+	if ( convexHullEnabled )
+	{
+		for ( size_t i = 0; i < numBlobs; i++ )
+		{
+			const vector< vec2 > &hull = blobs.mConvexHulls[ i ].getPoints();
+			mPoints.resize( hull.size() );
+			for ( size_t j = 0; j < hull.size(); j++ )
+			{
+				mPoints[ j ] = map( hull[ j ] );
+			}
+			addPolyLine( mPoints.data(), mPoints.size(), true, style.mHullColor );
+		}
+	}
+	for ( size_t i = 0; i < numBlobs; i++ )
+	{
+		addMarker( map( blobs.mPositions[ i ] ), style.mMarkerSize, style.mMarkerColor );
+	}
+}
+
+void DebugGeometry::addRect( const Rectf &rect, const ColorA &color )
+{
+	const vec2 ul = rect.getUpperLeft();
+	const vec2 ur = rect.getUpperRight();
+	const vec2 lr = rect.getLowerRight();
+	const vec2 ll = rect.getLowerLeft();
+	addLine( ul, ur, color );
+	addLine( ur, lr, color );
+	addLine( lr, ll, color );
+	addLine( ll, ul, color );
+}
+
+void DebugGeometry::addPolyLine( const vec2 *points, size_t numPoints, bool closed, const ColorA &color )
+{
+	for ( size_t i = 1; i < numPoints; i++ )
+	{
+		addLine( points[ i - 1 ], points[ i ], color );
+	}
+	if ( closed && ( numPoints > 2 ) )
+	{
+		addLine( points[ numPoints - 1 ], points[ 0 ], color );
+	}
+}
+
+void DebugGeometry::addMarker( const vec2 &pos, float size, const ColorA &color )
+{
+	addLine( pos - vec2( size, 0.f ), pos + vec2( size, 0.f ), color );
+	addLine( pos - vec2( 0.f, size ), pos + vec2( 0.f, size ), color );
+}
+
+} } // namespace mndl::blobtracker
@@ -0,0 +1,160 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include "mndl/blobtracker/InputFrame.h"
+
+using namespace ci;
+using namespace std;
+
+namespace mndl { namespace blobtracker {
+
+namespace {
+
+// Rec. 601 luma weights in 14-bit fixed point, like cv::cvtColor
+const uint32_t kRedWeight = 4899;
+const uint32_t kGreenWeight = 9617;
+const uint32_t kBlueWeight = 1868;
+const int kWeightBits = 14;
+
+// flags of the row converter variants, kGeneric reads the flip flag from the argument instead
+const int kFlip = 1;
+const int kGeneric = 2;
+
+//! Converts \a n pixels of \a kPixelInc bytes starting at \a src to luma at \a dst, writing backwards if flipped.
+template< int kPixelInc, int kFlags >
+void convertColorRow( const uint8_t *src, int r, int g, int b, uint8_t *dst, bool flip, int n )
+{
+	// a compile-time step unless generic, the forward rows are contiguous stores
+	const ptrdiff_t dstStep = ( ( kFlags & kGeneric ) ? flip : ( ( kFlags & kFlip ) != 0 ) ) ? -1 : 1;
+	for ( int x = 0; x < n; x++, src += kPixelInc, dst += dstStep )
+	{
+		*dst = uint8_t( ( kRedWeight * src[ r ] + kGreenWeight * src[ g ] + kBlueWeight * src[ b ] +
+						  ( 1u << ( kWeightBits - 1 ) ) ) >> kWeightBits );
+	}
+}
+
+//! Thresholds \a n depth readings \a pixelInc elements apart to the band [ \a lo, \a hi ]. \a kPixelInc is the
+//! increment if not 0.
+template< int kPixelInc, int kFlags >
+void convertDepthRow( const uint16_t *src, int pixelInc, uint16_t lo, uint16_t hi, uint8_t *dst, bool flip, int n )
+{
+	const ptrdiff_t srcStep = kPixelInc ? kPixelInc : pixelInc;
+	const ptrdiff_t dstStep = ( ( kFlags & kGeneric ) ? flip : ( ( kFlags & kFlip ) != 0 ) ) ? -1 : 1;
+	// unsigned wrap around maps below lo above the band
+	const uint16_t range = uint16_t( hi - lo );
+	for ( int x = 0; x < n; x++, src += srcStep, dst += dstStep )
+	{
+		*dst = ( uint16_t( *src - lo ) <= range ) ? 255 : 0;
+	}
+}
+
+typedef void ( *ColorRowFn )( const uint8_t *, int, int, int, uint8_t *, bool, int );
+typedef void ( *DepthRowFn )( const uint16_t *, int, uint16_t, uint16_t, uint8_t *, bool, int );
+
+// indexed by [ 3 or 4 byte pixels ][ variant ]
+const ColorRowFn kColorRows[ 2 ][ 3 ] = {
+	{ convertColorRow< 3, 0 >, convertColorRow< 3, kFlip >, convertColorRow< 3, kGeneric > },
+	{ convertColorRow< 4, 0 >, convertColorRow< 4, kFlip >, convertColorRow< 4, kGeneric > } };
+// indexed by [ interleaved or single channel ][ variant ]
+const DepthRowFn kDepthRows[ 2 ][ 3 ] = {
+	{ convertDepthRow< 0, 0 >, convertDepthRow< 0, kFlip >, convertDepthRow< 0, kGeneric > },
+	{ convertDepthRow< 1, 0 >, convertDepthRow< 1, kFlip >, convertDepthRow< 1, kGeneric > } };
+
+} // anonymous namespace
+
+InputFrame::InputFrame( const Channel8u &channel ) :
+	mData( toOcv( channel ) )
+{}
+
+InputFrame::InputFrame( const Surface8u &surface ) :
+	mData( surface.getHeight(), surface.getWidth(), CV_8UC( surface.getPixelInc() ),
+		   const_cast< uint8_t * >( surface.getData() ), surface.getRowBytes() ),
+	mFormat( Format::COLOR ),
+	mRedOffset( surface.getRedOffset() ),
+	mGreenOffset( surface.getGreenOffset() ),
+	mBlueOffset( surface.getBlueOffset() )
+{}
+
+InputFrame::InputFrame( const Channel16u &channel ) :
+	mData( channel.getHeight(), channel.getWidth(), CV_16UC( channel.getIncrement() ),
+		   const_cast< uint16_t * >( channel.getData() ), channel.getRowBytes() ),
+	mFormat( Format::DEPTH )
+{}
+
+void InputFrame::copyTo( InputFrame &frame ) const
+{
+	mData.copyTo( frame.mData );
+	frame.mFormat = mFormat;
+	frame.mRedOffset = mRedOffset;
+	frame.mGreenOffset = mGreenOffset;
+	frame.mBlueOffset = mBlueOffset;
+}
+
+void InputFrame::convert( const cv::Rect &area, bool flip, uint16_t depthNear, uint16_t depthFar, cv::Mat &dst,
+						  bool specialized ) const
+{
+	const int w = mData.cols;
+	const cv::Rect mirroredArea( w - area.x - area.width, area.y, area.width, area.height );
+	cv::Mat dstArea = dst( area );
+	if ( mFormat == Format::GRAY )
+	{
+		if ( flip )
+		{
+			cv::flip( mData( mirroredArea ), dstArea, 1 );
+		}
+		else
+		{
+			mData( area ).copyTo( dstArea );
+		}
+		return;
+	}
+
+	depthNear = std::max< uint16_t >( depthNear, 1 );
+	if ( ( mFormat == Format::DEPTH ) && ( depthFar < depthNear ) )
+	{
+		dstArea.setTo( cv::Scalar( 0 ) );
+		return;
+	}
+
+	// the row converter is picked once for the frame
+	const int variant = specialized ? ( flip ? kFlip : 0 ) : kGeneric;
+	const int pixelInc = mData.channels();
+	const ColorRowFn colorRow = kColorRows[ ( pixelInc == 4 ) ? 1 : 0 ][ variant ];
+	const DepthRowFn depthRow = kDepthRows[ ( pixelInc == 1 ) ? 1 : 0 ][ variant ];
+
+	// walks the source forward and the destination backward when flipping
+	const cv::Rect &srcArea = flip ? mirroredArea : area;
+	const int dstStart = flip ? ( area.x + area.width - 1 ) : area.x;
+	for ( int y = area.y; y < area.y + area.height; y++ )
+	{
+		uint8_t *d = dst.ptr< uint8_t >( y ) + dstStart;
+		if ( mFormat == Format::DEPTH )
+		{
+			const uint16_t *src = mData.ptr< uint16_t >( y ) + srcArea.x * pixelInc;
+			depthRow( src, pixelInc, depthNear, depthFar, d, flip, area.width );
+		}
+		else
+		{
+			const uint8_t *src = mData.ptr< uint8_t >( y ) + srcArea.x * pixelInc;
+			colorRow( src, mRedOffset, mGreenOffset, mBlueOffset, d, flip, area.width );
+		}
+	}
+}
+
+} } // namespace mndl::blobtracker
@@ -0,0 +1,563 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+// MNDL_BLOBTRACKER_NO_SIMD builds the scalar code, to check it on the targets with the vector instructions
+#if defined( MNDL_BLOBTRACKER_NO_SIMD )
+#elif defined( __AVX2__ )
+#define MNDL_BLOBTRACKER_AVX2
+#include <immintrin.h>
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && ( _M_IX86_FP >= 2 ) )
+#define MNDL_BLOBTRACKER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "mndl/blobtracker/PreprocessStage.h"
+
+using namespace std;
+
+namespace mndl { namespace blobtracker {
+
+void PreprocessStage::processBits( const cv::Mat &input, const cv::Rect &area, const Params &params,
+								   cv::Mat &blurred, BitMask &mask, bool keepBlurred )
+{
+	mScratchMask.create( input.size(), CV_8UC1 );
+	process( input, area, params, blurred, mScratchMask, keepBlurred );
+	mask.pack( mScratchMask, area );
+}
+
+// the thresholds read the blurred image, so it is always written
+void OpenCvPreprocessStage::process( const cv::Mat &input, const cv::Rect &area, const Params &params,
+									 cv::Mat &blurred, cv::Mat &thresholded, bool /*keepBlurred*/ )
+{
+	cv::Mat blurredArea = blurred( area );
+	cv::Mat thresholdedArea = thresholded( area );
+	cv::blur( input( area ), blurredArea, cv::Size( params.mBlurSize, params.mBlurSize ) );
+	if ( params.mAdaptiveThresholdEnabled )
+	{
+		// the local means read the input around the area like the blur, the buffers have the size of the input,
+		// so the changing areas of the incremental frames write into views instead of reallocating them
+		const int offset = params.mAdaptiveOffset;
+		mMean.create( input.size(), CV_8UC1 );
+		mDifference.create( input.size(), CV_16SC1 );
+		cv::Mat meanArea = mMean( area );
+		cv::Mat differenceArea = mDifference( area );
+		cv::blur( input( area ), meanArea, cv::Size( params.mAdaptiveBlockSize, params.mAdaptiveBlockSize ) );
+		cv::subtract( blurredArea, meanArea, differenceArea, cv::noArray(), CV_16S );
+		cv::compare( differenceArea, cv::Scalar( params.mThresholdInvertEnabled ? -offset : offset ), thresholdedArea,
+				params.mThresholdInvertEnabled ? cv::CMP_LT : cv::CMP_GT );
+		return;
+	}
+	cv::threshold( blurredArea, thresholdedArea, params.mThreshold, 255,
+			params.mThresholdInvertEnabled ? CV_THRESH_BINARY_INV : CV_THRESH_BINARY );
+}
+
+namespace {
+
+// flags of the sumColumns() variants, kGeneric reads them from the arguments instead
+const int kInvert = 1;
+const int kKeepBlurred = 2;
+const int kExactDivision = 4;
+const int kGeneric = 8;
+
+#if defined( MNDL_BLOBTRACKER_AVX2 ) || defined( MNDL_BLOBTRACKER_SSE2 )
+//! Returns 255 for the bytes of \a v greater or equal than \a lowest, if \a enabled is all ones, inverted if \a invert.
+inline __m128i thresholdBytes( __m128i v, __m128i lowest, __m128i enabled, bool invert )
+{
+	__m128i above = _mm_and_si128( _mm_cmpeq_epi8( _mm_max_epu8( v, lowest ), v ), enabled );
+	return invert ? _mm_xor_si128( above, _mm_set1_epi8( char( 0xff ) ) ) : above;
+}
+#endif
+
+//! Adds \a newRow and subtracts \a oldRow from the column sums, then writes the normalized and thresholded sums.
+//! OpenCV divides the sums of kernels up to 256 pixels with rounding half up, and multiplies larger ones with
+//! the float reciprocal rounding half to even. The vector code does the latter and corrects the quotient for the former.
+//! The flags are the template argument \a kFlags, so the branches on them fold away, or \a flags for kGeneric.
+template< int kFlags >
+void sumColumns( uint32_t *columnSums, const uint32_t *newRow, const uint32_t *oldRow, int width,
+				 int kernelArea, int threshold, int flags, uint8_t *blurred, uint8_t *mask )
+{
+	if ( ! ( kFlags & kGeneric ) )
+	{
+		flags = kFlags;
+	}
+	const bool invert = ( flags & kInvert ) != 0;
+	const bool keepBlurred = ( flags & kKeepBlurred ) != 0;
+	const bool exactDivision = ( flags & kExactDivision ) != 0;
+	const float scale = 1.f / float( kernelArea );
+	const uint32_t half = uint32_t( kernelArea / 2 );
+
+	// v > threshold is v >= lowest for the 8-bit blurred values, nothing passes when lowest is 256
+	const int lowest = std::min( std::max( threshold + 1, 0 ), 256 );
+	const uint8_t enabled = ( lowest < 256 ) ? 255 : 0;
+	const uint8_t inverted = invert ? 255 : 0;
+
+	int x = 0;
+#if defined( MNDL_BLOBTRACKER_AVX2 ) || defined( MNDL_BLOBTRACKER_SSE2 )
+	const __m128i lowest16 = _mm_set1_epi8( char( std::min( lowest, 255 ) ) );
+	const __m128i enabled16 = _mm_set1_epi8( char( enabled ) );
+	// remainder range of the quotient rounded half up, anything goes for the float rounding
+	const float remainderMin = exactDivision ? 0.f : -FLT_MAX;
+	const float remainderMax = exactDivision ? float( kernelArea ) : FLT_MAX;
+#endif
+#if defined( MNDL_BLOBTRACKER_AVX2 )
+	const __m256 scale8 = _mm256_set1_ps( scale );
+	const __m256 area8 = _mm256_set1_ps( float( kernelArea ) );
+	const __m256 half8 = _mm256_set1_ps( float( half ) );
+	const __m256 remainderMin8 = _mm256_set1_ps( remainderMin );
+	const __m256 remainderMax8 = _mm256_set1_ps( remainderMax );
+	for ( ; x <= width - 16; x += 16 )
+	{
+		__m256i s[ 2 ];
+		for ( int j = 0; j < 2; j++ )
+		{
+			__m256i *c = reinterpret_cast< __m256i * >( columnSums + x + j * 8 );
+			__m256i n = _mm256_loadu_si256( reinterpret_cast< const __m256i * >( newRow + x + j * 8 ) );
+			__m256i o = _mm256_loadu_si256( reinterpret_cast< const __m256i * >( oldRow + x + j * 8 ) );
+			__m256i sum = _mm256_add_epi32( _mm256_loadu_si256( c ), _mm256_sub_epi32( n, o ) );
+			_mm256_storeu_si256( c, sum );
+			__m256 sumf = _mm256_cvtepi32_ps( sum );
+			__m256i q = _mm256_cvtps_epi32( _mm256_mul_ps( sumf, scale8 ) );
+			__m256 r = _mm256_sub_ps( _mm256_add_ps( sumf, half8 ), _mm256_mul_ps( _mm256_cvtepi32_ps( q ), area8 ) );
+			q = _mm256_add_epi32( q, _mm256_castps_si256( _mm256_cmp_ps( r, remainderMin8, _CMP_LT_OQ ) ) );
+			s[ j ] = _mm256_sub_epi32( q, _mm256_castps_si256( _mm256_cmp_ps( r, remainderMax8, _CMP_GE_OQ ) ) );
+		}
+		// packs works within 128-bit lanes, restore the order of the 16-bit values
+		__m256i words = _mm256_permute4x64_epi64( _mm256_packs_epi32( s[ 0 ], s[ 1 ] ), _MM_SHUFFLE( 3, 1, 2, 0 ) );
+		__m128i v = _mm_packus_epi16( _mm256_castsi256_si128( words ), _mm256_extracti128_si256( words, 1 ) );
+		if ( keepBlurred )
+		{
+			_mm_storeu_si128( reinterpret_cast< __m128i * >( blurred + x ), v );
+		}
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( mask + x ), thresholdBytes( v, lowest16, enabled16, invert ) );
+	}
+#elif defined( MNDL_BLOBTRACKER_SSE2 )
+	const __m128 scale4 = _mm_set1_ps( scale );
+	const __m128 area4 = _mm_set1_ps( float( kernelArea ) );
+	const __m128 half4 = _mm_set1_ps( float( half ) );
+	const __m128 remainderMin4 = _mm_set1_ps( remainderMin );
+	const __m128 remainderMax4 = _mm_set1_ps( remainderMax );
+	for ( ; x <= width - 16; x += 16 )
+	{
+		__m128i s[ 4 ];
+		for ( int j = 0; j < 4; j++ )
+		{
+			__m128i *c = reinterpret_cast< __m128i * >( columnSums + x + j * 4 );
+			__m128i n = _mm_loadu_si128( reinterpret_cast< const __m128i * >( newRow + x + j * 4 ) );
+			__m128i o = _mm_loadu_si128( reinterpret_cast< const __m128i * >( oldRow + x + j * 4 ) );
+			__m128i sum = _mm_add_epi32( _mm_loadu_si128( c ), _mm_sub_epi32( n, o ) );
+			_mm_storeu_si128( c, sum );
+			__m128 sumf = _mm_cvtepi32_ps( sum );
+			__m128i q = _mm_cvtps_epi32( _mm_mul_ps( sumf, scale4 ) );
+			__m128 r = _mm_sub_ps( _mm_add_ps( sumf, half4 ), _mm_mul_ps( _mm_cvtepi32_ps( q ), area4 ) );
+			q = _mm_add_epi32( q, _mm_castps_si128( _mm_cmplt_ps( r, remainderMin4 ) ) );
+			s[ j ] = _mm_sub_epi32( q, _mm_castps_si128( _mm_cmpge_ps( r, remainderMax4 ) ) );
+		}
+		__m128i v = _mm_packus_epi16( _mm_packs_epi32( s[ 0 ], s[ 1 ] ), _mm_packs_epi32( s[ 2 ], s[ 3 ] ) );
+		if ( keepBlurred )
+		{
+			_mm_storeu_si128( reinterpret_cast< __m128i * >( blurred + x ), v );
+		}
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( mask + x ), thresholdBytes( v, lowest16, enabled16, invert ) );
+	}
+#endif
+
+	for ( ; x < width; x++ )
+	{
+		uint32_t sum = columnSums[ x ] + newRow[ x ] - oldRow[ x ];
+		columnSums[ x ] = sum;
+		int v = exactDivision ? int( ( sum + half ) / uint32_t( kernelArea ) ) :
+				std::min( int( std::lrint( float( sum ) * scale ) ), 255 );
+		if ( keepBlurred )
+		{
+			blurred[ x ] = uint8_t( v );
+		}
+		mask[ x ] = ( ( v >= lowest ) ? enabled : 0 ) ^ inverted;
+	}
+}
+
+typedef void ( *SumColumnsFn )( uint32_t *, const uint32_t *, const uint32_t *, int, int, int, int, uint8_t *, uint8_t * );
+
+// indexed by the flags, the last one is generic
+const SumColumnsFn kSumColumns[] = {
+	sumColumns< 0 >, sumColumns< 1 >, sumColumns< 2 >, sumColumns< 3 >,
+	sumColumns< 4 >, sumColumns< 5 >, sumColumns< 6 >, sumColumns< 7 >,
+	sumColumns< kGeneric > };
+
+//! Returns the mean of the box \a sum of \a kernelArea pixels, rounded like the normalized 8-bit box filter of OpenCV.
+inline int boxMean( uint32_t sum, int kernelArea, float scale, bool exactDivision )
+{
+	return exactDivision ? int( ( sum + uint32_t( kernelArea / 2 ) ) / uint32_t( kernelArea ) ) :
+		   std::min( int( std::lrint( float( sum ) * scale ) ), 255 );
+}
+
+#if defined( MNDL_BLOBTRACKER_AVX2 )
+//! Rounds the box sums of a kernel of \a kernelArea pixels to means like boxMean(), with the quotient correction
+//! of sumColumns().
+struct BoxMean8
+{
+	explicit BoxMean8( int kernelArea ) :
+		mScale( _mm256_set1_ps( 1.f / float( kernelArea ) ) ),
+		mArea( _mm256_set1_ps( float( kernelArea ) ) ),
+		mHalf( _mm256_set1_ps( float( kernelArea / 2 ) ) ),
+		mRemainderMin( _mm256_set1_ps( ( kernelArea <= 256 ) ? 0.f : -FLT_MAX ) ),
+		mRemainderMax( _mm256_set1_ps( ( kernelArea <= 256 ) ? float( kernelArea ) : FLT_MAX ) )
+	{}
+
+	__m256i operator()( __m256i sum ) const
+	{
+		__m256 sumf = _mm256_cvtepi32_ps( sum );
+		__m256i q = _mm256_cvtps_epi32( _mm256_mul_ps( sumf, mScale ) );
+		__m256 r = _mm256_sub_ps( _mm256_add_ps( sumf, mHalf ), _mm256_mul_ps( _mm256_cvtepi32_ps( q ), mArea ) );
+		q = _mm256_add_epi32( q, _mm256_castps_si256( _mm256_cmp_ps( r, mRemainderMin, _CMP_LT_OQ ) ) );
+		return _mm256_sub_epi32( q, _mm256_castps_si256( _mm256_cmp_ps( r, mRemainderMax, _CMP_GE_OQ ) ) );
+	}
+
+	__m256 mScale, mArea, mHalf, mRemainderMin, mRemainderMax;
+};
+
+//! Returns the box sums of the kernels of \a size starting at columns \a x to \a x + 7 of the integral rows.
+inline __m256i boxSums8( const uint32_t *top, const uint32_t *bottom, int size, int x )
+{
+	auto load = [ x ]( const uint32_t *p ) { return _mm256_loadu_si256( reinterpret_cast< const __m256i * >( p + x ) ); };
+	return _mm256_add_epi32( _mm256_sub_epi32( load( bottom + size ), load( bottom ) ),
+							 _mm256_sub_epi32( load( top ), load( top + size ) ) );
+}
+#elif defined( MNDL_BLOBTRACKER_SSE2 )
+//! Rounds the box sums of a kernel of \a kernelArea pixels to means like boxMean(), with the quotient correction
+//! of sumColumns().
+struct BoxMean4
+{
+	explicit BoxMean4( int kernelArea ) :
+		mScale( _mm_set1_ps( 1.f / float( kernelArea ) ) ),
+		mArea( _mm_set1_ps( float( kernelArea ) ) ),
+		mHalf( _mm_set1_ps( float( kernelArea / 2 ) ) ),
+		mRemainderMin( _mm_set1_ps( ( kernelArea <= 256 ) ? 0.f : -FLT_MAX ) ),
+		mRemainderMax( _mm_set1_ps( ( kernelArea <= 256 ) ? float( kernelArea ) : FLT_MAX ) )
+	{}
+
+	__m128i operator()( __m128i sum ) const
+	{
+		__m128 sumf = _mm_cvtepi32_ps( sum );
+		__m128i q = _mm_cvtps_epi32( _mm_mul_ps( sumf, mScale ) );
+		__m128 r = _mm_sub_ps( _mm_add_ps( sumf, mHalf ), _mm_mul_ps( _mm_cvtepi32_ps( q ), mArea ) );
+		q = _mm_add_epi32( q, _mm_castps_si128( _mm_cmplt_ps( r, mRemainderMin ) ) );
+		return _mm_sub_epi32( q, _mm_castps_si128( _mm_cmpge_ps( r, mRemainderMax ) ) );
+	}
+
+	__m128 mScale, mArea, mHalf, mRemainderMin, mRemainderMax;
+};
+
+//! Returns the box sums of the kernels of \a size starting at columns \a x to \a x + 3 of the integral rows.
+inline __m128i boxSums4( const uint32_t *top, const uint32_t *bottom, int size, int x )
+{
+	auto load = [ x ]( const uint32_t *p ) { return _mm_loadu_si128( reinterpret_cast< const __m128i * >( p + x ) ); };
+	return _mm_add_epi32( _mm_sub_epi32( load( bottom + size ), load( bottom ) ),
+						  _mm_sub_epi32( load( top ), load( top + size ) ) );
+}
+#endif
+
+//! Writes the blurred pixels and the mask of a row thresholded against the local means. The box sums of pixel x
+//! are taken from the integral image rows \a blurTop, \a blurBottom and \a blockTop, \a blockBottom between
+//! columns x and x + kernel size. A pixel passes if it is brighter than its local mean by more than \a offset,
+//! or darker if inverted. The flags are the template argument \a kFlags, or \a flags for kGeneric.
+template< int kFlags >
+void thresholdAdaptiveRow( const uint32_t *blurTop, const uint32_t *blurBottom, int blurSize,
+						   const uint32_t *blockTop, const uint32_t *blockBottom, int blockSize,
+						   int offset, int flags, int width, uint8_t *blurred, uint8_t *mask )
+{
+	if ( ! ( kFlags & kGeneric ) )
+	{
+		flags = kFlags;
+	}
+	const bool invert = ( flags & kInvert ) != 0;
+	const bool keepBlurred = ( flags & kKeepBlurred ) != 0;
+	const int blurArea = blurSize * blurSize;
+	const int blockArea = blockSize * blockSize;
+	const float blurScale = 1.f / float( blurArea );
+	const float blockScale = 1.f / float( blockArea );
+	const bool blurExact = blurArea <= 256;
+	const bool blockExact = blockArea <= 256;
+
+	int x = 0;
+#if defined( MNDL_BLOBTRACKER_AVX2 )
+	const BoxMean8 blurMean( blurArea );
+	const BoxMean8 blockMean( blockArea );
+	// d > offset, or -offset > d when inverted
+	const __m256i offset8 = _mm256_set1_epi32( invert ? -offset : offset );
+	for ( ; x <= width - 16; x += 16 )
+	{
+		__m256i v[ 2 ];
+		__m256i pass[ 2 ];
+		for ( int j = 0; j < 2; j++ )
+		{
+			v[ j ] = blurMean( boxSums8( blurTop, blurBottom, blurSize, x + j * 8 ) );
+			__m256i d = _mm256_sub_epi32( v[ j ], blockMean( boxSums8( blockTop, blockBottom, blockSize, x + j * 8 ) ) );
+			pass[ j ] = invert ? _mm256_cmpgt_epi32( offset8, d ) : _mm256_cmpgt_epi32( d, offset8 );
+		}
+		// packs works within 128-bit lanes, restore the order of the 16-bit values
+		if ( keepBlurred )
+		{
+			__m256i words = _mm256_permute4x64_epi64( _mm256_packs_epi32( v[ 0 ], v[ 1 ] ), _MM_SHUFFLE( 3, 1, 2, 0 ) );
+			_mm_storeu_si128( reinterpret_cast< __m128i * >( blurred + x ),
+							  _mm_packus_epi16( _mm256_castsi256_si128( words ), _mm256_extracti128_si256( words, 1 ) ) );
+		}
+		__m256i words = _mm256_permute4x64_epi64( _mm256_packs_epi32( pass[ 0 ], pass[ 1 ] ), _MM_SHUFFLE( 3, 1, 2, 0 ) );
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( mask + x ),
+						  _mm_packs_epi16( _mm256_castsi256_si128( words ), _mm256_extracti128_si256( words, 1 ) ) );
+	}
+#elif defined( MNDL_BLOBTRACKER_SSE2 )
+	const BoxMean4 blurMean( blurArea );
+	const BoxMean4 blockMean( blockArea );
+	// d > offset, or -offset > d when inverted
+	const __m128i offset4 = _mm_set1_epi32( invert ? -offset : offset );
+	for ( ; x <= width - 16; x += 16 )
+	{
+		__m128i v[ 4 ];
+		__m128i pass[ 4 ];
+		for ( int j = 0; j < 4; j++ )
+		{
+			v[ j ] = blurMean( boxSums4( blurTop, blurBottom, blurSize, x + j * 4 ) );
+			__m128i d = _mm_sub_epi32( v[ j ], blockMean( boxSums4( blockTop, blockBottom, blockSize, x + j * 4 ) ) );
+			pass[ j ] = invert ? _mm_cmpgt_epi32( offset4, d ) : _mm_cmpgt_epi32( d, offset4 );
+		}
+		if ( keepBlurred )
+		{
+			_mm_storeu_si128( reinterpret_cast< __m128i * >( blurred + x ),
+							  _mm_packus_epi16( _mm_packs_epi32( v[ 0 ], v[ 1 ] ), _mm_packs_epi32( v[ 2 ], v[ 3 ] ) ) );
+		}
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( mask + x ),
+						  _mm_packs_epi16( _mm_packs_epi32( pass[ 0 ], pass[ 1 ] ), _mm_packs_epi32( pass[ 2 ], pass[ 3 ] ) ) );
+	}
+#endif
+
+	for ( ; x < width; x++ )
+	{
+		// the sums wrap around in the integral image, their differences do not
+		uint32_t blurSum = blurBottom[ x + blurSize ] - blurBottom[ x ] - blurTop[ x + blurSize ] + blurTop[ x ];
+		uint32_t blockSum = blockBottom[ x + blockSize ] - blockBottom[ x ] - blockTop[ x + blockSize ] + blockTop[ x ];
+		int v = boxMean( blurSum, blurArea, blurScale, blurExact );
+		int d = v - boxMean( blockSum, blockArea, blockScale, blockExact );
+		if ( keepBlurred )
+		{
+			blurred[ x ] = uint8_t( v );
+		}
+		mask[ x ] = ( invert ? ( d < -offset ) : ( d > offset ) ) ? 255 : 0;
+	}
+}
+
+typedef void ( *ThresholdAdaptiveRowFn )( const uint32_t *, const uint32_t *, int, const uint32_t *, const uint32_t *,
+										  int, int, int, int, uint8_t *, uint8_t * );
+
+// index of the generic variant, after the ones of the invert and keep blurred flags
+const int kThresholdAdaptiveGeneric = ( kInvert | kKeepBlurred ) + 1;
+
+// indexed by the invert and keep blurred flags, or kThresholdAdaptiveGeneric
+const ThresholdAdaptiveRowFn kThresholdAdaptiveRows[] = {
+	thresholdAdaptiveRow< 0 >, thresholdAdaptiveRow< kInvert >, thresholdAdaptiveRow< kKeepBlurred >,
+	thresholdAdaptiveRow< kInvert | kKeepBlurred >, thresholdAdaptiveRow< kGeneric > };
+static_assert( sizeof( kThresholdAdaptiveRows ) / sizeof( kThresholdAdaptiveRows[ 0 ] ) == kThresholdAdaptiveGeneric + 1,
+			   "kThresholdAdaptiveRows does not end with the generic variant" );
+
+} // anonymous namespace
+
+const uint8_t * FusedPreprocessStage::padRow( const cv::Mat &input, int y, int x0, int width )
+{
+	const uint8_t *src = input.ptr< uint8_t >( y );
+	mPaddedRow.resize( width );
+	uint8_t *padded = mPaddedRow.data();
+	const int inside1 = std::min( std::max( -x0, 0 ), width );
+	const int inside2 = std::max( std::min( input.cols - x0, width ), inside1 );
+	for ( int i = 0; i < inside1; i++ )
+	{
+		padded[ i ] = src[ cv::borderInterpolate( x0 + i, input.cols, cv::BORDER_REFLECT_101 ) ];
+	}
+	std::memcpy( padded + inside1, src + x0 + inside1, inside2 - inside1 );
+	for ( int i = inside2; i < width; i++ )
+	{
+		padded[ i ] = src[ cv::borderInterpolate( x0 + i, input.cols, cv::BORDER_REFLECT_101 ) ];
+	}
+	return padded;
+}
+
+void FusedPreprocessStage::sumRow( const cv::Mat &input, int y, const cv::Rect &area, int kernelSize, uint32_t *dst )
+{
+	const uint8_t *padded = padRow( input, y, area.x - kernelSize / 2, area.width + kernelSize - 1 );
+
+	uint32_t sum = 0;
+	for ( int i = 0; i < kernelSize - 1; i++ )
+	{
+		sum += padded[ i ];
+	}
+	for ( int x = 0; x < area.width; x++ )
+	{
+		sum += padded[ x + kernelSize - 1 ];
+		dst[ x ] = sum;
+		sum -= padded[ x ];
+	}
+}
+
+void FusedPreprocessStage::process( const cv::Mat &input, const cv::Rect &area, const Params &params,
+									cv::Mat &blurred, cv::Mat &thresholded, bool keepBlurred )
+{
+	processArea( input, area, params, blurred, &thresholded, nullptr, keepBlurred );
+}
+
+void FusedPreprocessStage::processBits( const cv::Mat &input, const cv::Rect &area, const Params &params,
+										cv::Mat &blurred, BitMask &mask, bool keepBlurred )
+{
+	processArea( input, area, params, blurred, nullptr, &mask, keepBlurred );
+}
+
+void FusedPreprocessStage::processArea( const cv::Mat &input, const cv::Rect &area, const Params &params,
+										cv::Mat &blurred, cv::Mat *thresholded, BitMask *mask, bool keepBlurred )
+{
+	const int kernelSize = std::max( params.mBlurSize, 1 );
+	const int w = area.width;
+	const int h = area.height;
+	if ( ( w <= 0 ) || ( h <= 0 ) )
+	{
+		return;
+	}
+	if ( params.mAdaptiveThresholdEnabled )
+	{
+		processAdaptive( input, area, params, blurred, thresholded, mask, keepBlurred );
+		return;
+	}
+	if ( mask != nullptr )
+	{
+		mMaskRow.resize( w );
+	}
+
+	// input row area.y - kernelSize / 2 + i is kept in slot i % ringSize, the slots start zeroed,
+	// so subtracting the row before the window is a no-op for the first output row
+	const int ringSize = kernelSize + 1;
+	mRowSums.assign( size_t( ringSize ) * w, 0 );
+	mColumnSums.assign( w, 0 );
+	auto rowSums = [ & ]( int i ) { return mRowSums.data() + size_t( i % ringSize ) * w; };
+	const int y0 = area.y - kernelSize / 2;
+
+	// the column pass is picked once for the area
+	const int kernelArea = kernelSize * kernelSize;
+	const int flags = ( params.mThresholdInvertEnabled ? kInvert : 0 ) | ( keepBlurred ? kKeepBlurred : 0 ) |
+					  ( ( kernelArea <= 256 ) ? kExactDivision : 0 );
+	const SumColumnsFn sumColumnsFn = kSumColumns[ params.mSpecializationEnabled ? flags : kGeneric ];
+
+	for ( int i = 0; i < kernelSize - 1; i++ )
+	{
+		uint32_t *row = rowSums( i );
+		sumRow( input, cv::borderInterpolate( y0 + i, input.rows, cv::BORDER_REFLECT_101 ), area, kernelSize, row );
+		for ( int x = 0; x < w; x++ )
+		{
+			mColumnSums[ x ] += row[ x ];
+		}
+	}
+
+	for ( int y = 0; y < h; y++ )
+	{
+		int i = y + kernelSize - 1;
+		uint32_t *newRow = rowSums( i );
+		sumRow( input, cv::borderInterpolate( y0 + i, input.rows, cv::BORDER_REFLECT_101 ), area, kernelSize, newRow );
+
+		uint8_t *blurredRow = keepBlurred ? blurred.ptr< uint8_t >( area.y + y ) + area.x : nullptr;
+		uint8_t *maskRow = ( thresholded != nullptr ) ? thresholded->ptr< uint8_t >( area.y + y ) + area.x :
+						   mMaskRow.data();
+		sumColumnsFn( mColumnSums.data(), newRow, rowSums( i + 1 ), w, kernelArea, params.mThreshold, flags,
+					  blurredRow, maskRow );
+		if ( mask != nullptr )
+		{
+			mask->packRow( maskRow, area.x, area.y + y, w );
+		}
+	}
+}
+
+void FusedPreprocessStage::processAdaptive( const cv::Mat &input, const cv::Rect &area, const Params &params,
+											cv::Mat &blurred, cv::Mat *thresholded, BitMask *mask,
+											bool keepBlurred )
+{
+	const int blurSize = std::max( params.mBlurSize, 1 );
+	const int blockSize = std::max( params.mAdaptiveBlockSize, 1 );
+	const int w = area.width;
+	const int h = area.height;
+
+	// the kernels start kernelSize / 2 pixels before their center like in cv::blur, the padded rows and the
+	// window of rows cover both
+	const int before = std::max( blurSize / 2, blockSize / 2 );
+	const int after = std::max( blurSize - 1 - blurSize / 2, blockSize - 1 - blockSize / 2 );
+	const int x0 = area.x - before;
+	const int y0 = area.y - before;
+	const int paddedWidth = w + before + after;
+	if ( mask != nullptr )
+	{
+		mMaskRow.resize( w );
+	}
+
+	// integral row j sums the padded rows above input row y0 + j, output row y spans the integral rows from y to
+	// y + before + after + 1. The slots start zeroed, slot 0 is the first integral row
+	const int ringSize = before + after + 2;
+	const size_t rowStride = size_t( paddedWidth ) + 1;
+	mIntegralRows.assign( size_t( ringSize ) * rowStride, 0 );
+	auto integralRow = [ & ]( int j ) { return mIntegralRows.data() + size_t( j % ringSize ) * rowStride; };
+	auto addRow = [ & ]( int j )
+	{
+		const uint8_t *padded = padRow( input, cv::borderInterpolate( y0 + j - 1, input.rows, cv::BORDER_REFLECT_101 ),
+										x0, paddedWidth );
+		const uint32_t *prev = integralRow( j - 1 );
+		uint32_t *row = integralRow( j );
+		uint32_t sum = 0;
+		for ( int x = 0; x < paddedWidth; x++ )
+		{
+			sum += padded[ x ];
+			row[ x + 1 ] = prev[ x + 1 ] + sum;
+		}
+	};
+
+	// the row pass is picked once for the area
+	const int flags = ( params.mThresholdInvertEnabled ? kInvert : 0 ) | ( keepBlurred ? kKeepBlurred : 0 );
+	const ThresholdAdaptiveRowFn thresholdRow =
+		kThresholdAdaptiveRows[ params.mSpecializationEnabled ? flags : kThresholdAdaptiveGeneric ];
+	const int blurStart = before - blurSize / 2;
+	const int blockStart = before - blockSize / 2;
+
+	for ( int j = 1; j < ringSize - 1; j++ )
+	{
+		addRow( j );
+	}
+
+	for ( int y = 0; y < h; y++ )
+	{
+		addRow( y + ringSize - 1 );
+
+		uint8_t *blurredRow = keepBlurred ? blurred.ptr< uint8_t >( area.y + y ) + area.x : nullptr;
+		uint8_t *maskRow = ( thresholded != nullptr ) ? thresholded->ptr< uint8_t >( area.y + y ) + area.x :
+						   mMaskRow.data();
+		thresholdRow( integralRow( y + blurStart ) + blurStart, integralRow( y + blurStart + blurSize ) + blurStart,
+					  blurSize, integralRow( y + blockStart ) + blockStart,
+					  integralRow( y + blockStart + blockSize ) + blockStart, blockSize, params.mAdaptiveOffset, flags,
+					  w, blurredRow, maskRow );
+		if ( mask != nullptr )
+		{
+			mask->packRow( maskRow, area.x, area.y + y, w );
+		}
+	}
+}
+
+} } // namespace mndl::blobtracker
@@ -0,0 +1,153 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mndl/blobtracker/SpatialGrid.h"
+
+using namespace ci;
+using namespace std;
+
+namespace mndl { namespace blobtracker {
+
+void SpatialGrid::build( const vector< vec2 > &points, float pointsPerCell )
+{
+	const size_t n = points.size();
+	mPoints.resize( n );
+	mIndices.resize( n );
+	if ( n == 0 )
+	{
+		mNumCols = mNumRows = 0;
+		mCellStarts.assign( 1, 0 );
+		return;
+	}
+
+	vec2 lo = points[ 0 ];
+	vec2 hi = points[ 0 ];
+	for ( const vec2 &p : points )
+	{
+		lo = vec2( std::min( lo.x, p.x ), std::min( lo.y, p.y ) );
+		hi = vec2( std::max( hi.x, p.x ), std::max( hi.y, p.y ) );
+	}
+
+	// cells of pointsPerCell points if the points were spread evenly over their bounds, or along the longer
+	// side if they are on a line, so there are at most about n / pointsPerCell cells
+	const vec2 size = hi - lo;
+	float cellSize = std::sqrt( size.x * size.y * pointsPerCell / float( n ) );
+	cellSize = std::max( cellSize, std::max( size.x, size.y ) * pointsPerCell / float( n ) );
+	if ( ! ( cellSize > 0.f ) )
+	{
+		// all points in one place
+		cellSize = 1.f;
+	}
+	mOrigin = lo;
+	mCellSize = cellSize;
+	mInvCellSize = 1.f / cellSize;
+	mNumCols = int( size.x * mInvCellSize ) + 1;
+	mNumRows = int( size.y * mInvCellSize ) + 1;
+
+	// counting sort, the points keep their order within a cell
+	const size_t numCells = size_t( mNumCols ) * mNumRows;
+	mCellStarts.assign( numCells + 1, 0 );
+	mPointCells.resize( n );
+	for ( size_t i = 0; i < n; i++ )
+	{
+		const vec2 p = ( points[ i ] - lo ) * mInvCellSize;
+		const int x = std::min( int( p.x ), mNumCols - 1 );
+		const int y = std::min( int( p.y ), mNumRows - 1 );
+		const uint32_t cell = uint32_t( y * mNumCols + x );
+		mPointCells[ i ] = cell;
+		mCellStarts[ cell ]++;
+	}
+	uint32_t start = 0;
+	for ( size_t c = 0; c <= numCells; c++ )
+	{
+		const uint32_t count = mCellStarts[ c ];
+		mCellStarts[ c ] = start;
+		start += count;
+	}
+	// placing a point advances the start of its cell to the start of the next one
+	for ( size_t i = 0; i < n; i++ )
+	{
+		const uint32_t k = mCellStarts[ mPointCells[ i ] ]++;
+		mPoints[ k ] = points[ i ];
+		mIndices[ k ] = uint32_t( i );
+	}
+	for ( size_t c = numCells; c > 0; c-- )
+	{
+		mCellStarts[ c ] = mCellStarts[ c - 1 ];
+	}
+	mCellStarts[ 0 ] = 0;
+}
+
+int32_t SpatialGrid::findNearest( const vec2 &pos, float maxDistance ) const
+{
+	if ( mIndices.empty() )
+	{
+		return -1;
+	}
+
+	int32_t best = -1;
+	float bestDistSq = maxDistance * maxDistance;
+	searchRings( pos,
+		[ & ]( float distSq, uint32_t k )
+		{
+			const int32_t index = int32_t( k );
+			if ( ( distSq < bestDistSq ) || ( ( distSq == bestDistSq ) && ( ( best == -1 ) || ( index < best ) ) ) )
+			{
+				best = index;
+				bestDistSq = distSq;
+			}
+		},
+		[ & ]() { return bestDistSq; } );
+	return best;
+}
+
+void SpatialGrid::findNearest( const vec2 &pos, float maxDistance, size_t k, vector< pair< float, uint32_t > > *nearest ) const
+{
+	nearest->clear();
+	if ( mIndices.empty() || ( k == 0 ) )
+	{
+		return;
+	}
+
+	// sorted by the distance, then the index, by insertion, k is small
+	const float maxDistSq = maxDistance * maxDistance;
+	searchRings( pos,
+		[ & ]( float distSq, uint32_t index )
+		{
+			const pair< float, uint32_t > point( distSq, index );
+			if ( ( distSq > maxDistSq ) || ( ( nearest->size() == k ) && ! ( point < nearest->back() ) ) )
+			{
+				return;
+			}
+			if ( nearest->size() == k )
+			{
+				nearest->pop_back();
+			}
+			nearest->insert( std::upper_bound( nearest->begin(), nearest->end(), point ), point );
+		},
+		[ & ]() { return ( nearest->size() == k ) ? nearest->back().first : maxDistSq; } );
+}
+
+void SpatialGrid::getCellRange( const vec2 &pos, float radius, int *x1, int *y1, int *x2, int *y2 ) const
+{
+	*x1 = std::max( toCell( pos.x - radius - mOrigin.x, mNumCols ), 0 );
+	*y1 = std::max( toCell( pos.y - radius - mOrigin.y, mNumRows ), 0 );
+	*x2 = std::min( toCell( pos.x + radius - mOrigin.x, mNumCols ), mNumCols - 1 );
+	*y2 = std::min( toCell( pos.y + radius - mOrigin.y, mNumRows ), mNumRows - 1 );
+}
+
+} } // namespace mndl::blobtracker
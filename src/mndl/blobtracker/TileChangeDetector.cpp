@@ -0,0 +1,147 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstdlib>
+
+#if defined( MNDL_BLOBTRACKER_NO_SIMD )
+#elif defined( __AVX2__ )
+#define MNDL_BLOBTRACKER_AVX2
+#include <immintrin.h>
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && ( _M_IX86_FP >= 2 ) )
+#define MNDL_BLOBTRACKER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "mndl/blobtracker/TileChangeDetector.h"
+
+using namespace std;
+
+namespace mndl { namespace blobtracker {
+
+uint32_t TileChangeDetector::sumAbsDiff( const uint8_t *a, const uint8_t *b, int n )
+{
+	uint32_t sum = 0;
+	int x = 0;
+#if defined( MNDL_BLOBTRACKER_AVX2 )
+	__m256i sums = _mm256_setzero_si256();
+	for ( ; x + 32 <= n; x += 32 )
+	{
+		__m256i va = _mm256_loadu_si256( reinterpret_cast< const __m256i * >( a + x ) );
+		__m256i vb = _mm256_loadu_si256( reinterpret_cast< const __m256i * >( b + x ) );
+		sums = _mm256_add_epi64( sums, _mm256_sad_epu8( va, vb ) );
+	}
+	// the four 64-bit lane sums fit in 32 bits for any row length
+	__m128i half = _mm_add_epi64( _mm256_castsi256_si128( sums ), _mm256_extracti128_si256( sums, 1 ) );
+	sum += uint32_t( _mm_cvtsi128_si32( _mm_add_epi64( half, _mm_srli_si128( half, 8 ) ) ) );
+#endif
+#if defined( MNDL_BLOBTRACKER_AVX2 ) || defined( MNDL_BLOBTRACKER_SSE2 )
+	__m128i sums16 = _mm_setzero_si128();
+	for ( ; x + 16 <= n; x += 16 )
+	{
+		__m128i va = _mm_loadu_si128( reinterpret_cast< const __m128i * >( a + x ) );
+		__m128i vb = _mm_loadu_si128( reinterpret_cast< const __m128i * >( b + x ) );
+		sums16 = _mm_add_epi64( sums16, _mm_sad_epu8( va, vb ) );
+	}
+	sum += uint32_t( _mm_cvtsi128_si32( _mm_add_epi64( sums16, _mm_srli_si128( sums16, 8 ) ) ) );
+#endif
+	for ( ; x < n; x++ )
+	{
+		sum += uint32_t( std::abs( int( a[ x ] ) - int( b[ x ] ) ) );
+	}
+	return sum;
+}
+
+size_t TileChangeDetector::update( const cv::Mat &image, const cv::Rect &area, int tileSize, float threshold,
+								   bool reset )
+{
+	tileSize = std::max( tileSize, 1 );
+	const int tilesX = ( area.width + tileSize - 1 ) / tileSize;
+	const int tilesY = ( area.height + tileSize - 1 ) / tileSize;
+	mNumTiles = size_t( tilesX ) * size_t( tilesY );
+	mDirtyRects.clear();
+
+	if ( reset || mReference.empty() || ( mReference.size() != image.size() ) ||
+		 ( mArea != area ) || ( mTileSize != tileSize ) )
+	{
+		mReference.create( image.size(), CV_8UC1 );
+		cv::Mat dst = mReference( area );
+		image( area ).copyTo( dst );
+		mArea = area;
+		mTileSize = tileSize;
+		mNumDirtyTiles = mNumTiles;
+		if ( mNumTiles > 0 )
+		{
+			mDirtyRects.push_back( area );
+		}
+		return mNumDirtyTiles;
+	}
+
+	mNumDirtyTiles = 0;
+	mTileSums.resize( tilesX );
+	for ( int ty = 0; ty < tilesY; ty++ )
+	{
+		const int y1 = area.y + ty * tileSize;
+		const int y2 = std::min( y1 + tileSize, area.y + area.height );
+		std::fill( mTileSums.begin(), mTileSums.end(), 0 );
+		for ( int y = y1; y < y2; y++ )
+		{
+			const uint8_t *row = image.ptr< uint8_t >( y );
+			const uint8_t *refRow = mReference.ptr< uint8_t >( y );
+			for ( int tx = 0; tx < tilesX; tx++ )
+			{
+				int x1 = area.x + tx * tileSize;
+				int x2 = std::min( x1 + tileSize, area.x + area.width );
+				mTileSums[ tx ] += sumAbsDiff( row + x1, refRow + x1, x2 - x1 );
+			}
+		}
+
+		// runs of dirty tiles become one rect
+		int runStart = -1;
+		for ( int tx = 0; tx <= tilesX; tx++ )
+		{
+			bool dirty = false;
+			if ( tx < tilesX )
+			{
+				int x1 = area.x + tx * tileSize;
+				int x2 = std::min( x1 + tileSize, area.x + area.width );
+				dirty = float( mTileSums[ tx ] ) > threshold * float( ( x2 - x1 ) * ( y2 - y1 ) );
+			}
+			if ( dirty )
+			{
+				mNumDirtyTiles++;
+				if ( runStart < 0 )
+				{
+					runStart = tx;
+				}
+			}
+			else if ( runStart >= 0 )
+			{
+				int x1 = area.x + runStart * tileSize;
+				int x2 = std::min( area.x + tx * tileSize, area.x + area.width );
+				cv::Rect rect( x1, y1, x2 - x1, y2 - y1 );
+				cv::Mat dst = mReference( rect );
+				image( rect ).copyTo( dst );
+				mDirtyRects.push_back( rect );
+				runStart = -1;
+			}
+		}
+	}
+	return mNumDirtyTiles;
+}
+
+} } // namespace mndl::blobtracker
@@ -0,0 +1,541 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstring>
+
+#if defined( _WIN32 )
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mndl/blobtracker/TrackRecording.h"
+
+using namespace ci;
+using namespace std;
+
+namespace mndl { namespace blobtracker {
+
+namespace {
+
+// file layout, all fields little-endian, swapped by put() and get() on big-endian hosts
+//   header: char magic[ 8 ], uint32 version, uint32 byte order mark
+//   record: uint32 size, uint32 flags, uint64 frame number, float64 timestamp,
+//           uint32 began, moved, ended, hull points
+//           blobs in began, moved, ended order: int32 id, uint32 hull points, float32 pos[ 2 ],
+//           prevPos[ 2 ], bounds[ 4 ]
+//           hull points of the blobs in the same order: float32 [ 2 ]
+//   index: uint64 record offsets
+//   footer: uint64 index offset, uint64 number of frames, char magic[ 8 ]
+// every part is a multiple of 8 bytes long, so the records stay aligned
+const char kMagic[ 8 ] = { 'M', 'N', 'D', 'L', 'T', 'R', 'K', 0 };
+const char kIndexMagic[ 8 ] = { 'M', 'N', 'D', 'L', 'I', 'D', 'X', 0 };
+const uint32_t kVersion = 1;
+const uint32_t kByteOrderMark = 0x01020304;
+const size_t kHeaderSize = 16;
+const size_t kRecordHeaderSize = 40;
+const size_t kBlobSize = 40;
+const size_t kHullPointSize = 8;
+const size_t kFooterSize = 24;
+
+const uint32_t kFlagExtrapolated = 1;
+
+//! Returns whether the host stores the lowest byte first, like the file.
+inline bool isHostLittleEndian()
+{
+	const uint32_t one = 1;
+	uint8_t first;
+	std::memcpy( &first, &one, 1 );
+	return first == 1;
+}
+
+template< typename T >
+uint8_t *put( uint8_t *p, T value )
+{
+	std::memcpy( p, &value, sizeof( T ) );
+	if ( ! isHostLittleEndian() )
+	{
+		std::reverse( p, p + sizeof( T ) );
+	}
+	return p + sizeof( T );
+}
+
+// the mapping has no alignment guarantee for the compiler, read through memcpy
+template< typename T >
+T get( const uint8_t *p )
+{
+	uint8_t bytes[ sizeof( T ) ];
+	std::memcpy( bytes, p, sizeof( T ) );
+	if ( ! isHostLittleEndian() )
+	{
+		std::reverse( bytes, bytes + sizeof( T ) );
+	}
+	T value;
+	std::memcpy( &value, bytes, sizeof( T ) );
+	return value;
+}
+
+} // anonymous namespace
+
+TrackRecorderRef TrackRecorder::create( const fs::path &path )
+{
+	std::FILE *file = std::fopen( path.string().c_str(), "wb" );
+	if ( file == nullptr )
+	{
+		return TrackRecorderRef();
+	}
+
+	TrackRecorderRef recorder( new TrackRecorder( file ) );
+	uint8_t header[ kHeaderSize ];
+	std::memcpy( header, kMagic, sizeof( kMagic ) );
+	put( put( header + sizeof( kMagic ), kVersion ), kByteOrderMark );
+	recorder->writeBytes( header, sizeof( header ) );
+	return recorder;
+}
+
+TrackRecorder::TrackRecorder( std::FILE *file ) :
+	mFile( file )
+{}
+
+TrackRecorder::~TrackRecorder()
+{
+	close();
+}
+
+void TrackRecorder::writeBytes( const void *data, size_t size )
+{
+	if ( ( mFile == nullptr ) || ! mGood || ( size == 0 ) )
+	{
+		return;
+	}
+
+	if ( std::fwrite( data, 1, size, mFile ) != size )
+	{
+		mGood = false;
+		std::fclose( mFile );
+		mFile = nullptr;
+		return;
+	}
+	mOffset += size;
+}
+
+void TrackRecorder::write( const FrameResultRef &frameResult )
+{
+	if ( mFile == nullptr )
+	{
+		return;
+	}
+
+	const FrameResult &frame = *frameResult;
+	const Span< FrameResult::BlobState > groups[ 3 ] = { frame.getBegan(), frame.getMoved(), frame.getEnded() };
+	size_t numBlobs = 0;
+	size_t numHullPoints = 0;
+	for ( const Span< FrameResult::BlobState > &blobs : groups )
+	{
+		numBlobs += blobs.size();
+		for ( const FrameResult::BlobState &blob : blobs )
+		{
+			numHullPoints += blob.mNumHullPoints;
+		}
+	}
+
+	const size_t size = kRecordHeaderSize + numBlobs * kBlobSize + numHullPoints * kHullPointSize;
+	mRecord.resize( size );
+	uint8_t *p = mRecord.data();
+	p = put( p, uint32_t( size ) );
+	p = put( p, uint32_t( frame.isExtrapolated() ? kFlagExtrapolated : 0 ) );
+	p = put( p, uint64_t( frame.getFrameNumber() ) );
+	p = put( p, double( frame.getTimestamp() ) );
+	for ( const Span< FrameResult::BlobState > &blobs : groups )
+	{
+		p = put( p, uint32_t( blobs.size() ) );
+	}
+	p = put( p, uint32_t( numHullPoints ) );
+
+	for ( const Span< FrameResult::BlobState > &blobs : groups )
+	{
+		for ( const FrameResult::BlobState &blob : blobs )
+		{
+			p = put( p, int32_t( blob.mId ) );
+			p = put( p, uint32_t( blob.mNumHullPoints ) );
+			p = put( put( p, blob.mPos.x ), blob.mPos.y );
+			p = put( put( p, blob.mPrevPos.x ), blob.mPrevPos.y );
+			p = put( put( put( put( p, blob.mBounds.x1 ), blob.mBounds.y1 ), blob.mBounds.x2 ), blob.mBounds.y2 );
+		}
+	}
+	for ( const Span< FrameResult::BlobState > &blobs : groups )
+	{
+		for ( const FrameResult::BlobState &blob : blobs )
+		{
+			for ( const vec2 &pt : frame.getHullPoints( blob ) )
+			{
+				p = put( put( p, pt.x ), pt.y );
+			}
+		}
+	}
+
+	mOffsets.push_back( mOffset );
+	writeBytes( mRecord.data(), size );
+}
+
+void TrackRecorder::flush()
+{
+	if ( mFile != nullptr )
+	{
+		std::fflush( mFile );
+	}
+}
+
+void TrackRecorder::close()
+{
+	if ( mFile == nullptr )
+	{
+		return;
+	}
+
+	uint64_t indexOffset = mOffset;
+	if ( ! isHostLittleEndian() )
+	{
+		for ( uint64_t &offset : mOffsets )
+		{
+			put( reinterpret_cast< uint8_t * >( &offset ), offset );
+		}
+	}
+	writeBytes( mOffsets.data(), mOffsets.size() * sizeof( uint64_t ) );
+	uint8_t footer[ kFooterSize ];
+	std::memcpy( put( put( footer, indexOffset ), uint64_t( mOffsets.size() ) ), kIndexMagic, sizeof( kIndexMagic ) );
+	writeBytes( footer, sizeof( footer ) );
+	if ( mFile != nullptr )
+	{
+		mGood = ( std::fclose( mFile ) == 0 ) && mGood;
+		mFile = nullptr;
+	}
+}
+
+//! Read-only memory mapping of a whole file.
+class TrackPlayer::MappedFile
+{
+ public:
+	~MappedFile()
+	{
+#if defined( _WIN32 )
+		if ( mData != nullptr )
+		{
+			UnmapViewOfFile( mData );
+		}
+		if ( mMapping != nullptr )
+		{
+			CloseHandle( mMapping );
+		}
+		if ( mFile != INVALID_HANDLE_VALUE )
+		{
+			CloseHandle( mFile );
+		}
+#else
+		if ( mData != nullptr )
+		{
+			munmap( const_cast< uint8_t * >( mData ), mSize );
+		}
+#endif
+	}
+
+	//! Maps \a path, returns false if it cannot be opened or is empty.
+	bool open( const fs::path &path )
+	{
+#if defined( _WIN32 )
+		mFile = CreateFileW( path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+							 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+		LARGE_INTEGER size;
+		if ( ( mFile == INVALID_HANDLE_VALUE ) || ! GetFileSizeEx( mFile, &size ) || ( size.QuadPart == 0 ) )
+		{
+			return false;
+		}
+		mSize = size_t( size.QuadPart );
+		mMapping = CreateFileMappingW( mFile, nullptr, PAGE_READONLY, 0, 0, nullptr );
+		if ( mMapping == nullptr )
+		{
+			return false;
+		}
+		mData = static_cast< const uint8_t * >( MapViewOfFile( mMapping, FILE_MAP_READ, 0, 0, 0 ) );
+		return mData != nullptr;
+#else
+		int fd = ::open( path.string().c_str(), O_RDONLY );
+		if ( fd < 0 )
+		{
+			return false;
+		}
+		struct stat st;
+		if ( ( fstat( fd, &st ) != 0 ) || ( st.st_size == 0 ) )
+		{
+			::close( fd );
+			return false;
+		}
+		// the mapping stays valid after closing the descriptor
+		void *data = mmap( nullptr, size_t( st.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 );
+		::close( fd );
+		if ( data == MAP_FAILED )
+		{
+			return false;
+		}
+		mData = static_cast< const uint8_t * >( data );
+		mSize = size_t( st.st_size );
+		return true;
+#endif
+	}
+
+	const uint8_t *getData() const { return mData; }
+	size_t getSize() const { return mSize; }
+
+ private:
+	const uint8_t *mData = nullptr;
+	size_t mSize = 0;
+#if defined( _WIN32 )
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	HANDLE mMapping = nullptr;
+#endif
+};
+
+TrackPlayerRef TrackPlayer::create( const fs::path &path )
+{
+	unique_ptr< MappedFile > file( new MappedFile() );
+	if ( ! file->open( path ) )
+	{
+		return TrackPlayerRef();
+	}
+
+	const uint8_t *data = file->getData();
+	const size_t size = file->getSize();
+	if ( ( size < kHeaderSize ) || ( std::memcmp( data, kMagic, sizeof( kMagic ) ) != 0 ) ||
+		 ( get< uint32_t >( data + 8 ) > kVersion ) || ( get< uint32_t >( data + 12 ) != kByteOrderMark ) )
+	{
+		return TrackPlayerRef();
+	}
+
+	// the index of a closed recording
+	vector< uint64_t > index;
+	if ( ( size >= kHeaderSize + kFooterSize ) &&
+		 ( std::memcmp( data + size - sizeof( kIndexMagic ), kIndexMagic, sizeof( kIndexMagic ) ) == 0 ) )
+	{
+		const uint8_t *footer = data + size - kFooterSize;
+		uint64_t indexOffset = get< uint64_t >( footer );
+		uint64_t numFrames = get< uint64_t >( footer + 8 );
+		if ( ( numFrames > 0 ) && ( indexOffset >= kHeaderSize ) && ( indexOffset <= size - kFooterSize ) &&
+			 ( numFrames == ( size - kFooterSize - indexOffset ) / sizeof( uint64_t ) ) )
+		{
+			index.resize( size_t( numFrames ) );
+			for ( size_t i = 0; i < index.size(); i++ )
+			{
+				index[ i ] = get< uint64_t >( data + indexOffset + i * sizeof( uint64_t ) );
+			}
+		}
+		for ( uint64_t offset : index )
+		{
+			if ( ( offset < kHeaderSize ) || ( offset + kRecordHeaderSize > indexOffset ) ||
+				 ( get< uint32_t >( data + offset ) > indexOffset - offset ) )
+			{
+				index.clear();
+				break;
+			}
+		}
+	}
+
+	// otherwise the recording was not closed, index the whole records
+	if ( index.empty() )
+	{
+		size_t offset = kHeaderSize;
+		while ( size - offset >= kRecordHeaderSize )
+		{
+			uint32_t recordSize = get< uint32_t >( data + offset );
+			if ( ( recordSize < kRecordHeaderSize ) || ( recordSize > size - offset ) )
+			{
+				break;
+			}
+			index.push_back( offset );
+			offset += recordSize;
+		}
+	}
+
+	return TrackPlayerRef( new TrackPlayer( std::move( file ), std::move( index ) ) );
+}
+
+TrackPlayer::TrackPlayer( unique_ptr< MappedFile > file, vector< uint64_t > index ) :
+	mFile( std::move( file ) ),
+	mIndex( std::move( index ) )
+{}
+
+TrackPlayer::~TrackPlayer()
+{}
+
+double TrackPlayer::getFrameTime( size_t frameIndex ) const
+{
+	return get< double >( mFile->getData() + mIndex[ frameIndex ] + 16 );
+}
+
+void TrackPlayer::seek( size_t frameIndex )
+{
+	mFrameIndex = std::min( frameIndex, mIndex.size() );
+	mClockStarted = false;
+}
+
+void TrackPlayer::setSpeed( double speed )
+{
+	// keeps the recorded time reached so far
+	if ( mClockStarted )
+	{
+		double now = FrameResult::getCurrentTime();
+		mClockFrameTime += ( now - mClockStart ) * mSpeed;
+		mClockStart = now;
+	}
+	mSpeed = std::max( speed, 0.0 );
+}
+
+size_t TrackPlayer::update()
+{
+	if ( mLoop && isDone() )
+	{
+		seek( 0 );
+	}
+	if ( isDone() )
+	{
+		return 0;
+	}
+
+	double now = FrameResult::getCurrentTime();
+	if ( ! mClockStarted )
+	{
+		mClockStarted = true;
+		mClockStart = now;
+		mClockFrameTime = getFrameTime( mFrameIndex );
+	}
+
+	double due = mClockFrameTime + ( now - mClockStart ) * mSpeed;
+	size_t numPlayed = 0;
+	while ( ! isDone() && ( getFrameTime( mFrameIndex ) <= due ) )
+	{
+		playNextFrame();
+		numPlayed++;
+	}
+	return numPlayed;
+}
+
+bool TrackPlayer::playNextFrame()
+{
+	if ( mLoop && isDone() )
+	{
+		seek( 0 );
+	}
+	if ( isDone() )
+	{
+		return false;
+	}
+
+	mFrameResult = decodeFrame( mFrameIndex++ );
+	emitSignals( mFrameResult );
+	return true;
+}
+
+shared_ptr< FrameResult > TrackPlayer::decodeFrame( size_t frameIndex )
+{
+	shared_ptr< FrameResult > frameResult = mFrameResultCache.acquire();
+
+	// the record sizes were checked when indexing, the counts are trusted up to the record size
+	const uint8_t *record = mFile->getData() + mIndex[ frameIndex ];
+	const size_t recordSize = get< uint32_t >( record );
+	FrameResult &frame = *frameResult;
+	frame.mExtrapolated = ( get< uint32_t >( record + 4 ) & kFlagExtrapolated ) != 0;
+	frame.mFrameNumber = get< uint64_t >( record + 8 );
+	frame.mTimestamp = get< double >( record + 16 );
+	vector< FrameResult::BlobState > *groups[ 3 ] = { &frame.mBegan, &frame.mMoved, &frame.mEnded };
+	size_t numBlobs[ 3 ];
+	for ( int i = 0; i < 3; i++ )
+	{
+		numBlobs[ i ] = get< uint32_t >( record + 24 + 4 * i );
+	}
+	const size_t numHullPoints = get< uint32_t >( record + 36 );
+	if ( kRecordHeaderSize + ( numBlobs[ 0 ] + numBlobs[ 1 ] + numBlobs[ 2 ] ) * kBlobSize +
+		 numHullPoints * kHullPointSize > recordSize )
+	{
+		return frameResult;
+	}
+
+	const uint8_t *p = record + kRecordHeaderSize;
+	const uint8_t *hullData = p + ( numBlobs[ 0 ] + numBlobs[ 1 ] + numBlobs[ 2 ] ) * kBlobSize;
+	frame.mHullPoints.resize( numHullPoints );
+	if ( ( numHullPoints > 0 ) && isHostLittleEndian() )
+	{
+		std::memcpy( frame.mHullPoints.data(), hullData, numHullPoints * kHullPointSize );
+	}
+	else
+	{
+		for ( size_t i = 0; i < numHullPoints; i++ )
+		{
+			const uint8_t *point = hullData + i * kHullPointSize;
+			frame.mHullPoints[ i ] = vec2( get< float >( point ), get< float >( point + 4 ) );
+		}
+	}
+	uint32_t firstHullPoint = 0;
+	for ( int i = 0; i < 3; i++ )
+	{
+		for ( size_t j = 0; j < numBlobs[ i ]; j++, p += kBlobSize )
+		{
+			FrameResult::BlobState blob;
+			blob.mId = get< int32_t >( p );
+			blob.mNumHullPoints = std::min( get< uint32_t >( p + 4 ), uint32_t( numHullPoints - firstHullPoint ) );
+			blob.mFirstHullPoint = firstHullPoint;
+			firstHullPoint += blob.mNumHullPoints;
+			blob.mPos = vec2( get< float >( p + 8 ), get< float >( p + 12 ) );
+			blob.mPrevPos = vec2( get< float >( p + 16 ), get< float >( p + 20 ) );
+			blob.mBounds = Rectf( get< float >( p + 24 ), get< float >( p + 28 ),
+								  get< float >( p + 32 ), get< float >( p + 36 ) );
+			blob.mExtrapolated = frame.mExtrapolated;
+			groups[ i ]->push_back( blob );
+		}
+	}
+	return frameResult;
+}
+
+void TrackPlayer::emitSignals( const FrameResultRef &frameResult )
+{
+	mFrameSig.emit( frameResult );
+
+	// the order of BlobTracker
+	const FrameResult &frame = *frameResult;
+	for ( const FrameResult::BlobState &blob : frame.getEnded() )
+	{
+		mBlobsEndedSig.emit( BlobEvent( frameResult, blob ) );
+	}
+	for ( const FrameResult::BlobState &blob : frame.getMoved() )
+	{
+		mBlobsMovedSig.emit( BlobEvent( frameResult, blob ) );
+	}
+	for ( const FrameResult::BlobState &blob : frame.getBegan() )
+	{
+		mBlobsBeganSig.emit( BlobEvent( frameResult, blob ) );
+	}
+}
+
+} } // namespace mndl::blobtracker
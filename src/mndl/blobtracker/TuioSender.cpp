@@ -0,0 +1,502 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#if defined( _WIN32 )
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#if defined( _MSC_VER )
+#pragma comment( lib, "ws2_32.lib" )
+#endif
+#else
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include "mndl/blobtracker/TuioSender.h"
+
+using namespace ci;
+using namespace std;
+
+namespace mndl { namespace blobtracker {
+
+namespace {
+
+#if defined( _WIN32 )
+typedef SOCKET SocketHandle;
+const SocketHandle kInvalidSocket = INVALID_SOCKET;
+void closeSocket( SocketHandle socket ) { closesocket( socket ); }
+#else
+typedef int SocketHandle;
+const SocketHandle kInvalidSocket = -1;
+void closeSocket( SocketHandle socket ) { ::close( socket ); }
+#endif
+
+// OSC 1.0, big-endian 32-bit arguments, strings zero terminated and padded to 4 bytes
+const char kBundleTag[ 8 ] = { '#', 'b', 'u', 'n', 'd', 'l', 'e', 0 };
+const uint64_t kTimeTagImmediately = 1;
+// seconds from the NTP epoch of OSC time tags to the Unix epoch
+const uint64_t kNtpUnixOffset = 2208988800ull;
+
+const char kTuio1Address[] = "/tuio/2Dblb";
+const char kTuio2FrameAddress[] = "/tuio2/frm";
+const char kTuio2BoundsAddress[] = "/tuio2/bnd";
+const char kTuio2AliveAddress[] = "/tuio2/alv";
+
+size_t padded( size_t size ) { return ( size + 3 ) & ~size_t( 3 ); }
+
+//! Returns the size of a bundle element holding a message to \a address with \a numArgs arguments of
+//! \a argsSize bytes in total.
+size_t getMessageSize( const char *address, size_t numArgs, size_t argsSize )
+{
+	return 4 + padded( std::strlen( address ) + 1 ) + padded( numArgs + 2 ) + argsSize;
+}
+
+//! Appends \a size zeroed bytes to \a data and returns their offset. Does not allocate within the capacity.
+size_t grow( vector< uint8_t > &data, size_t size )
+{
+	size_t offset = data.size();
+	data.resize( offset + size, 0 );
+	return offset;
+}
+
+void putInt32( vector< uint8_t > &data, uint32_t value )
+{
+	uint8_t *p = &data[ grow( data, 4 ) ];
+	p[ 0 ] = uint8_t( value >> 24 );
+	p[ 1 ] = uint8_t( value >> 16 );
+	p[ 2 ] = uint8_t( value >> 8 );
+	p[ 3 ] = uint8_t( value );
+}
+
+void putFloat( vector< uint8_t > &data, float value )
+{
+	uint32_t bits;
+	std::memcpy( &bits, &value, sizeof( bits ) );
+	putInt32( data, bits );
+}
+
+void putTimeTag( vector< uint8_t > &data, uint64_t timeTag )
+{
+	putInt32( data, uint32_t( timeTag >> 32 ) );
+	putInt32( data, uint32_t( timeTag ) );
+}
+
+void putString( vector< uint8_t > &data, const char *str, size_t length )
+{
+	size_t offset = grow( data, padded( length + 1 ) );
+	std::memcpy( &data[ offset ], str, length );
+}
+
+void putString( vector< uint8_t > &data, const char *str ) { putString( data, str, std::strlen( str ) ); }
+
+//! Starts a bundle element with a message to \a address with the type tags \a types followed by \a numRepeats
+//! times \a repeatedType. Returns the offset of the element size, which endMessage() fills in.
+size_t beginMessage( vector< uint8_t > &data, const char *address, const char *types, char repeatedType = 0,
+					 size_t numRepeats = 0 )
+{
+	size_t sizeOffset = grow( data, 4 );
+	putString( data, address );
+	size_t length = std::strlen( types );
+	size_t offset = grow( data, padded( 1 + length + numRepeats + 1 ) );
+	data[ offset ] = ',';
+	std::memcpy( &data[ offset + 1 ], types, length );
+	std::memset( &data[ offset + 1 + length ], repeatedType, numRepeats );
+	return sizeOffset;
+}
+
+void endMessage( vector< uint8_t > &data, size_t sizeOffset )
+{
+	uint32_t size = uint32_t( data.size() - sizeOffset - 4 );
+	data[ sizeOffset ] = uint8_t( size >> 24 );
+	data[ sizeOffset + 1 ] = uint8_t( size >> 16 );
+	data[ sizeOffset + 2 ] = uint8_t( size >> 8 );
+	data[ sizeOffset + 3 ] = uint8_t( size );
+}
+
+//! Returns the OSC time tag of the steady clock time \a timestamp.
+uint64_t toTimeTag( double timestamp )
+{
+	double unixTime = chrono::duration< double >( chrono::system_clock::now().time_since_epoch() ).count() -
+					  ( FrameResult::getCurrentTime() - timestamp );
+	double seconds = std::floor( unixTime );
+	return ( ( uint64_t( seconds ) + kNtpUnixOffset ) << 32 ) | uint64_t( ( unixTime - seconds ) * 4294967296.0 );
+}
+
+} // anonymous namespace
+
+//! Connected UDP socket.
+class TuioSender::Socket
+{
+ public:
+	~Socket()
+	{
+		if ( mSocket != kInvalidSocket )
+		{
+			closeSocket( mSocket );
+		}
+#if defined( _WIN32 )
+		if ( mStarted )
+		{
+			WSACleanup();
+		}
+#endif
+	}
+
+	//! Connects to \a port of \a host, returns false if the host cannot be resolved or reached.
+	bool open( const string &host, uint16_t port )
+	{
+#if defined( _WIN32 )
+		WSADATA wsaData;
+		if ( WSAStartup( MAKEWORD( 2, 2 ), &wsaData ) != 0 )
+		{
+			return false;
+		}
+		mStarted = true;
+#endif
+		addrinfo hints;
+		std::memset( &hints, 0, sizeof( hints ) );
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_DGRAM;
+		hints.ai_protocol = IPPROTO_UDP;
+		addrinfo *addresses = nullptr;
+		if ( getaddrinfo( host.c_str(), to_string( port ).c_str(), &hints, &addresses ) != 0 )
+		{
+			return false;
+		}
+		for ( addrinfo *a = addresses; ( a != nullptr ) && ( mSocket == kInvalidSocket ); a = a->ai_next )
+		{
+			mSocket = socket( a->ai_family, a->ai_socktype, a->ai_protocol );
+			if ( ( mSocket != kInvalidSocket ) && ( connect( mSocket, a->ai_addr, int( a->ai_addrlen ) ) != 0 ) )
+			{
+				closeSocket( mSocket );
+				mSocket = kInvalidSocket;
+			}
+		}
+		freeaddrinfo( addresses );
+		return mSocket != kInvalidSocket;
+	}
+
+	bool send( const uint8_t *data, size_t size )
+	{
+		return ::send( mSocket, reinterpret_cast< const char * >( data ), int( size ), 0 ) == int( size );
+	}
+
+ private:
+	SocketHandle mSocket = kInvalidSocket;
+#if defined( _WIN32 )
+	bool mStarted = false;
+#endif
+};
+
+TuioSenderRef TuioSender::create( const string &host, uint16_t port, const Options &options )
+{
+	unique_ptr< Socket > socket( new Socket() );
+	if ( ! socket->open( host, port ) )
+	{
+		return TuioSenderRef();
+	}
+	return TuioSenderRef( new TuioSender( std::move( socket ), options ) );
+}
+
+TuioSender::TuioSender( unique_ptr< Socket > socket, const Options &options ) :
+	mSocket( std::move( socket ) ),
+	mOptions( options )
+{
+	mThread = thread( &TuioSender::sendPackets, this );
+}
+
+TuioSender::~TuioSender()
+{
+	mMailbox.close();
+	if ( mThread.joinable() )
+	{
+		mThread.join();
+	}
+}
+
+void TuioSender::send( const FrameResultRef &frame )
+{
+	if ( ! frame )
+	{
+		return;
+	}
+
+	updateTracks( *frame );
+	pack( *frame, mPackets );
+	mNumFrames++;
+	// the replaced bundles come back in mPackets, their changes are only covered by sending everything
+	if ( mMailbox.post( mPackets ) )
+	{
+		mNumDroppedFrames++;
+		mSendAll = true;
+	}
+}
+
+void TuioSender::updateTracks( const FrameResult &frame )
+{
+	const float scale = 1.f / mOptions.mNormalizationScale;
+	const float dt = ( mNumFrames > 0 ) ? float( frame.getTimestamp() - mLastTimestamp ) : 0.f;
+	mLastTimestamp = frame.getTimestamp();
+
+	auto find = [ this ]( int32_t id )
+	{
+		return std::lower_bound( mTracks.begin(), mTracks.end(), id,
+								 []( const Track &track, int32_t id ) { return track.mId < id; } );
+	};
+
+	for ( const FrameResult::BlobState &blob : frame.getEnded() )
+	{
+		auto it = find( blob.mId );
+		if ( ( it != mTracks.end() ) && ( it->mId == blob.mId ) )
+		{
+			mTracks.erase( it );
+		}
+	}
+
+	for ( const FrameResult::BlobState &blob : frame.getMoved() )
+	{
+		auto it = find( blob.mId );
+		if ( ( it == mTracks.end() ) || ( it->mId != blob.mId ) )
+		{
+			continue;
+		}
+		vec2 velocity = ( dt > 0.f ) ? ( blob.mPos - blob.mPrevPos ) * ( scale / dt ) : vec2( 0.f );
+		it->mAcceleration = ( dt > 0.f ) ? ( glm::length( velocity ) - glm::length( it->mVelocity ) ) / dt : 0.f;
+		it->mVelocity = velocity;
+		it->mPos = blob.mPos * scale;
+		it->mSize = blob.mBounds.getSize() * scale;
+		it->mChanged = true;
+	}
+
+	for ( const FrameResult::BlobState &blob : frame.getBegan() )
+	{
+		auto it = find( blob.mId );
+		if ( ( it == mTracks.end() ) || ( it->mId != blob.mId ) )
+		{
+			it = mTracks.insert( it, Track() );
+		}
+		it->mId = blob.mId;
+		it->mPos = blob.mPos * scale;
+		it->mSize = blob.mBounds.getSize() * scale;
+		it->mVelocity = vec2( 0.f );
+		it->mAcceleration = 0.f;
+		it->mChanged = true;
+	}
+
+	if ( mSendAll )
+	{
+		for ( Track &track : mTracks )
+		{
+			track.mChanged = true;
+		}
+		mSendAll = false;
+	}
+}
+
+void TuioSender::pack( const FrameResult &frame, Packets &packets )
+{
+	vector< uint8_t > &data = packets.mData;
+	data.clear();
+	packets.mEnds.clear();
+	// each of the buffers passed around by the mailbox grows at once, not when it first carries a large frame
+	data.reserve( mMaxDataSize );
+
+	const uint32_t frameId = uint32_t( frame.getFrameNumber() & 0x7fffffff );
+	const uint64_t timeTag =
+			( mOptions.mProtocol == Options::Protocol::TUIO_2_0 ) ? toTimeTag( frame.getTimestamp() ) : kTimeTagImmediately;
+	const size_t tailSize = getBundleTailSize();
+
+	size_t bundleStart = 0;
+	size_t numTracksInBundle = 0;
+	beginBundle( frameId, timeTag, packets );
+	// once the alive ids crowd out the blob messages the bundles are fragmented by IP anyway, then each carries
+	// a packet size of blob messages on top of the ids
+	const size_t fixedSize = data.size() + tailSize;
+	const size_t maxSize = mOptions.mMaxPacketSize;
+	const size_t bundleSize = ( fixedSize > maxSize / 2 ) ? ( fixedSize + maxSize ) : maxSize;
+	// the size of the frame sending all alive blobs, as after a dropped one, which depends on the number of blobs
+	// only, so the buffers stop growing with it
+	const size_t trackSize = getTrackMessageSize();
+	const size_t tracksPerBundle = std::max( ( bundleSize - fixedSize ) / trackSize, size_t( 1 ) );
+	const size_t numBundles = std::max( ( mTracks.size() + tracksPerBundle - 1 ) / tracksPerBundle, size_t( 1 ) );
+	mMaxDataSize = std::max( mMaxDataSize, numBundles * fixedSize + mTracks.size() * trackSize );
+	mMaxNumBundles = std::max( mMaxNumBundles, numBundles );
+	data.reserve( mMaxDataSize );
+	packets.mEnds.reserve( mMaxNumBundles );
+	for ( Track &track : mTracks )
+	{
+		if ( ! track.mChanged )
+		{
+			continue;
+		}
+		track.mChanged = false;
+
+		size_t mark = data.size();
+		packTrack( track, packets );
+		if ( ( numTracksInBundle > 0 ) && ( data.size() - bundleStart + tailSize > bundleSize ) )
+		{
+			data.resize( mark );
+			endBundle( -1, packets );
+			bundleStart = data.size();
+			numTracksInBundle = 0;
+			beginBundle( frameId, timeTag, packets );
+			packTrack( track, packets );
+		}
+		numTracksInBundle++;
+	}
+	endBundle( int32_t( frameId ), packets );
+}
+
+void TuioSender::beginBundle( uint32_t frameId, uint64_t timeTag, Packets &packets ) const
+{
+	vector< uint8_t > &data = packets.mData;
+	std::memcpy( &data[ grow( data, sizeof( kBundleTag ) ) ], kBundleTag, sizeof( kBundleTag ) );
+	putTimeTag( data, timeTag );
+
+	if ( mOptions.mProtocol == Options::Protocol::TUIO_2_0 )
+	{
+		size_t message = beginMessage( data, kTuio2FrameAddress, "itis" );
+		putInt32( data, frameId );
+		putTimeTag( data, timeTag );
+		putInt32( data, ( uint32_t( mOptions.mSensorSize.x ) << 16 ) | ( uint32_t( mOptions.mSensorSize.y ) & 0xffff ) );
+		putString( data, mOptions.mSourceName.c_str(), mOptions.mSourceName.size() );
+		endMessage( data, message );
+		return;
+	}
+
+	if ( ! mOptions.mSourceName.empty() )
+	{
+		size_t message = beginMessage( data, kTuio1Address, "ss" );
+		putString( data, "source" );
+		putString( data, mOptions.mSourceName.c_str(), mOptions.mSourceName.size() );
+		endMessage( data, message );
+	}
+	size_t message = beginMessage( data, kTuio1Address, "s", 'i', mTracks.size() );
+	putString( data, "alive" );
+	for ( const Track &track : mTracks )
+	{
+		putInt32( data, uint32_t( track.mId ) );
+	}
+	endMessage( data, message );
+}
+
+void TuioSender::packTrack( const Track &track, Packets &packets ) const
+{
+	vector< uint8_t > &data = packets.mData;
+	size_t message;
+	if ( mOptions.mProtocol == Options::Protocol::TUIO_2_0 )
+	{
+		// s_id x_pos y_pos angle width height area x_vel y_vel a_vel m_acc r_acc
+		message = beginMessage( data, kTuio2BoundsAddress, "i", 'f', 11 );
+	}
+	else
+	{
+		// set s x y a w h f X Y A m r
+		message = beginMessage( data, kTuio1Address, "si", 'f', 11 );
+		putString( data, "set" );
+	}
+	putInt32( data, uint32_t( track.mId ) );
+	putFloat( data, track.mPos.x );
+	putFloat( data, track.mPos.y );
+	putFloat( data, 0.f );
+	putFloat( data, track.mSize.x );
+	putFloat( data, track.mSize.y );
+	putFloat( data, track.mSize.x * track.mSize.y );
+	putFloat( data, track.mVelocity.x );
+	putFloat( data, track.mVelocity.y );
+	putFloat( data, 0.f );
+	putFloat( data, track.mAcceleration );
+	putFloat( data, 0.f );
+	endMessage( data, message );
+}
+
+void TuioSender::endBundle( int32_t frameSequence, Packets &packets ) const
+{
+	vector< uint8_t > &data = packets.mData;
+	size_t message;
+	if ( mOptions.mProtocol == Options::Protocol::TUIO_2_0 )
+	{
+		message = beginMessage( data, kTuio2AliveAddress, "", 'i', mTracks.size() );
+		for ( const Track &track : mTracks )
+		{
+			putInt32( data, uint32_t( track.mId ) );
+		}
+	}
+	else
+	{
+		message = beginMessage( data, kTuio1Address, "si" );
+		putString( data, "fseq" );
+		putInt32( data, uint32_t( frameSequence ) );
+	}
+	endMessage( data, message );
+	packets.mEnds.push_back( data.size() );
+}
+
+size_t TuioSender::getTrackMessageSize() const
+{
+	if ( mOptions.mProtocol == Options::Protocol::TUIO_2_0 )
+	{
+		return getMessageSize( kTuio2BoundsAddress, 12, 12 * 4 );
+	}
+	return getMessageSize( kTuio1Address, 13, padded( sizeof( "set" ) ) + 12 * 4 );
+}
+
+size_t TuioSender::getBundleTailSize() const
+{
+	if ( mOptions.mProtocol == Options::Protocol::TUIO_2_0 )
+	{
+		return getMessageSize( kTuio2AliveAddress, mTracks.size(), 4 * mTracks.size() );
+	}
+	return getMessageSize( kTuio1Address, 2, padded( sizeof( "fseq" ) ) + 4 );
+}
+
+void TuioSender::sendPackets()
+{
+	Packets packets;
+	while ( mMailbox.waitTake( packets ) )
+	{
+		size_t begin = 0;
+		for ( size_t end : packets.mEnds )
+		{
+			if ( mSocket->send( packets.mData.data() + begin, end - begin ) )
+			{
+				mNumPacketsSent++;
+				mNumBytesSent += end - begin;
+			}
+			else
+			{
+				mNumSendErrors++;
+			}
+			begin = end;
+		}
+	}
+}
+
+} } // namespace mndl::blobtracker
@@ -0,0 +1,161 @@
+/*
+ Copyright (C) 2012-2015 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+
+#include "mndl/blobtracker/WorkStealingPool.h"
+
+using namespace std;
+
+namespace mndl { namespace blobtracker {
+
+WorkStealingPool::WorkStealingPool( size_t numThreads )
+{
+	if ( numThreads == 0 )
+	{
+		numThreads = std::max( thread::hardware_concurrency(), 1u );
+	}
+
+	for ( size_t i = 0; i < numThreads; i++ )
+	{
+		mQueues.emplace_back( new Queue() );
+	}
+	for ( size_t i = 0; i < numThreads; i++ )
+	{
+		mThreads.emplace_back( &WorkStealingPool::workerLoop, this, i );
+	}
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		lock_guard< mutex > lock( mIdleMutex );
+		mStopping = true;
+	}
+	mIdleCondition.notify_all();
+	for ( thread &t : mThreads )
+	{
+		t.join();
+	}
+}
+
+void WorkStealingPool::submit( Task task )
+{
+	// workers keep their own subtasks local
+	size_t index = getWorkerIndex();
+	if ( index == mQueues.size() )
+	{
+		index = mNextQueue.fetch_add( 1, memory_order_relaxed ) % mQueues.size();
+	}
+
+	// counted before it is visible and under the idle mutex, so the count never goes negative
+	// and a worker about to sleep does not miss it
+	{
+		lock_guard< mutex > lock( mIdleMutex );
+		mNumPending++;
+	}
+	{
+		lock_guard< mutex > lock( mQueues[ index ]->mMutex );
+		mQueues[ index ]->mTasks.push_back( std::move( task ) );
+	}
+	mIdleCondition.notify_one();
+}
+
+void WorkStealingPool::wait( const atomic< size_t > &remaining )
+{
+	size_t index = getWorkerIndex() % mQueues.size();
+	Task task;
+	while ( remaining.load( memory_order_acquire ) > 0 )
+	{
+		if ( tryPop( index, task ) )
+		{
+			task();
+			task = nullptr;
+		}
+		else
+		{
+			this_thread::yield();
+		}
+	}
+}
+
+size_t WorkStealingPool::getWorkerIndex() const
+{
+	// the thread ids are fixed after construction
+	const thread::id self = this_thread::get_id();
+	for ( size_t i = 0; i < mThreads.size(); i++ )
+	{
+		if ( mThreads[ i ].get_id() == self )
+		{
+			return i;
+		}
+	}
+	return mThreads.size();
+}
+
+bool WorkStealingPool::tryPop( size_t index, Task &task )
+{
+	{
+		Queue &own = *mQueues[ index ];
+		lock_guard< mutex > lock( own.mMutex );
+		if ( ! own.mTasks.empty() )
+		{
+			task = std::move( own.mTasks.back() );
+			own.mTasks.pop_back();
+			mNumPending--;
+			return true;
+		}
+	}
+
+	for ( size_t i = 1; i < mQueues.size(); i++ )
+	{
+		Queue &victim = *mQueues[ ( index + i ) % mQueues.size() ];
+		lock_guard< mutex > lock( victim.mMutex );
+		if ( ! victim.mTasks.empty() )
+		{
+			task = std::move( victim.mTasks.front() );
+			victim.mTasks.pop_front();
+			mNumPending--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkStealingPool::workerLoop( size_t index )
+{
+	Task task;
+	while ( true )
+	{
+		if ( tryPop( index, task ) )
+		{
+			task();
+			task = nullptr;
+			continue;
+		}
+
+		unique_lock< mutex > lock( mIdleMutex );
+		mIdleCondition.wait( lock, [ this ] { return ( mNumPending > 0 ) || mStopping; } );
+		if ( mStopping && ( mNumPending == 0 ) )
+		{
+			break;
+		}
+	}
+}
+
+} } // namespace mndl::blobtracker